@@ -7,10 +7,78 @@
  */
 
 #define NETWORK_PORT 53000
+// Increment whenever the encoding of any network packet changes
+#define NETWORK_PROTOCOL_VERSION 11
 #define MAX_NUM_PLAYERS 6
+// Spectators, see GameServer.h
+#define MAX_NUM_SPECTATORS 64
+#define SPECTATOR_MAX_QUEUED_STEPS 100
+// Joining a running game, see GameServer.h
+#define CHECKPOINT_INTERVAL_STEPS 600
+#define CHECKPOINT_CHUNK_BYTES 16384
+#define CATCH_UP_CHUNK_STEPS 200
+// Actions per packet (sent as Uint8), per step and waiting per client
+#define MAX_ACTIONS_PER_PACKET 255
+#define MAX_ACTIONS_PER_STEP 8
+#define MAX_QUEUED_ACTIONS_PER_CLIENT 64
+// UDP redundancy, see GamePacketTypes.h
+#define UDP_REDUNDANT_STEPS 10
+#define UDP_MAX_UNACKED_ACTIONS 32
+// Input delay, see GameServer::chooseInputDelay
+#define INPUT_DELAY_MIN_STEPS 2
+#define INPUT_DELAY_MAX_STEPS 10
+#define INPUT_DELAY_ADAPT_INTERVAL_STEPS 50
+// Clock synchronization, see ClockSync.h
+#define CLOCK_SYNC_INTERVAL_MS 1000
+#define CLOCK_SYNC_INITIAL_INTERVAL_MS 100
+#define CLOCK_SYNC_MIN_SAMPLES 5
+#define CLOCK_SYNC_HISTORY_SAMPLES 32
+#define CLOCK_SYNC_DELAY_TOLERANCE_MS 2
+#define CLOCK_SYNC_MIN_DRIFT_SPAN_MS 10000
+#define CLOCK_SYNC_MAX_DRIFT_PPM 500.0
+// Start of the match, see GameServer::updateStartBarrier
+#define START_BARRIER_TIMEOUT_MS 15000
+#define START_DELAY_MS 300
+#define CLOCK_SYNC_LEAD_MS 5
+// Input latency tracing, see LatencyTrace.h
+#define LATENCY_TRACE_HISTORY_ACTIONS 1000
+#define LATENCY_TRACE_MAX_PENDING_ACTIONS 256
+// Catching up with the schedule, see Game::simulate
+#define CATCH_UP_SPEED_PERCENT 125
+#define CATCH_UP_MAX_BACKLOG_STEPS 20
+#define CATCH_UP_FRAME_BUDGET_MS 8
+#define CATCH_UP_REPLAY_BUDGET_MS 50
+// Aggregation interval of the network statistics
+#define NETWORK_STATS_INTERVAL_MS 1000
+// Ticks of the dedicated server's loop and the simulation thread
+#define DEDICATED_SERVER_TICK_MS 1
+#define SIMULATION_THREAD_TICK_MS 1
+// Job system, see JobSystem.h
+#define JOB_SYSTEM_MAX_WORKERS 16
+#define UPDATE_DRAWABLES_GRAIN_SIZE 64
+#define CREEP_PLANNING_GRAIN_SIZE 32
+// Countdown of the dedicated server's lobby, see LobbyServer.h
+#define DEDICATED_SERVER_START_DELAY_SEC 10
+// The host's network thread, see GameServer.h
+#define NETWORK_THREAD_TICK_MS 1
+#define NETWORK_THREAD_QUEUE_CAPACITY 256
+#define NETWORK_THREAD_MAX_WAIT_MS 100
+// Connecting to a host, see TcpConnector.h
+#define CONNECT_ATTEMPT_TIMEOUT_MS 5000
+#define CONNECT_ATTEMPT_STAGGER_MS 250
+#define CONNECT_RETRY_BACKOFF_MS 1000
+#define CONNECT_MAX_ROUNDS 3
+#define LOBBY_HANDSHAKE_TIMEOUT_MS 10000
+// Testing, see LoopbackConnection.h and NetworkSoak.h
+#define LOOPBACK_RETRANSMISSION_MS 200
+#define SOAK_BOT_ACTION_INTERVAL_MS 500
 #define MAX_LIVES 40
 #define SIMULATION_TIME_STEP_MS 100
 #define SIMULATION_TIME_STEP_SEC (SIMULATION_TIME_STEP_MS / 1000.0)
+// Side length in tiles of the chunks of Tilemap and CharacterContainer
+#define MAP_CHUNK_SIZE 32
+// Averaging window of the step timings in the debug overlay
+#define SIMULATION_TIMING_WINDOW_STEPS 50
 
 #define DEFAULT_CHARACTER_RADIUS 0.25
 #define DEFAULT_CHARACTER_ATTACK_RANGE 2
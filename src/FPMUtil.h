@@ -8,8 +8,23 @@
 #include <fpm/math.hpp>
 
 
+#ifdef ARENA_WIDE_FIXED_POINT
+// 32.32 fixed-point numbers (see the ARENA_WIDE_FIXED_POINT option in CMakeLists.txt). With 16.16, squared distances
+// (getLengthSq) overflow for distances above ~181 tiles; with 32.32, this only happens above ~46000 tiles.
+// Multiplication and division need a 128 bit intermediate type. FPMNum24 is widened as well, since converting
+// between fpm types happens in the raw type of the source.
+typedef fpm::fixed<std::int64_t, __int128, 32> FPMNum;
+typedef fpm::fixed<std::int64_t, __int128, 8> FPMNum24;
+typedef sf::Int64 FPMRawValue;
+#define FPM_FRACTION_BITS 32
+#else
 typedef fpm::fixed_16_16 FPMNum;
 typedef fpm::fixed_24_8 FPMNum24;
+typedef sf::Int32 FPMRawValue;
+#define FPM_FRACTION_BITS 16
+#endif
+// FPMRawValue has the size of FPMNum's raw value and is used to send FPMNums over the network.
+// FPM_FRACTION_BITS is stored in cooked maps, which are only valid for one kind of build.
 typedef sf::Vector2<FPMNum> FPMVector2;
 typedef sf::Rect<FPMNum> FPMRect;
 
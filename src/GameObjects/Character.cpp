@@ -1,6 +1,8 @@
 #include <iostream>
 #include "Character.h"
 #include "../Constants.h"
+#include "../JobSystem.h"
+#include "../NetworkEvents/WireFormat.h"
 #include "SFML/Graphics/Glsl.hpp"
 #include "SFML/Graphics/RenderStates.hpp"
 #include "SFML/Graphics/Shader.hpp"
@@ -10,8 +12,10 @@
 
 std::vector<std::unique_ptr<AnimatedTileset>> Character::characterTilesets;
 std::array<std::unique_ptr<sf::Texture>, static_cast<unsigned int>(CONDITIONS::CONDITIONS_COUNT)> Character::conditionIcons;
+bool Character::texturesLoaded = false;
 
-void Character::loadStaticResources() {
+void Character::loadStaticResources(bool loadTextures) {
+    texturesLoaded = loadTextures;
     characterTilesets.clear();
     characterTilesets.resize(static_cast<unsigned int>(CHARACTERS::CHARACTERS_COUNT) *
                              static_cast<unsigned int>(ANIMATION_STATE::CHARACTER_STATE_COUNT));
@@ -23,27 +27,50 @@ void Character::loadStaticResources() {
 
     // Parsing
     std::string lineBuffer, cellBuffer;
-    std::vector<std::string> entries;
+    std::vector<std::vector<std::string>> tilesets;
     // First lineBuffer is just a comment
     std::getline(file, lineBuffer);
     while (file.good()) {
+        std::getline(file, lineBuffer);
+        if (lineBuffer.size() == 0)
+            break;
+        std::vector<std::string> entries;
+        std::stringstream ss(lineBuffer);
+        while (std::getline(ss, cellBuffer, ','))
+            entries.push_back(cellBuffer);
+        if (entries.size() < 9)
+            throw std::runtime_error("Malformed file: " + charactersInfoFilePath);
+        tilesets.push_back(std::move(entries));
+    }
+    file.close();
+
+    // Decoding the PNGs takes most of the loading time, so they are decoded in parallel. The textures are then created
+    // here, where the OpenGL context is
+    std::vector<sf::Image> images(loadTextures ? tilesets.size() : 0);
+    JobSystem::parallelFor(images.size(), 1, [&images, &tilesets](std::size_t begin, std::size_t end) {
+        for (auto i = begin; i < end; i++) {
+            if (!images[i].loadFromFile(toStr("Data/characters/", tilesets[i][2])))
+                throw std::runtime_error(toStr("Could not load tileset Data/characters/", tilesets[i][2]));
+        }
+    });
+    for (std::size_t i = 0; i < tilesets.size(); i++) {
+        const auto& entries = tilesets[i];
         try {
-            std::getline(file, lineBuffer);
-            if (lineBuffer.size() == 0)
-                break;
-            entries.clear();
-            std::stringstream ss(lineBuffer);
-            while (std::getline(ss, cellBuffer, ','))
-                entries.push_back(cellBuffer);
             unsigned int posInArray = std::stoi(entries[0]) * static_cast<unsigned int>(ANIMATION_STATE::CHARACTER_STATE_COUNT) + std::stoi(entries[1]);
-            characterTilesets[posInArray] = std::make_unique<AnimatedTileset>(toStr("Data/characters/", entries[2]), std::stoi(entries[5]),
-                std::stoi(entries[6]), std::stoi(entries[7]), std::stoi(entries[3]), std::stoi(entries[4]), std::stof(entries[8]));
-        } catch (...) {
+            if (loadTextures)
+                characterTilesets.at(posInArray) = std::make_unique<AnimatedTileset>(images[i], std::stoi(entries[5]),
+                    std::stoi(entries[6]), std::stoi(entries[7]), std::stoi(entries[3]), std::stoi(entries[4]), std::stof(entries[8]));
+            else
+                characterTilesets.at(posInArray) = std::make_unique<AnimatedTileset>(toStr("Data/characters/", entries[2]), std::stoi(entries[5]),
+                    std::stoi(entries[6]), std::stoi(entries[7]), std::stoi(entries[3]), std::stoi(entries[4]), std::stof(entries[8]), false);
+        } catch (const std::logic_error&) {
+            // std::stoi etc. and at() throw std::invalid_argument and std::out_of_range
             throw std::runtime_error("Malformed file: " + charactersInfoFilePath);
         }
     }
-    file.close();
 
+    if (!loadTextures)
+        return;
     std::generate(conditionIcons.begin(), conditionIcons.end(), std::make_unique<sf::Texture>);
     conditionIcons[static_cast<unsigned int>(CONDITIONS::IMMOBILE)]->loadFromFile("Data/conditions/immobile.png");
     conditionIcons[static_cast<unsigned int>(CONDITIONS::IMMUNE_TO_DAMAGE)]->loadFromFile("Data/conditions/immune.png");
@@ -55,41 +82,62 @@ void Character::loadStaticResources() {
 
 void Character::unloadStaticResources() {
     characterTilesets.clear();
+    texturesLoaded = false;
     std::fill(conditionIcons.begin(), conditionIcons.end(), nullptr);
 }
 
 Character::Character(sf::Uint32 ID, CHARACTERS characterNum, FPMVector2 spawnPosition, const std::shared_ptr<Tilemap>& tilemap, const std::shared_ptr<CharacterContainer>& characterContainer, unsigned int randomSeed) :
         ID(ID), type(characterNum), mapPosition(spawnPosition), curOrientation(ORIENTATIONS::W), animationStep(0.f),
+        simulatedAnimationStep(0.f), renderedAnimationState(ANIMATION_STATE::STOP),
         curAnimationState(ANIMATION_STATE::STOP), tilemap(tilemap), maxMovementPerSecond(0),
         groundRadius(DEFAULT_CHARACTER_RADIUS), maxHP(30), HP(30), attackRange(DEFAULT_CHARACTER_ATTACK_RANGE),
         characterContainer(characterContainer), gen(randomSeed),
         attackDamageHP(0), attackCooldownMS(1000), attackTimer(0), hoverColor(sf::Color::White),
         attackTargetID(ID), animationStepsPerSecondFactor(1.f), conditionPoisonDmgPerSec(0) {
     characterContainer->insert(this, mapPosition, groundRadius);
-    healthRect.setFillColor(sf::Color(255, 0, 0));
-    characterIDShader.loadFromFile("Data/character_id_shader.glsl", sf::Shader::Type::Fragment); 
-    characterIDShader.setUniform("texture", sf::Shader::CurrentTexture);
-    characterIDShader.setUniform("characterID", sf::Glsl::Vec3((((ID + 1) >> 16) & 0xFF) / 255.f, (((ID + 1) >> 8) & 0xFF) / 255.f, ((ID + 1) & 0xFF) / 255.f));
     conditionTimers.fill(FPMNum24(0));
+    if (!texturesLoaded)
+        return;
+    healthRect.setFillColor(sf::Color(255, 0, 0));
+    characterIDShader = std::make_unique<sf::Shader>();
+    characterIDShader->loadFromFile("Data/character_id_shader.glsl", sf::Shader::Type::Fragment); 
+    characterIDShader->setUniform("texture", sf::Shader::CurrentTexture);
+    characterIDShader->setUniform("characterID", sf::Glsl::Vec3((((ID + 1) >> 16) & 0xFF) / 255.f, (((ID + 1) >> 8) & 0xFF) / 255.f, ((ID + 1) & 0xFF) / 255.f));
 }
 
-bool Character::updateDrawables(const sf::FloatRect& frustum, float elapsedSeconds, unsigned int elapsedMSSinceLastSimulationStep) {
+CharacterRenderState Character::getRenderState() const {
+    CharacterRenderState state;
+    state.mapPosition = mapPosition;
+    getNextSimulationPosition(state.nextMapPosition);
+    state.orientation = curOrientation;
+    state.animationState = curAnimationState;
+    state.animationStepsPerSecondFactor = animationStepsPerSecondFactor;
+    state.hpFraction = static_cast<float>(HP / maxHP);
+    state.attackTargetID = attackTargetID;
+    return state;
+}
+
+bool Character::updateDrawables(const CharacterRenderState& state, const sf::FloatRect& frustum, float elapsedSeconds, unsigned int elapsedMSSinceLastSimulationStep) {
     // Update animation, even if the character is not currently visible
-    auto curTilesetNum = getTilesetIndex(type, curAnimationState);
+    if (state.animationState != renderedAnimationState) {
+        renderedAnimationState = state.animationState;
+        animationStep = 0.f;
+    }
+    auto curTilesetNum = getTilesetIndex(type, renderedAnimationState);
     auto maxAnimationStep = characterTilesets[curTilesetNum]->getNumTilesAnimation();
     if (maxAnimationStep > 1) {
-        animationStep += elapsedSeconds * characterTilesets[curTilesetNum]->getDefaultAnimationStepsPerSecond() * animationStepsPerSecondFactor;
+        animationStep += elapsedSeconds * characterTilesets[curTilesetNum]->getDefaultAnimationStepsPerSecond() * state.animationStepsPerSecondFactor;
         if (animationStep >= maxAnimationStep) {
-            if (curAnimationState == ANIMATION_STATE::DIE or curAnimationState == ANIMATION_STATE::SPELL or curAnimationState == ANIMATION_STATE::HIT)
+            if (renderedAnimationState == ANIMATION_STATE::DIE or renderedAnimationState == ANIMATION_STATE::SPELL or renderedAnimationState == ANIMATION_STATE::HIT)
                 animationStep = maxAnimationStep - 1;
             else
                 animationStep -= (int) animationStep;
         }
     }
 
-    auto visible = frustum.contains(tilemap->mapToWorld(mapPosition));
+    auto visible = frustum.contains(tilemap->mapToWorld(state.mapPosition));
     if (visible) {
-        sprite.setTextureRect(characterTilesets[curTilesetNum]->getTileCoordinates(curOrientation, animationStep));
+        sprite.setTextureRect(characterTilesets[curTilesetNum]->getTileCoordinates(state.orientation, animationStep));
         sprite.setTexture(characterTilesets[curTilesetNum]->getTexture(), false);
         sprite.setOrigin(characterTilesets[curTilesetNum]->getOrigin());
 
@@ -98,15 +146,13 @@ bool Character::updateDrawables(const sf::FloatRect& frustum, float elapsedSecon
         // We display the character at its most likely next position, assuming it does not change its course.
         // This might turn out to be wrong later once we received the next events, but helps
         // to make movement look much more natural in most cases.
-        FPMVector2 newPosition;
-        getNextSimulationPosition(newPosition);
-        FPMVector2 mapPositionToRender = mapPosition + (newPosition - mapPosition) *
-                                                       FPMNum(std::min(elapsedMSSinceLastSimulationStep, (unsigned int) SIMULATION_TIME_STEP_MS) / (float) SIMULATION_TIME_STEP_MS);
+        FPMVector2 mapPositionToRender = state.mapPosition + (state.nextMapPosition - state.mapPosition) *
+                                                             FPMNum(std::min(elapsedMSSinceLastSimulationStep, (unsigned int) SIMULATION_TIME_STEP_MS) / (float) SIMULATION_TIME_STEP_MS);
         auto worldPositionToRender = tilemap->mapToWorld(mapPositionToRender);
         sprite.setPosition(worldPositionToRender);
-        sprite.setDepth(1.f - ((((unsigned int) mapPositionToRender.y) * tilemap->getWidth() + (float) mapPositionToRender.x) / (tilemap->getHeight() * tilemap->getWidth())));
+        sprite.setDepth(tilemap->getDepth(mapPositionToRender));
 
-        healthRect.setSize(sf::Vector2f((float)(HP/maxHP) * 40.f, 5.f));
+        healthRect.setSize(sf::Vector2f(state.hpFraction * 40.f, 5.f));
         healthRect.setPosition(worldPositionToRender.x - 20.f, worldPositionToRender.y - 75.f);
     }
     hoverColor = sf::Color::White;
@@ -118,7 +164,7 @@ void Character::drawSprite(sf::RenderTarget& target) {
 }
 
 void Character::drawCharacterID(sf::RenderTarget& target) {
-    target.draw(sprite, &characterIDShader);
+    target.draw(sprite, characterIDShader.get());
 }
 
 void Character::drawUI(sf::RenderTarget &target) {
@@ -161,11 +207,11 @@ void Character::setAnimationState(ANIMATION_STATE state, float animationStepsPer
     // Animations have some precedence rules. For example, the HIT animation is more relevant to show than the WALK animation.
     if (curAnimationState == ANIMATION_STATE::DIE and isDead())
         return;
-    if ((curAnimationState == ANIMATION_STATE::SPELL or curAnimationState == ANIMATION_STATE::HIT) and (state == ANIMATION_STATE::RUN or state == ANIMATION_STATE::WALK or state == ANIMATION_STATE::STOP or state == ANIMATION_STATE::ATTACK) and animationStep < characterTilesets[getTilesetIndex(type, curAnimationState)]->getNumTilesAnimation() - 1)
+    if ((curAnimationState == ANIMATION_STATE::SPELL or curAnimationState == ANIMATION_STATE::HIT) and (state == ANIMATION_STATE::RUN or state == ANIMATION_STATE::WALK or state == ANIMATION_STATE::STOP or state == ANIMATION_STATE::ATTACK) and simulatedAnimationStep < characterTilesets[getTilesetIndex(type, curAnimationState)]->getNumTilesAnimation() - 1)
         return;
 
     if (curAnimationState != state)
-        animationStep = 0.f;
+        simulatedAnimationStep = 0.f;
     curAnimationState = state;
     if (animationStepsPerSecondFactor > 4.f)
         animationStepsPerSecondFactor = 4.f;
@@ -293,9 +339,10 @@ void Character::heal(FPMNum amountHP) {
 }
 
 bool Character::deathAnimationComplete() const {
-    if (curAnimationState != ANIMATION_STATE::DIE)
-        throw std::runtime_error("Called deathAnimationComplete but character is not currently dying");
-    return animationStep >= characterTilesets[getTilesetIndex(type, curAnimationState)]->getNumTilesAnimation() - 1;
+    // The rendering may not have seen the DIE animation yet
+    if (renderedAnimationState != ANIMATION_STATE::DIE)
+        return false;
+    return animationStep >= characterTilesets[getTilesetIndex(type, renderedAnimationState)]->getNumTilesAnimation() - 1;
 }
 
 void Character::killedCreep(FPMNum fractionOfDamageCaused) {
@@ -373,6 +420,9 @@ void Character::simulate() {
     /// The following is related to rendering, but we actually don't have to recompute this every frame.
     /// So we only do it when velocity or attacking state change (i.e. during a call to simulate)
     /////////////////////////////////////////////////////////////////
+    auto curTileset = characterTilesets[getTilesetIndex(type, curAnimationState)].get();
+    simulatedAnimationStep = std::min(simulatedAnimationStep + static_cast<float>(SIMULATION_TIME_STEP_SEC) * curTileset->getDefaultAnimationStepsPerSecond() * animationStepsPerSecondFactor,
+                                      static_cast<float>(curTileset->getNumTilesAnimation()));
     if (attackTargetID != this->ID) {
         setAnimationState(ANIMATION_STATE::ATTACK, 1000.f / static_cast<float>(getAttackCooldownMS()));
         if (characterContainer->isAlive(attackTargetID))  // Target may have been killed in the meantime
@@ -397,3 +447,68 @@ FPMNum24 Character::getAttackCooldownMS() const {
     else
         return attackCooldownMS;
 }
+
+void Character::saveState(sf::Packet &packet) const {
+    writeVarUint(packet, gen.getSeed());
+    writeVarUint(packet, gen.getNumDrawn());
+    packet << static_cast<sf::Uint8>(type) << static_cast<sf::Uint8>(curAnimationState) << static_cast<sf::Uint8>(curOrientation);
+    writeFixed(packet, mapPosition.x);
+    writeFixed(packet, mapPosition.y);
+    writeFixed(packet, velocity.x);
+    writeFixed(packet, velocity.y);
+    writeFixed(packet, maxMovementPerSecond);
+    writeFixed(packet, groundRadius);
+    writeFixed(packet, HP);
+    writeFixed(packet, maxHP);
+    writeFixed(packet, attackRange);
+    writeFixed(packet, attackDamageHP);
+    writeFixed(packet, attackCooldownMS);
+    writeFixed(packet, attackTimer);
+    writeVarUint(packet, attackTargetID);
+    for (unsigned int i = 0; i < conditionTimers.size(); i++) {
+        writeFixed(packet, conditionTimers[i]);
+        writeVarUint(packet, conditionAttackerIDs[i]);
+    }
+    writeFixed(packet, conditionPoisonDmgPerSec);
+    // The animation is part of the game logic, since it decides when SPELL and HIT may be replaced
+    writeFloat(packet, animationStepsPerSecondFactor);
+    writeFloat(packet, simulatedAnimationStep);
+}
+
+void Character::loadState(sf::Packet &packet) {
+    // The character is registered again at its new position, unless it is dead
+    characterContainer->remove(this, mapPosition, groundRadius);
+    auto seed = static_cast<RandomGenerator::result_type>(readVarUint(packet));
+    gen.restore(seed, readVarUint(packet));
+    sf::Uint8 typeNum, animationStateNum, orientationNum;
+    packet >> typeNum >> animationStateNum >> orientationNum;
+    if (!packet or typeNum >= static_cast<sf::Uint8>(CHARACTERS::CHARACTERS_COUNT) or
+        animationStateNum >= static_cast<sf::Uint8>(ANIMATION_STATE::CHARACTER_STATE_COUNT) or
+        orientationNum >= static_cast<sf::Uint8>(ORIENTATIONS::NUM_ORIENTATIONS))
+        throw std::runtime_error("Invalid character in checkpoint");
+    type = static_cast<CHARACTERS>(typeNum);
+    curAnimationState = static_cast<ANIMATION_STATE>(animationStateNum);
+    curOrientation = static_cast<ORIENTATIONS>(orientationNum);
+    mapPosition.x = readFixed<FPMNum>(packet);
+    mapPosition.y = readFixed<FPMNum>(packet);
+    velocity.x = readFixed<FPMNum>(packet);
+    velocity.y = readFixed<FPMNum>(packet);
+    maxMovementPerSecond = readFixed<FPMNum>(packet);
+    groundRadius = readFixed<FPMNum>(packet);
+    HP = readFixed<FPMNum>(packet);
+    maxHP = readFixed<FPMNum>(packet);
+    attackRange = readFixed<FPMNum>(packet);
+    attackDamageHP = readFixed<FPMNum>(packet);
+    attackCooldownMS = readFixed<FPMNum24>(packet);
+    attackTimer = readFixed<FPMNum24>(packet);
+    attackTargetID = static_cast<sf::Uint32>(readVarUint(packet));
+    for (unsigned int i = 0; i < conditionTimers.size(); i++) {
+        conditionTimers[i] = readFixed<FPMNum24>(packet);
+        conditionAttackerIDs[i] = static_cast<sf::Uint32>(readVarUint(packet));
+    }
+    conditionPoisonDmgPerSec = readFixed<FPMNum>(packet);
+    animationStepsPerSecondFactor = readFloat(packet);
+    simulatedAnimationStep = readFloat(packet);
+    if (!isDead())
+        characterContainer->insert(this, mapPosition, groundRadius);
+}
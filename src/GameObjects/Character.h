@@ -1,6 +1,7 @@
 #pragma once
 
 #include "SFML/Graphics.hpp"
+#include "SFML/Network.hpp"
 #include <random>
 #include <vector>
 #include "../Render/AnimatedTileset.h"
@@ -11,6 +12,7 @@
 #include "../Render/Sprite3.h"
 #include "../Util.h"
 #include "../FPMUtil.h"
+#include "../RandomGenerator.h"
 
 enum class CHARACTERS : sf::Uint8 {
     ARCHER, BAT, DINO, GHOST, GNOME, KNIGHT, MAGE, MONK, OGRE, ORC, SPIDER, WOLF, ZOMBIE, GREEN_ZOMBIE, PINK_ZOMBIE,
@@ -26,6 +28,18 @@ enum class CONDITIONS {
     IMMOBILE, IMMUNE_TO_DAMAGE, CONFUSED, ENRAGED, POISONED, CONDITIONS_COUNT
 };
 
+// What the rendering needs to know about a character's state after a simulation step (see RenderSnapshot.h)
+struct CharacterRenderState {
+    FPMVector2 mapPosition;
+    // Where the character will be after the next step if it keeps its course
+    FPMVector2 nextMapPosition;
+    ORIENTATIONS orientation;
+    ANIMATION_STATE animationState;
+    float animationStepsPerSecondFactor;
+    float hpFraction;
+    sf::Uint32 attackTargetID;
+};
+
 /***
  * Super class for players, creeps, spawn point guards, and allies.
  * There a some attributes related to the game logic (HP, position in the map etc.), stored using integers
@@ -34,6 +48,10 @@ enum class CONDITIONS {
  * be stored as floats.
  *
  * A character can have CONDITIONS, which disappear after a time.
+ *
+ * The simulation and the rendering run on different threads (see Game::runSimulationThread). Rendering does not read
+ * the game logic attributes directly, but a CharacterRenderState captured after each step, and only it touches the
+ * attributes related to rendering.
  * */
 class Character {
 public:
@@ -47,8 +65,11 @@ public:
 
     virtual bool isPlayerOrAlly() const;
 
+    // Called by the simulation after each step, for the rendering
+    CharacterRenderState getRenderState() const;
+
     // Must be called before drawing the character to perform culling and update the animation.
-    virtual bool updateDrawables(const sf::FloatRect& frustum, float elapsedSeconds, unsigned int elapsedMSSinceLastSimulationStep);
+    virtual bool updateDrawables(const CharacterRenderState& state, const sf::FloatRect& frustum, float elapsedSeconds, unsigned int elapsedMSSinceLastSimulationStep);
 
     // Draw the character's sprite. Supports depth testing.
     void drawSprite(sf::RenderTarget& target);
@@ -62,8 +83,9 @@ public:
     // Makes the character have a certain color tint for the next draw call. Make sure updateDrawables is called after this function.
     void hover(const sf::Color& color) { this->hoverColor = color; }
 
-    // Load character tile sheets to memory
-    static void loadStaticResources();
+    // Load character tile sheets to memory. Without textures (on the dedicated server), only the animation information
+    // needed by the simulation is loaded, and characters skip all graphics resources
+    static void loadStaticResources(bool loadTextures = true);
 
     // Unload character tile sheets from memory
     static void unloadStaticResources();
@@ -89,7 +111,7 @@ public:
 
     sf::Uint32 getID() const { return ID; }
 
-    // True if the character has died and the corresponding animation finished. For creeps, we destroy the creep object once the animation has finished.
+    // True if the character has died and the corresponding animation finished (as rendered so far). For creeps, we destroy the creep object once the animation has finished.
     bool deathAnimationComplete() const;
 
     const FPMNum &getHp() const { return HP; }
@@ -117,6 +139,7 @@ public:
     // Set the current animation. animationStepsPerSecondFactor can be used to speed up or slow down animations, e.g., to simulate faster walking speed.
     void setAnimationState(ANIMATION_STATE state, float animationStepsPerSecondFactor = 1.f);
 
+    // The step of the animation as rendered, see updateDrawables
     float getAnimationStep() const { return animationStep; }
 
     bool hasCondition(CONDITIONS condition) const { return conditionTimers[static_cast<unsigned int>(condition)] > FPMNum24(0);}
@@ -125,6 +148,13 @@ public:
     void giveCondition(CONDITIONS condition, FPMNum24 lengthMS, sf::Uint32 attackerID, FPMNum data = FPMNum(-1));
 
     static const std::unique_ptr<sf::Texture>& getConditionIcon(CONDITIONS condition) { return conditionIcons[static_cast<unsigned int>(condition)]; }
+
+    // Write the attributes related to the game logic to a checkpoint (see Game::saveCheckpoint)
+    virtual void saveState(sf::Packet& packet) const;
+
+    // Restore the attributes written by saveState, including the character's place in the characterContainer.
+    // Throws std::runtime_error on malformed data
+    virtual void loadState(sf::Packet& packet);
 protected:
     static bool tilesetExists(CHARACTERS type, ANIMATION_STATE state);
 
@@ -133,7 +163,7 @@ protected:
 
     void setOrientationFromVector(const FPMVector2& direction);
 
-    std::mt19937 gen;
+    RandomGenerator gen;
     sf::Uint32 ID;
     CHARACTERS type;
     FPMVector2 mapPosition;
@@ -166,12 +196,19 @@ protected:
     Sprite3 sprite;
 private:
     static std::vector<std::unique_ptr<AnimatedTileset>> characterTilesets;
+    static bool texturesLoaded;
 
     static unsigned int getTilesetIndex(CHARACTERS type, ANIMATION_STATE state);
 
+    float animationStepsPerSecondFactor;
+    // How far the current animation would have progressed, to let SPELL and HIT finish before they are replaced
+    float simulatedAnimationStep;
+
+    // Only used for rendering
     sf::Color hoverColor;
-    sf::Shader characterIDShader;
+    // nullptr without textures, since even destroying an unused sf::Shader needs an OpenGL context
+    std::unique_ptr<sf::Shader> characterIDShader;
+    ANIMATION_STATE renderedAnimationState;
     float animationStep;
-    float animationStepsPerSecondFactor;
     sf::RectangleShape healthRect;
 };
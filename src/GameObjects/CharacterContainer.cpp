@@ -3,15 +3,33 @@
 #include "../Constants.h"
 
 CharacterContainer::CharacterContainer(const std::shared_ptr<Tilemap>& tileMap) : tileMap(tileMap) {
-    characterMap.resize(tileMap->getWidth() * tileMap->getHeight() + 1);
+    chunksX = (tileMap->getWidth() + MAP_CHUNK_SIZE - 1) / MAP_CHUNK_SIZE;
+    auto chunksY = (tileMap->getHeight() + MAP_CHUNK_SIZE - 1) / MAP_CHUNK_SIZE;
+    characterChunks.resize(chunksX * chunksY);
 }
 
-std::list<Character*> &CharacterContainer::getCharactersAt(const FPMVector2 &map) {
+const std::list<Character*> &CharacterContainer::getCharactersAt(const FPMVector2 &map) const {
     auto x = static_cast<int>(map.x);
     auto y = static_cast<int>(map.y);
     if (x < 0 or y < 0 or x >= tileMap->getWidth() or y >= tileMap->getHeight())
-        return characterMap[tileMap->getWidth() * tileMap->getHeight()];
-    return characterMap[y * tileMap->getWidth() + x];
+        return noCharacters;
+    const auto &chunk = characterChunks[(y / MAP_CHUNK_SIZE) * chunksX + x / MAP_CHUNK_SIZE];
+    if (!chunk)
+        return noCharacters;
+    return (*chunk)[(y % MAP_CHUNK_SIZE) * MAP_CHUNK_SIZE + x % MAP_CHUNK_SIZE];
+}
+
+std::list<Character *> &CharacterContainer::getTileForInsert(int x, int y) {
+    auto &chunk = characterChunks[(y / MAP_CHUNK_SIZE) * chunksX + x / MAP_CHUNK_SIZE];
+    if (!chunk)
+        chunk = std::make_unique<Chunk>();
+    return (*chunk)[(y % MAP_CHUNK_SIZE) * MAP_CHUNK_SIZE + x % MAP_CHUNK_SIZE];
+}
+
+void CharacterContainer::removeFromTile(Character *c, int x, int y) {
+    auto &chunk = characterChunks[(y / MAP_CHUNK_SIZE) * chunksX + x / MAP_CHUNK_SIZE];
+    if (chunk)
+        (*chunk)[(y % MAP_CHUNK_SIZE) * MAP_CHUNK_SIZE + x % MAP_CHUNK_SIZE].remove(c);
 }
 
 std::unique_ptr<std::set<Character*>> CharacterContainer::getCharactersAtWithTolerance(const FPMVector2 &map, FPMNum tolerance) {
@@ -22,7 +40,8 @@ std::unique_ptr<std::set<Character*>> CharacterContainer::getCharactersAtWithTol
         for (int y = static_cast<int>(map.y - tolerance); y <= static_cast<int>(map.y + tolerance); y++) {
             if (y < 0 or y >= tileMap->getHeight())
                 continue;
-            returnSet->insert(characterMap[y * tileMap->getWidth() + x].begin(), characterMap[y * tileMap->getWidth() + x].end());
+            const auto &charactersOnTile = getCharactersAt(FPMVector2(FPMNum(x), FPMNum(y)));
+            returnSet->insert(charactersOnTile.begin(), charactersOnTile.end());
         }
     }
     return std::move(returnSet);
@@ -49,10 +68,10 @@ void CharacterContainer::update(Character* c, const FPMVector2 &oldPos, const FP
                 continue;
             if (((x < oldCoveredLeft or x > oldCoveredRight) and y >= newCoveredTop and y <= newCoveredBottom) or
                 ((y < oldCoveredTop or y > oldCoveredBottom) and x >= newCoveredLeft and x <= newCoveredRight))
-                characterMap[y * tileMap->getWidth() + x].push_back(c);
+                getTileForInsert(x, y).push_back(c);
             else if (((x < newCoveredLeft or x > newCoveredRight) and y >= oldCoveredTop and y <= oldCoveredBottom) or
                      ((y < newCoveredTop or y > newCoveredBottom) and x >= oldCoveredLeft and x <= oldCoveredRight))
-                characterMap[y * tileMap->getWidth() + x].remove(c);
+                removeFromTile(c, x, y);
         }
     }
 }
@@ -77,9 +96,9 @@ void CharacterContainer::insertOrRemove(Character* c, const FPMVector2 &pos, FPM
             if (y < 0 or y >= tileMap->getHeight())
                 continue;
             if (remove)
-                characterMap[y * tileMap->getWidth() + x].remove(c);
+                removeFromTile(c, x, y);
             else
-                characterMap[y * tileMap->getWidth() + x].push_back(c);
+                getTileForInsert(x, y).push_back(c);
         }
     }
 }
@@ -89,7 +108,7 @@ bool CharacterContainer::isAlive(sf::Uint32 ID) {
 }
 
 FPMVector2 CharacterContainer::findFreeSpawnPosition(const FPMRect &spawnZone, const FPMNum &groundRadius,
-                                                     std::mt19937 &gen, unsigned int trials) {
+                                                     RandomGenerator &gen, unsigned int trials) {
     FPMVector2 spawnPosition;
     std::uniform_int_distribution<int> dist(0, 1000);
     for (unsigned int t = 0; t < trials; t++) {
@@ -5,6 +5,8 @@
 #include <set>
 #include "Tilemap.h"
 #include "../FPMUtil.h"
+#include "../Constants.h"
+#include "../RandomGenerator.h"
 
 class Character;
 
@@ -21,6 +23,9 @@ class Character;
  * consider them as squares with a side length of 2*groundRadius. So a character may appear in the list
  * given by getCharactersAt, even though it is not actually on the tile (but very, very close to it).
  * The benefit of this is that update and search operations on the scene graph are much simpler and faster.
+ *
+ * The per-tile lists are grouped into chunks of MAP_CHUNK_SIZE x MAP_CHUNK_SIZE tiles. A chunk is only allocated
+ * once a character enters it, so the memory used does not depend on the total size of the map.
  */
 class CharacterContainer {
 public:
@@ -33,7 +38,7 @@ public:
     Character* getCharacterByID(sf::Uint32 ID) { return characterIDs[ID]; }
 
     // Get characters on that map tile. Fast function.
-    std::list<Character*>& getCharactersAt(const FPMVector2 &map);
+    const std::list<Character*>& getCharactersAt(const FPMVector2 &map) const;
 
     // Get characters on that map tile and adjacent tiles up to a Manhatten distance of tolerance. Slow function.
     std::unique_ptr<std::set<Character*>> getCharactersAtWithTolerance(const FPMVector2 &map, FPMNum tolerance);
@@ -48,14 +53,25 @@ public:
     void remove(Character *c, const FPMVector2 &pos, FPMNum tolerance);
 
     // Randomly (using gen) pick a position in spawnZone, ensuring there is no collision up to groundRadius. Try up to trials times and throw runtime_error if it fails.
-    FPMVector2 findFreeSpawnPosition(const FPMRect &spawnZone, const FPMNum &groundRadius, std::mt19937 &gen, unsigned int trials = 10);
+    FPMVector2 findFreeSpawnPosition(const FPMRect &spawnZone, const FPMNum &groundRadius, RandomGenerator &gen, unsigned int trials = 10);
 
 private:
     void insertOrRemove(Character* c, const FPMVector2 &pos, FPMNum tolerance, bool remove);
 
+    // The list of characters on tile (x, y), which must be inside the map. Allocates the tile's chunk if necessary.
+    std::list<Character *>& getTileForInsert(int x, int y);
+
+    // Remove c from the list of tile (x, y), which must be inside the map.
+    void removeFromTile(Character *c, int x, int y);
+
     std::shared_ptr<Tilemap> tileMap;
 
-    std::vector<std::list<Character *>> characterMap;
+    typedef std::array<std::list<Character *>, MAP_CHUNK_SIZE * MAP_CHUNK_SIZE> Chunk;
+    unsigned int chunksX;
+    // Chunks are nullptr until a character enters them
+    std::vector<std::unique_ptr<Chunk>> characterChunks;
+    // Returned by getCharactersAt for tiles outside the map or in chunks that are not allocated. Always empty.
+    const std::list<Character *> noCharacters;
 
     std::unordered_map<sf::Uint32, Character*> characterIDs;
 };
\ No newline at end of file
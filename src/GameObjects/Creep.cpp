@@ -1,11 +1,13 @@
 #include "Creep.h"
+#include "Pathfinder.h"
+#include "../NetworkEvents/WireFormat.h"
 #include <fpm/ios.hpp>
 #include <algorithm>
 
 Creep::Creep(sf::Uint32 ID, unsigned int level, FPMVector2 spawnPosition, const std::shared_ptr<Tilemap> &tilemap, const std::shared_ptr<CharacterContainer> &characterContainer, unsigned int randomSeed)
         : Character(ID, levelToCharacterType(level), spawnPosition, tilemap, characterContainer, randomSeed), wanderAngle(FPMNum(0)),
-          seekTargetID(ID), seekRange(DEFAULT_CREEP_SEEK_RANGE),
-          stuckTimer(0), damageReceived() {
+          seekTargetID(ID), seekRange(DEFAULT_CREEP_SEEK_RANGE), seekPathIndex(0), seekPathValid(false),
+          stuckTimer(0), damageReceived(), movementPlanned(false) {
     // Set creep stats according to the defaults in Constant.h and the current crep level
     std::uniform_int_distribution<int> dist(DEFAULT_CREEP_MAX_MOVEMENT_PER_SEC * 1000 - 500, DEFAULT_CREEP_MAX_MOVEMENT_PER_SEC * 1000 + 500);
     maxMovementPerSecond = FPMNum(dist(gen)) / FPMNum(1000);
@@ -116,6 +118,12 @@ bool Creep::hasReachedGoal() const {
     return tilemap->getCreepGoal().contains(mapPosition);
 }
 
+void Creep::planMovement() {
+    plannedFlowfieldVelocity = followFlowfield();
+    plannedObstaclesVelocity = avoidObstacles();
+    movementPlanned = true;
+}
+
 void Creep::simulate() {
     if (this->isDead())
         throw std::runtime_error("Trying to simulate dead creep!");
@@ -180,7 +188,7 @@ void Creep::simulate() {
         } else if (this->hasCondition(CONDITIONS::CONFUSED)) {
             wanderVelocity = wander();
             separationVelocity = separation();
-            obstaclesVelocity = avoidObstacles();
+            obstaclesVelocity = movementPlanned ? plannedObstaclesVelocity : avoidObstacles();
             desiredVelocity = wanderVelocity + FPMNum(3) * separationVelocity + FPMNum(3) * obstaclesVelocity;
             setNull(flowfieldVelocity);
             setNull(seekVelocity);
@@ -188,18 +196,18 @@ void Creep::simulate() {
             // If creep is currently seeking a player, ignore flowfield
             // Otherwise, follow flowfield while also introducing some randomness through wander()
             if (seekTargetID != this->ID) {
-                seekVelocity = seek(characterContainer->getCharacterByID(seekTargetID)->getMapPosition());
+                seekVelocity = seek(getSeekWaypoint(characterContainer->getCharacterByID(seekTargetID)->getMapPosition()));
                 setNull(flowfieldVelocity);
                 setNull(wanderVelocity);
             }
             else {
                 setNull(seekVelocity);
-                flowfieldVelocity = followFlowfield();
+                flowfieldVelocity = movementPlanned ? plannedFlowfieldVelocity : followFlowfield();
                 wanderVelocity = wander();
             }
             // Always keep away from other creeps and walls
             separationVelocity = separation();
-            obstaclesVelocity = avoidObstacles();
+            obstaclesVelocity = movementPlanned ? plannedObstaclesVelocity : avoidObstacles();
             desiredVelocity = FPMNum(2) * seekVelocity + FPMNum(2) * flowfieldVelocity + wanderVelocity +
                     FPMNum(3) * separationVelocity + FPMNum(3) * obstaclesVelocity;
         }
@@ -242,6 +250,7 @@ void Creep::simulate() {
             attackTimer -= SIMULATION_TIME_STEP_MS;
     }
 
+    movementPlanned = false;
     Character::simulate();
 }
 
@@ -267,6 +276,15 @@ void Creep::drawUI(sf::RenderTarget &target) {
         sf::Vertex line6[] = {sf::Vertex(worldPosition, sf::Color::Cyan),
                               sf::Vertex(tilemap->mapToWorld(mapPosition + obstaclesVelocity), sf::Color::Cyan)};
         target.draw(line6, 2, sf::Lines);
+        if (seekPathValid and seekTargetID != ID) {
+            auto from = worldPosition;
+            for (auto i = seekPathIndex; i < seekPath.size(); i++) {
+                auto to = tilemap->mapToWorld(sf::Vector2f(seekPath[i].x + 0.5f, seekPath[i].y + 0.5f));
+                sf::Vertex pathLine[] = {sf::Vertex(from, sf::Color::White), sf::Vertex(to, sf::Color::White)};
+                target.draw(pathLine, 2, sf::Lines);
+                from = to;
+            }
+        }
     }
 }
 
@@ -276,6 +294,38 @@ FPMVector2 Creep::seek(const FPMVector2 &target) {
     return desiredVelocity;
 }
 
+FPMVector2 Creep::getSeekWaypoint(const FPMVector2 &target) {
+    // If nothing is in the way, move straight towards the target
+    auto toTarget = target - mapPosition;
+    auto distance = getLength(toTarget);
+    normalize(toTarget);
+    FPMVector2 collisionPosition;
+    FPMVector2 collisionNormal;
+    if (!tilemap->lineOfSightCheck(mapPosition, toTarget, distance, collisionPosition, collisionNormal)) {
+        seekPathValid = false;
+        return target;
+    }
+
+    // Otherwise, follow a path around the obstacles. Only compute a new one if the target moved to another tile or
+    // if the creep got pushed off the path (e.g., by other creeps)
+    sf::Vector2i currentTile(static_cast<int>(fpm::floor(mapPosition.x)), static_cast<int>(fpm::floor(mapPosition.y)));
+    sf::Vector2i targetTile(static_cast<int>(fpm::floor(target.x)), static_cast<int>(fpm::floor(target.y)));
+    while (seekPathIndex < seekPath.size() and seekPath[seekPathIndex] == currentTile)
+        seekPathIndex++;
+    bool offPath = seekPathIndex < seekPath.size() and
+                   std::max(std::abs(seekPath[seekPathIndex].x - currentTile.x), std::abs(seekPath[seekPathIndex].y - currentTile.y)) > 1;
+    if (!seekPathValid or targetTile != seekPathTargetTile or offPath) {
+        seekPath = tilemap->getPathfinder().findPath(currentTile, targetTile);
+        seekPathIndex = 0;
+        seekPathTargetTile = targetTile;
+        seekPathValid = true;
+    }
+
+    if (seekPathIndex >= seekPath.size())
+        return target;
+    return {FPMNum(seekPath[seekPathIndex].x) + FPMNum(0.5f), FPMNum(seekPath[seekPathIndex].y) + FPMNum(0.5f)};
+}
+
 FPMVector2 Creep::flee(const FPMVector2 &target) {
     return -seek(target);
 }
@@ -321,7 +371,7 @@ FPMVector2 Creep::wander() {
 
     std::uniform_int_distribution<int> dist(0, 1000);
     if (isNull(curDirection))
-        wanderAngle = FPMNum(dist(gen)) / FPMNum(1000) * fpm::fixed_16_16::two_pi();
+        wanderAngle = FPMNum(dist(gen)) / FPMNum(1000) * FPMNum::two_pi();
     else
         wanderAngle += FPMNum(dist(gen) - dist(gen)) / FPMNum(1000) * WANDER_CHANGE;
 
@@ -526,3 +576,49 @@ FPMVector2 Creep::avoidObstacles() {
 //}
 //
 //
+
+void Creep::saveState(sf::Packet &packet) const {
+    Character::saveState(packet);
+    for (const auto& damage : damageReceived)
+        writeFixed(packet, damage);
+    writeFixed(packet, seekRange);
+    writeVarUint(packet, seekTargetID);
+    packet << seekPathValid;
+    writeVarUint(packet, seekPath.size());
+    for (const auto& tile : seekPath) {
+        writeVarInt(packet, tile.x);
+        writeVarInt(packet, tile.y);
+    }
+    writeVarUint(packet, seekPathIndex);
+    writeVarInt(packet, seekPathTargetTile.x);
+    writeVarInt(packet, seekPathTargetTile.y);
+    writeFixed(packet, stuckTimer);
+    writeFixed(packet, wanderAngle);
+}
+
+void Creep::loadState(sf::Packet &packet) {
+    Character::loadState(packet);
+    for (auto& damage : damageReceived)
+        damage = readFixed<FPMNum>(packet);
+    seekRange = readFixed<FPMNum>(packet);
+    seekTargetID = static_cast<sf::Uint32>(readVarUint(packet));
+    if (!(packet >> seekPathValid))
+        throw std::runtime_error("Invalid creep in checkpoint");
+    auto pathLength = readVarUint(packet);
+    // Each tile takes at least two bytes, which bounds the allocation by the size of the packet
+    if (pathLength > packet.getDataSize() / 2)
+        throw std::runtime_error("Invalid creep in checkpoint");
+    seekPath.resize(pathLength);
+    for (auto& tile : seekPath) {
+        tile.x = static_cast<int>(readVarInt(packet));
+        tile.y = static_cast<int>(readVarInt(packet));
+    }
+    seekPathIndex = static_cast<unsigned int>(readVarUint(packet));
+    if (seekPathIndex > seekPath.size())
+        throw std::runtime_error("Invalid creep in checkpoint");
+    seekPathTargetTile.x = static_cast<int>(readVarInt(packet));
+    seekPathTargetTile.y = static_cast<int>(readVarInt(packet));
+    stuckTimer = readFixed<FPMNum>(packet);
+    wanderAngle = readFixed<FPMNum>(packet);
+    movementPlanned = false;
+}
@@ -15,6 +15,10 @@ class Creep : public Character {
 public:
     Creep(sf::Uint32 ID, unsigned int level, FPMVector2 spawnPosition, const std::shared_ptr<Tilemap>& tilemap, const std::shared_ptr<CharacterContainer> &characterContainer, unsigned int randomSeed);
 
+    // Computes the parts of the next simulate call that only depend on the creep's own position and velocity and the map.
+    // Nothing else changes them before the creep is simulated, so this can run in parallel for all creeps beforehand
+    void planMovement();
+
     void simulate() override;
 
     void drawUI(sf::RenderTarget& target) override;
@@ -25,12 +29,24 @@ public:
 
     // In addition to losing HP, here we also keep track of which player caused the damage. If the creep dies, we inform all players that damaged it about their contribution so that they can gain XP etc.
     void harm(FPMNum amountHP, sf::Uint32 attackerID) override;
+
+    void saveState(sf::Packet& packet) const override;
+
+    void loadState(sf::Packet& packet) override;
 private:
     std::array<FPMNum, MAX_NUM_PLAYERS + 1> damageReceived;
 
     // In addition to an attack target (see Character class), creeps may have a seek target (a player they move towards, which is not yet in attack range)
     FPMNum seekRange;
     sf::Uint32 seekTargetID;
+    // If there is an obstacle between creep and seek target, the creep follows a path computed by the Tilemap's Pathfinder.
+    // The path is reused until the target moves to another tile.
+    std::vector<sf::Vector2i> seekPath;
+    unsigned int seekPathIndex;
+    sf::Vector2i seekPathTargetTile;
+    bool seekPathValid;
+    // Returns the position the creep should move towards to reach target
+    FPMVector2 getSeekWaypoint(const FPMVector2 &target);
 
     // If a creep gets start, it starts to move in random directions after a while
     FPMNum stuckTimer;
@@ -59,6 +75,10 @@ private:
     // Keep away from rectangular obstacles (provided by Tilemap)
     FPMVector2 avoidObstacles();
 
+    // Set by planMovement for the next simulate call
+    bool movementPlanned;
+    FPMVector2 plannedFlowfieldVelocity, plannedObstaclesVelocity;
+
     // For debugging
     FPMVector2 seekVelocity, flowfieldVelocity, wanderVelocity, separationVelocity, obstaclesVelocity;
 
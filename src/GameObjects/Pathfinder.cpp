@@ -0,0 +1,272 @@
+#include "Pathfinder.h"
+#include "Tilemap.h"
+#include <queue>
+#include <array>
+#include <algorithm>
+#include <functional>
+
+#define PATH_COST_STRAIGHT 10
+#define PATH_COST_DIAGONAL 14
+
+namespace {
+    const std::array<sf::Vector2i, 8> NEIGHBOR_OFFSETS = {sf::Vector2i(1, 0), sf::Vector2i(0, 1), sf::Vector2i(-1, 0), sf::Vector2i(0, -1),
+                                                          sf::Vector2i(1, 1), sf::Vector2i(-1, 1), sf::Vector2i(-1, -1), sf::Vector2i(1, -1)};
+
+    // Priority queue entries are (cost, index). Ordering by both makes the search order independent of the platform
+    typedef std::pair<unsigned int, unsigned int> QueueEntry;
+    typedef std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry>> MinQueue;
+}
+
+Pathfinder::Pathfinder(const Tilemap &tilemap) {
+    width = static_cast<int>(tilemap.getWidth());
+    height = static_cast<int>(tilemap.getHeight());
+    clustersX = (width + CLUSTER_SIZE - 1) / CLUSTER_SIZE;
+    clustersY = (height + CLUSTER_SIZE - 1) / CLUSTER_SIZE;
+
+    // Mark all tiles that are (partially) covered by an obstacle
+    blocked.resize(width * height, 0);
+    for (const auto &obstacle : tilemap.getObstacles()) {
+        auto left = std::max(0, static_cast<int>(fpm::floor(obstacle->left)));
+        auto top = std::max(0, static_cast<int>(fpm::floor(obstacle->top)));
+        auto right = std::min(width, static_cast<int>(fpm::ceil(obstacle->left + obstacle->width)));
+        auto bottom = std::min(height, static_cast<int>(fpm::ceil(obstacle->top + obstacle->height)));
+        for (int y = top; y < bottom; y++)
+            for (int x = left; x < right; x++)
+                blocked[y * width + x] = 1;
+    }
+
+    // Place entrances on the borders between neighboring clusters
+    clusterNodes.resize(clustersX * clustersY);
+    for (int cy = 0; cy < clustersY; cy++) {
+        for (int cx = 0; cx < clustersX; cx++) {
+            auto bounds = getClusterBounds(cy * clustersX + cx);
+            if (cx + 1 < clustersX)
+                createEntrances(sf::Vector2i(bounds.left + bounds.width - 1, bounds.top), sf::Vector2i(bounds.left + bounds.width, bounds.top), sf::Vector2i(0, 1), bounds.height);
+            if (cy + 1 < clustersY)
+                createEntrances(sf::Vector2i(bounds.left, bounds.top + bounds.height - 1), sf::Vector2i(bounds.left, bounds.top + bounds.height), sf::Vector2i(1, 0), bounds.width);
+        }
+    }
+
+    // Connect all entrances of each cluster with each other and cache the paths between them
+    LocalSearch search;
+    for (unsigned int cluster = 0; cluster < clusterNodes.size(); cluster++) {
+        search.bounds = getClusterBounds(cluster);
+        const auto &nodesInCluster = clusterNodes[cluster];
+        for (unsigned int i = 0; i < nodesInCluster.size(); i++) {
+            searchLocal(nodes[nodesInCluster[i]].tile, search);
+            for (unsigned int j = i + 1; j < nodesInCluster.size(); j++) {
+                const auto &target = nodes[nodesInCluster[j]].tile;
+                auto cost = search.cost[(target.y - search.bounds.top) * search.bounds.width + target.x - search.bounds.left];
+                if (cost != UNREACHABLE)
+                    addEdge(nodesInCluster[i], nodesInCluster[j], cost, extractPathFromStart(search, target));
+            }
+        }
+    }
+}
+
+unsigned int Pathfinder::getClusterOf(const sf::Vector2i &tile) const {
+    return (tile.y / CLUSTER_SIZE) * clustersX + tile.x / CLUSTER_SIZE;
+}
+
+sf::IntRect Pathfinder::getClusterBounds(unsigned int cluster) const {
+    int left = (static_cast<int>(cluster) % clustersX) * CLUSTER_SIZE;
+    int top = (static_cast<int>(cluster) / clustersX) * CLUSTER_SIZE;
+    return {left, top, std::min(CLUSTER_SIZE, width - left), std::min(CLUSTER_SIZE, height - top)};
+}
+
+unsigned int Pathfinder::getOrCreateNode(const sf::Vector2i &tile) {
+    auto tileIndex = tile.y * width + tile.x;
+    auto it = tileToNode.find(tileIndex);
+    if (it != tileToNode.end())
+        return it->second;
+    auto nodeIndex = static_cast<unsigned int>(nodes.size());
+    nodes.push_back({tile, getClusterOf(tile), {}});
+    clusterNodes[nodes.back().cluster].push_back(nodeIndex);
+    tileToNode[tileIndex] = nodeIndex;
+    return nodeIndex;
+}
+
+void Pathfinder::addEdge(unsigned int from, unsigned int to, unsigned int cost, std::vector<sf::Vector2i> tiles) {
+    // The reverse path walks the same tiles backwards, ending at 'from'
+    std::vector<sf::Vector2i> reverseTiles(tiles.rbegin() + 1, tiles.rend());
+    reverseTiles.push_back(nodes[from].tile);
+    auto forwardIndex = static_cast<unsigned int>(nodes[from].edges.size());
+    auto reverseIndex = static_cast<unsigned int>(nodes[to].edges.size());
+    nodes[from].edges.push_back({to, cost, reverseIndex, std::move(tiles)});
+    nodes[to].edges.push_back({from, cost, forwardIndex, std::move(reverseTiles)});
+}
+
+void Pathfinder::createEntrances(const sf::Vector2i &firstA, const sf::Vector2i &firstB, const sf::Vector2i &step, int length) {
+    // Find maximal runs of tiles that are free on both sides of the border. Short runs get one entrance in the
+    // middle, long runs get one at each end, so that paths do not need to detour through the middle.
+    int runStart = -1;
+    for (int i = 0; i <= length; i++) {
+        bool free = i < length && !isBlocked(firstA.x + i * step.x, firstA.y + i * step.y) && !isBlocked(firstB.x + i * step.x, firstB.y + i * step.y);
+        if (free && runStart < 0)
+            runStart = i;
+        if (!free && runStart >= 0) {
+            auto runLength = i - runStart;
+            std::vector<int> positions;
+            if (runLength >= 6)
+                positions = {runStart, i - 1};
+            else
+                positions = {runStart + runLength / 2};
+            for (auto position : positions) {
+                auto nodeA = getOrCreateNode(firstA + step * position);
+                auto nodeB = getOrCreateNode(firstB + step * position);
+                addEdge(nodeA, nodeB, PATH_COST_STRAIGHT, {nodes[nodeB].tile});
+            }
+            runStart = -1;
+        }
+    }
+}
+
+void Pathfinder::searchLocal(const sf::Vector2i &start, LocalSearch &search) const {
+    const auto &bounds = search.bounds;
+    search.cost.assign(bounds.width * bounds.height, UNREACHABLE);
+    search.parent.assign(bounds.width * bounds.height, NONE);
+    auto toIndex = [&bounds](int x, int y) { return static_cast<unsigned int>((y - bounds.top) * bounds.width + x - bounds.left); };
+    auto inBounds = [&bounds](int x, int y) { return x >= bounds.left && y >= bounds.top && x < bounds.left + bounds.width && y < bounds.top + bounds.height; };
+
+    MinQueue queue;
+    search.cost[toIndex(start.x, start.y)] = 0;
+    queue.emplace(0, toIndex(start.x, start.y));
+    while (!queue.empty()) {
+        auto [cost, index] = queue.top();
+        queue.pop();
+        if (cost > search.cost[index])
+            continue;
+        int x = bounds.left + static_cast<int>(index) % bounds.width;
+        int y = bounds.top + static_cast<int>(index) / bounds.width;
+        for (unsigned int n = 0; n < NEIGHBOR_OFFSETS.size(); n++) {
+            int nx = x + NEIGHBOR_OFFSETS[n].x;
+            int ny = y + NEIGHBOR_OFFSETS[n].y;
+            if (!inBounds(nx, ny) || isBlocked(nx, ny))
+                continue;
+            bool diagonal = n >= 4;
+            // Do not cut corners
+            if (diagonal && (isBlocked(nx, y) || isBlocked(x, ny)))
+                continue;
+            auto newCost = cost + (diagonal ? PATH_COST_DIAGONAL : PATH_COST_STRAIGHT);
+            auto neighborIndex = toIndex(nx, ny);
+            if (newCost < search.cost[neighborIndex]) {
+                search.cost[neighborIndex] = newCost;
+                search.parent[neighborIndex] = index;
+                queue.emplace(newCost, neighborIndex);
+            }
+        }
+    }
+}
+
+std::vector<sf::Vector2i> Pathfinder::extractPathFromStart(const LocalSearch &search, const sf::Vector2i &to) const {
+    auto path = extractPathToStart(search, to);
+    // path now is 'to' (excluded) ... start (included), so reverse it and swap start for 'to'
+    if (!path.empty()) {
+        path.pop_back();
+        std::reverse(path.begin(), path.end());
+        path.push_back(to);
+    }
+    return path;
+}
+
+std::vector<sf::Vector2i> Pathfinder::extractPathToStart(const LocalSearch &search, const sf::Vector2i &from) const {
+    const auto &bounds = search.bounds;
+    std::vector<sf::Vector2i> path;
+    auto index = search.parent[(from.y - bounds.top) * bounds.width + from.x - bounds.left];
+    while (index != NONE) {
+        path.emplace_back(bounds.left + static_cast<int>(index) % bounds.width, bounds.top + static_cast<int>(index) / bounds.width);
+        index = search.parent[index];
+    }
+    return path;
+}
+
+const Pathfinder::GoalTree &Pathfinder::getGoalTree(const sf::Vector2i &goal) {
+    auto key = std::make_pair(goal.x, goal.y);
+    auto it = goalTrees.find(key);
+    if (it != goalTrees.end())
+        return it->second;
+    if (goalTrees.size() >= MAX_CACHED_GOALS)
+        goalTrees.clear();
+
+    auto &tree = goalTrees[key];
+    tree.costToGoal.assign(nodes.size(), UNREACHABLE);
+    tree.nextEdge.assign(nodes.size(), NONE);
+
+    // Nodes in the goal's cluster walk there directly
+    auto goalCluster = getClusterOf(goal);
+    tree.goalSearch.bounds = getClusterBounds(goalCluster);
+    searchLocal(goal, tree.goalSearch);
+    MinQueue queue;
+    for (auto node : clusterNodes[goalCluster]) {
+        const auto &tile = nodes[node].tile;
+        auto cost = tree.goalSearch.cost[(tile.y - tree.goalSearch.bounds.top) * tree.goalSearch.bounds.width + tile.x - tree.goalSearch.bounds.left];
+        if (cost != UNREACHABLE) {
+            tree.costToGoal[node] = cost;
+            queue.emplace(cost, node);
+        }
+    }
+
+    // Dijkstra on the abstract graph, backwards from the goal. Edge costs are symmetric.
+    while (!queue.empty()) {
+        auto [cost, node] = queue.top();
+        queue.pop();
+        if (cost > tree.costToGoal[node])
+            continue;
+        for (const auto &edge : nodes[node].edges) {
+            auto newCost = cost + edge.cost;
+            if (newCost < tree.costToGoal[edge.to]) {
+                tree.costToGoal[edge.to] = newCost;
+                tree.nextEdge[edge.to] = edge.reverseEdge;
+                queue.emplace(newCost, edge.to);
+            }
+        }
+    }
+    return tree;
+}
+
+std::vector<sf::Vector2i> Pathfinder::findPath(const sf::Vector2i &start, const sf::Vector2i &goal) {
+    if (start == goal || start.x < 0 || start.y < 0 || start.x >= width || start.y >= height ||
+        goal.x < 0 || goal.y < 0 || goal.x >= width || goal.y >= height)
+        return {};
+
+    const auto &tree = getGoalTree(goal);
+    const auto &goalBounds = tree.goalSearch.bounds;
+
+    // Connect start to the entrances of its cluster and pick the one with the cheapest total cost
+    LocalSearch startSearch;
+    startSearch.bounds = getClusterBounds(getClusterOf(start));
+    searchLocal(start, startSearch);
+    unsigned int bestCost = UNREACHABLE;
+    unsigned int bestNode = NONE;
+    for (auto node : clusterNodes[getClusterOf(start)]) {
+        const auto &tile = nodes[node].tile;
+        auto localCost = startSearch.cost[(tile.y - startSearch.bounds.top) * startSearch.bounds.width + tile.x - startSearch.bounds.left];
+        if (localCost == UNREACHABLE || tree.costToGoal[node] == UNREACHABLE)
+            continue;
+        if (localCost + tree.costToGoal[node] < bestCost) {
+            bestCost = localCost + tree.costToGoal[node];
+            bestNode = node;
+        }
+    }
+
+    // If start and goal share a cluster, walking there directly may be cheaper
+    if (getClusterOf(start) == getClusterOf(goal)) {
+        auto directCost = tree.goalSearch.cost[(start.y - goalBounds.top) * goalBounds.width + start.x - goalBounds.left];
+        if (directCost != UNREACHABLE && directCost <= bestCost)
+            return extractPathToStart(tree.goalSearch, start);
+    }
+    if (bestNode == NONE)
+        return {};
+
+    // Refine the abstract path into tiles
+    auto path = extractPathFromStart(startSearch, nodes[bestNode].tile);
+    auto node = bestNode;
+    while (tree.nextEdge[node] != NONE) {
+        const auto &edge = nodes[node].edges[tree.nextEdge[node]];
+        path.insert(path.end(), edge.tiles.begin(), edge.tiles.end());
+        node = edge.to;
+    }
+    auto lastLeg = extractPathToStart(tree.goalSearch, nodes[node].tile);
+    path.insert(path.end(), lastLeg.begin(), lastLeg.end());
+    return path;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include "SFML/Graphics.hpp"
+
+class Tilemap;
+
+/***
+ * Hierarchical pathfinding (HPA*) on the tile grid of a Tilemap.
+ *
+ * A tile is blocked if any obstacle overlaps it. The map is divided into square clusters of CLUSTER_SIZE tiles.
+ * Wherever two neighboring clusters share free border tiles, entrances are placed. Entrances become the nodes of an
+ * abstract graph, connected by edges between neighboring clusters and by edges inside each cluster (whose tile paths are
+ * computed once and cached). The abstract graph never changes, since obstacles are static.
+ *
+ * Path queries are answered with a search tree over the abstract graph rooted at the goal tile. The tree is cached
+ * per goal tile, so all creeps chasing the same target share it and only need a search inside their own cluster.
+ *
+ * All costs are integers (10 for straight and 14 for diagonal steps) and all ties are broken by node or tile index,
+ * so results are identical on all machines. Caches only store results of pure computations, so they never
+ * influence the returned paths.
+ */
+class Pathfinder {
+public:
+    explicit Pathfinder(const Tilemap &tilemap);
+
+    /***
+     * Find a path from start to goal, moving in 8 directions without cutting corners of blocked tiles.
+     * start and goal themselves may be blocked (e.g., if a character stands very close to a wall).
+     *
+     * @return The tiles to walk through, excluding start and including goal. Empty if start == goal, if either is
+     *         outside the map, or if goal cannot be reached.
+     */
+    std::vector<sf::Vector2i> findPath(const sf::Vector2i &start, const sf::Vector2i &goal);
+
+    bool isBlocked(int x, int y) const { return blocked[y * width + x] != 0; }
+
+    static constexpr int CLUSTER_SIZE = 10;
+
+private:
+    static constexpr unsigned int UNREACHABLE = 0xFFFFFFFF;
+    static constexpr unsigned int NONE = 0xFFFFFFFF;
+    // Number of goal trees kept in the cache before it is cleared
+    static constexpr unsigned int MAX_CACHED_GOALS = 64;
+
+    struct Edge {
+        unsigned int to;
+        unsigned int cost;
+        // Index of the edge in the opposite direction (in the edge list of node 'to')
+        unsigned int reverseEdge;
+        // Tiles walked along this edge, excluding the start node's tile and including the end node's tile
+        std::vector<sf::Vector2i> tiles;
+    };
+
+    struct Node {
+        sf::Vector2i tile;
+        unsigned int cluster;
+        std::vector<Edge> edges;
+    };
+
+    // Result of a Dijkstra search restricted to one cluster
+    struct LocalSearch {
+        sf::IntRect bounds;
+        // Per tile in bounds (row-major)
+        std::vector<unsigned int> cost;
+        std::vector<unsigned int> parent;
+    };
+
+    // Search tree over the abstract graph, rooted at a goal tile
+    struct GoalTree {
+        // Per node: cost of the cheapest path to the goal, UNREACHABLE if there is none
+        std::vector<unsigned int> costToGoal;
+        // Per node: index of the edge towards the goal, or NONE if the node is in the goal's cluster and walks there directly
+        std::vector<unsigned int> nextEdge;
+        // Search from the goal inside its cluster. Since costs are symmetric, following parents from a tile leads to the goal
+        LocalSearch goalSearch;
+    };
+
+    unsigned int getClusterOf(const sf::Vector2i &tile) const;
+
+    sf::IntRect getClusterBounds(unsigned int cluster) const;
+
+    unsigned int getOrCreateNode(const sf::Vector2i &tile);
+
+    void addEdge(unsigned int from, unsigned int to, unsigned int cost, std::vector<sf::Vector2i> tiles);
+
+    void createEntrances(const sf::Vector2i &firstA, const sf::Vector2i &firstB, const sf::Vector2i &step, int length);
+
+    void searchLocal(const sf::Vector2i &start, LocalSearch &search) const;
+
+    // Path from the search's start to 'to', excluding the start and including 'to'
+    std::vector<sf::Vector2i> extractPathFromStart(const LocalSearch &search, const sf::Vector2i &to) const;
+
+    // Path from 'from' back to the search's start, excluding 'from' and including the start
+    std::vector<sf::Vector2i> extractPathToStart(const LocalSearch &search, const sf::Vector2i &from) const;
+
+    const GoalTree &getGoalTree(const sf::Vector2i &goal);
+
+    int width;
+    int height;
+    int clustersX;
+    int clustersY;
+    std::vector<unsigned char> blocked;
+    std::vector<Node> nodes;
+    std::vector<std::vector<unsigned int>> clusterNodes;
+    std::unordered_map<int, unsigned int> tileToNode;
+    std::map<std::pair<int, int>, GoalTree> goalTrees;
+};
@@ -4,6 +4,7 @@
 
 #include "../Constants.h"
 #include "Skills.h"
+#include "../NetworkEvents/WireFormat.h"
 
 Player::Player(sf::Uint32 ID, CHARACTERS type, FPMVector2 spawnPosition, const std::shared_ptr<Tilemap> &tilemap, const std::shared_ptr<CharacterContainer> &characterContainer, unsigned int randomSeed, std::string name, std::shared_ptr<sf::Font> font)
         : Character(ID, type, spawnPosition, tilemap, characterContainer, randomSeed), name(std::move(name)),
@@ -50,14 +51,16 @@ Player::Player(sf::Uint32 ID, CHARACTERS type, FPMVector2 spawnPosition, const s
     
     createScarecrowFlag = false;
 
-    // Player names are displayed under the respective character sprites
-    this->font->setSmooth(false);
-    nameForRendering.setFillColor(sf::Color::White);
-    nameForRendering.setFont(*this->font);
-    nameForRendering.setString(sf::String::fromUtf8(this->name.begin(), this->name.end()));
-    nameForRendering.setCharacterSize(13);
-    auto nameBounds = nameForRendering.getGlobalBounds();
-    nameForRendering.setOrigin(nameBounds.width / 2.f, nameBounds.height / 2.f);
+    // Player names are displayed under the respective character sprites (there is no font on the dedicated server)
+    if (this->font) {
+        this->font->setSmooth(false);
+        nameForRendering.setFillColor(sf::Color::White);
+        nameForRendering.setFont(*this->font);
+        nameForRendering.setString(sf::String::fromUtf8(this->name.begin(), this->name.end()));
+        nameForRendering.setCharacterSize(13);
+        auto nameBounds = nameForRendering.getGlobalBounds();
+        nameForRendering.setOrigin(nameBounds.width / 2.f, nameBounds.height / 2.f);
+    }
 
     // Most skills have the default cooldown, some take longer
     skillsTimer.fill(FPMNum24(0));
@@ -245,8 +248,8 @@ void Player::regainMP(FPMNum amount) {
         this->MP = this->maxMP;
 }
 
-bool Player::updateDrawables(const sf::FloatRect& frustum, float elapsedSeconds, unsigned int elapsedMSSinceLastSimulationStep) {
-    auto visible = Character::updateDrawables(frustum, elapsedSeconds, elapsedMSSinceLastSimulationStep);
+bool Player::updateDrawables(const CharacterRenderState& state, const sf::FloatRect& frustum, float elapsedSeconds, unsigned int elapsedMSSinceLastSimulationStep) {
+    auto visible = Character::updateDrawables(state, frustum, elapsedSeconds, elapsedMSSinceLastSimulationStep);
     if (visible)
         nameForRendering.setPosition(sprite.getPosition().x, sprite.getPosition().y + 10.f);
     return visible;
@@ -561,3 +564,48 @@ void Player::upgradeSkill(unsigned int skillSlot) {
         return;
     skillsLevel[skillSlot]++;
 }
+
+void Player::saveState(sf::Packet &packet) const {
+    Character::saveState(packet);
+    writeFixed(packet, respawnTimer);
+    writeFixed(packet, respawnCooldownMS);
+    writeFixed(packet, maxMP);
+    writeFixed(packet, MP);
+    writeFixed(packet, XP);
+    writeVarUint(packet, gold);
+    writeVarUint(packet, level);
+    writeVarUint(packet, numHPPotions);
+    writeVarUint(packet, numMPPotions);
+    packet << createScarecrowFlag;
+    writeFixed(packet, zonePosition.x);
+    writeFixed(packet, zonePosition.y);
+    writeFixed(packet, zoneTimer);
+    for (unsigned int i = 0; i < skillsTimer.size(); i++) {
+        writeFixed(packet, skillsTimer[i]);
+        writeFixed(packet, skillsCooldownMS[i]);
+        writeVarUint(packet, skillsLevel[i]);
+    }
+}
+
+void Player::loadState(sf::Packet &packet) {
+    Character::loadState(packet);
+    respawnTimer = readFixed<FPMNum24>(packet);
+    respawnCooldownMS = readFixed<FPMNum24>(packet);
+    maxMP = readFixed<FPMNum>(packet);
+    MP = readFixed<FPMNum>(packet);
+    XP = readFixed<FPMNum>(packet);
+    gold = static_cast<unsigned int>(readVarUint(packet));
+    level = static_cast<unsigned int>(readVarUint(packet));
+    numHPPotions = static_cast<unsigned int>(readVarUint(packet));
+    numMPPotions = static_cast<unsigned int>(readVarUint(packet));
+    if (!(packet >> createScarecrowFlag))
+        throw std::runtime_error("Invalid player in checkpoint");
+    zonePosition.x = readFixed<FPMNum>(packet);
+    zonePosition.y = readFixed<FPMNum>(packet);
+    zoneTimer = readFixed<FPMNum24>(packet);
+    for (unsigned int i = 0; i < skillsTimer.size(); i++) {
+        skillsTimer[i] = readFixed<FPMNum24>(packet);
+        skillsCooldownMS[i] = readFixed<FPMNum24>(packet);
+        skillsLevel[i] = static_cast<unsigned int>(readVarUint(packet));
+    }
+}
@@ -24,7 +24,7 @@ public:
 
     bool isPlayerOrAlly() const override { return true; }
 
-    bool updateDrawables(const sf::FloatRect& frustum, float elapsedSeconds, unsigned int elapsedMSSinceLastSimulationStep) override;
+    bool updateDrawables(const CharacterRenderState& state, const sf::FloatRect& frustum, float elapsedSeconds, unsigned int elapsedMSSinceLastSimulationStep) override;
 
     void drawUI(sf::RenderTarget& target) override;
 
@@ -106,6 +106,10 @@ public:
 
     // This is a hack. Since the game class is responsible for managing Ally objects, we can't directly create the Ally in Player::useSkill, but instead inform the Game class that it needs to do this for us. This is of course ugly and it would be better to have CharacterContainer manage the Ally objects.
     bool gameShouldCreateScarecrow();
+
+    void saveState(sf::Packet& packet) const override;
+
+    void loadState(sf::Packet& packet) override;
 private:
     void gainXp (FPMNum amount);
 
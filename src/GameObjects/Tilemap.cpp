@@ -4,9 +4,194 @@
 
 #include "fpm/ios.hpp"
 #include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cmath>
+#include <unordered_map>
 #include "../Constants.h"
+#include "../MappedFile.h"
+#include "Pathfinder.h"
+
+namespace {
+    // Layout of a cooked .arenamap file: The header below, followed by these sections (in this order):
+    // tileset image path (chars), player spawn positions (2 x Int64 each), creep spawn zones (4 x Int64 each),
+    // player respawn zone, shop, healing zone, creep goal (4 x Int64 each), obstacles (4 x Int64 each),
+    // obstacle chunk numbers (Uint32 each), obstacle index offsets (Uint32, one per tile in the listed obstacle chunks,
+    // plus one for the outside obstacles, plus one), obstacle index entries (Uint32 obstacle numbers),
+    // flowfield chunk numbers (Uint32 each), flowfield chunks (MAP_CHUNK_SIZE^2 x Uint8 each),
+    // render chunks (CookedRenderChunk each), vertices of all render chunks (raw Vertex3 structs).
+    // Fixed point numbers are stored as their raw values. All values are in host byte order, which is checked through byteOrderMark.
+    // Increment COOKED_MAP_VERSION whenever this layout changes.
+    const char COOKED_MAP_MAGIC[8] = {'A', 'R', 'E', 'N', 'A', 'M', 'A', 'P'};
+    const sf::Uint32 COOKED_MAP_VERSION = 4;
+    const sf::Uint32 COOKED_MAP_BYTE_ORDER_MARK = 0x01020304;
+
+    struct CookedMapHeader {
+        char magic[8];
+        sf::Uint32 version;
+        sf::Uint32 byteOrderMark;
+        sf::Uint32 fixedPointFractionBits;
+        sf::Uint32 vertexSize;
+        sf::Uint32 chunkSize;
+        sf::Uint32 width;
+        sf::Uint32 height;
+        sf::Uint32 tileWidth;
+        sf::Uint32 tileHeight;
+        sf::Uint32 tilesetTileWidth;
+        sf::Uint32 tilesetTileHeight;
+        sf::Uint32 tilesetTilesPerColumn;
+        sf::Uint32 tilesetImagePathLength;
+        sf::Uint32 numPlayerSpawnPositions;
+        sf::Uint32 numCreepSpawnZones;
+        sf::Uint32 numObstacles;
+        sf::Uint32 numObstacleChunks;
+        sf::Uint32 numObstacleIndexEntries;
+        sf::Uint32 numFlowfieldChunks;
+        sf::Uint32 numRenderChunks;
+        sf::Uint32 numVertices;
+        // Tilemap::getContentHash, split so that the header has no padding
+        sf::Uint32 contentHashLow;
+        sf::Uint32 contentHashHigh;
+    };
+
+    struct CookedRenderChunk {
+        sf::Uint32 chunkNumber;
+        sf::Uint32 layerEnd[3];
+        float bounds[4];
+    };
+
+    // Sequential, bounds-checked reads from a memory-mapped cooked map
+    class CookedMapReader {
+    public:
+        CookedMapReader(const char *data, std::size_t size) : pos(data), end(data + size) {}
+
+        template<typename T> void read(T *out, std::size_t count) {
+            auto numBytes = sizeof(T) * count;
+            if (static_cast<std::size_t>(end - pos) < numBytes)
+                throw std::runtime_error("Cooked map file is truncated");
+            if (numBytes > 0)
+                std::memcpy(out, pos, numBytes);
+            pos += numBytes;
+        }
+
+        FPMNum readNum() {
+            sf::Int64 raw;
+            read(&raw, 1);
+            return FPMNum::from_raw_value(static_cast<decltype(FPMNum(1).raw_value())>(raw));
+        }
+
+        FPMVector2 readVector() {
+            auto x = readNum();
+            auto y = readNum();
+            return {x, y};
+        }
+
+        FPMRect readRect() {
+            auto left = readNum();
+            auto top = readNum();
+            auto width = readNum();
+            auto height = readNum();
+            return {left, top, width, height};
+        }
+
+        bool atEnd() const { return pos == end; }
+
+        CookedMapHeader readHeader(const std::string &filename) {
+            CookedMapHeader header{};
+            read(&header, 1);
+            if (std::memcmp(header.magic, COOKED_MAP_MAGIC, sizeof(COOKED_MAP_MAGIC)) != 0)
+                throw std::runtime_error("Not a cooked map file: " + filename);
+            if (header.byteOrderMark != COOKED_MAP_BYTE_ORDER_MARK)
+                throw std::runtime_error("Cooked map file " + filename + " was created on a machine with different byte order");
+            if (header.version != COOKED_MAP_VERSION)
+                throw std::runtime_error("Cooked map file " + filename + " has version " + std::to_string(header.version) + ", expected " + std::to_string(COOKED_MAP_VERSION) + ". Please re-cook the map");
+            if (header.fixedPointFractionBits != FPM_FRACTION_BITS || header.vertexSize != sizeof(Vertex3) || header.chunkSize != MAP_CHUNK_SIZE)
+                throw std::runtime_error("Cooked map file " + filename + " was created by an incompatible build");
+            if (header.numPlayerSpawnPositions != MAX_NUM_PLAYERS || header.numCreepSpawnZones != 3)
+                throw std::runtime_error("Unexpected number of spawn points in cooked map file " + filename);
+            return header;
+        }
+
+    private:
+        const char *pos;
+        const char *end;
+    };
+
+    template<typename T> void writeCooked(std::ofstream &file, const T *data, std::size_t count) {
+        file.write(reinterpret_cast<const char *>(data), static_cast<std::streamsize>(sizeof(T) * count));
+    }
+
+    void writeCookedNum(std::ofstream &file, const FPMNum &num) {
+        auto raw = static_cast<sf::Int64>(num.raw_value());
+        writeCooked(file, &raw, 1);
+    }
+
+    void writeCookedVector(std::ofstream &file, const FPMVector2 &vector) {
+        writeCookedNum(file, vector.x);
+        writeCookedNum(file, vector.y);
+    }
+
+    void writeCookedRect(std::ofstream &file, const FPMRect &rect) {
+        writeCookedNum(file, rect.left);
+        writeCookedNum(file, rect.top);
+        writeCookedNum(file, rect.width);
+        writeCookedNum(file, rect.height);
+    }
 
-Tilemap::Tilemap(const std::string &filename) {
+    // 64 bit FNV-1a. Values are fed in little endian byte order, so the hash does not depend on the host
+    class ContentHasher {
+    public:
+        void add(sf::Uint64 value) {
+            for (int i = 0; i < 8; i++) {
+                hash ^= (value >> (8 * i)) & 0xFF;
+                hash *= 1099511628211ULL;
+            }
+        }
+
+        void addNum(const FPMNum &num) { add(static_cast<sf::Uint64>(static_cast<sf::Int64>(num.raw_value()))); }
+
+        void addRect(const FPMRect &rect) {
+            addNum(rect.left);
+            addNum(rect.top);
+            addNum(rect.width);
+            addNum(rect.height);
+        }
+
+        sf::Uint64 get() const { return hash; }
+
+    private:
+        sf::Uint64 hash = 14695981039346656037ULL;
+    };
+}
+
+Tilemap::Tilemap(const std::string &filename, bool loadTexture) {
+    const std::string cookedExtension = ".arenamap";
+    if (filename.size() >= cookedExtension.size() && filename.compare(filename.size() - cookedExtension.size(), cookedExtension.size(), cookedExtension) == 0)
+        loadFromCooked(filename);
+    else
+        loadFromTmx(filename);
+    if (loadTexture && !tilesetTexture.loadFromFile(tilesetImagePath))
+        throw std::runtime_error("Could not load tileset " + tilesetImagePath);
+}
+
+Tilemap::~Tilemap() = default;
+
+Pathfinder &Tilemap::getPathfinder() {
+    if (!pathfinder)
+        pathfinder = std::make_unique<Pathfinder>(*this);
+    return *pathfinder;
+}
+
+FPMNum Tilemap::pixelsToMap(float pixels) const {
+    // Scaling a float by a power of two is exact in double precision, so the rounding to an integer is the only
+    // rounding step. The division by tileHeight is then done in integer arithmetic (rounding half away from zero).
+    auto scaled = static_cast<sf::Int64>(std::llround(static_cast<double>(pixels) * static_cast<double>(FPMNum(1).raw_value())));
+    auto divisor = static_cast<sf::Int64>(tileHeight);
+    auto raw = scaled >= 0 ? (scaled + divisor / 2) / divisor : -((-scaled + divisor / 2) / divisor);
+    return FPMNum::from_raw_value(static_cast<decltype(FPMNum(1).raw_value())>(raw));
+}
+
+void Tilemap::loadFromTmx(const std::string &filename) {
     tmx::Map map;
     if (!map.load(filename))
         throw std::runtime_error("Could not open file " + filename);
@@ -14,95 +199,93 @@ Tilemap::Tilemap(const std::string &filename) {
     height = map.getTileCount().y;
     tileWidth = map.getTileSize().x;
     tileHeight = map.getTileSize().y;
+    initChunks();
     if(!(map.getTilesets().size() == 2 && map.getTilesets()[0].getName() == "Cave" && map.getTilesets()[1].getName() == "flowfield"))
         throw std::runtime_error("Unknown or missing tilesets in map file " + filename);
     auto tileset = map.getTilesets()[0];
-    tilesetTexture.loadFromFile(tileset.getImagePath());
+    tilesetImagePath = tileset.getImagePath();
     tilesetTileWidth = tileset.getTileSize().x;
     tilesetTileHeight = tileset.getTileSize().y;
     tilesetTilesPerColumn = tileset.getColumnCount();
-    totalNumVertices = 0;
     createVertices(map, tileset.getFirstGID());
 
     // Note: for some reason, positions and sizes of objects in Tiled .tmx files must be divided by tileHeight
     // See here: https://discourse.mapeditor.org/t/whats-the-algorithm-of-object-position-in-iso-map/1790/3
+    // This division is done by pixelsToMap, so that the resulting fixed point values are the same on all devices.
     for (auto& layer : map.getLayers()) {
-        // TODO It is essential that positions etc. are parsed deterministically on all devices. But we get them as floats here...
         if (layer->getName() == "playerSpawn") {
             auto objects = layer->getLayerAs<tmx::ObjectGroup>().getObjects();
             if (objects.size() != MAX_NUM_PLAYERS)
                 throw std::runtime_error("Expected MAX_NUM_PLAYERS player spawn points in map");
-            playerSpawnPositions.reserve(6);
+            playerSpawnPositions.resize(6);
             for (int index = 0; index < 6; index++) {
                 if (std::stoi(objects[5 - index].getName()) != index + 1)
                     throw std::runtime_error("Player spawn points must be named 1, 2, ... and ordered top down");
-                playerSpawnPositions[index].x = static_cast<FPMNum>(objects[5 - index].getPosition().x / tileHeight);
-                playerSpawnPositions[index].y = static_cast<FPMNum>(objects[5 - index].getPosition().y / tileHeight);
+                playerSpawnPositions[index].x = pixelsToMap(objects[5 - index].getPosition().x);
+                playerSpawnPositions[index].y = pixelsToMap(objects[5 - index].getPosition().y);
             }
         } else if (layer->getName() == "creepSpawn") {
             auto objects = layer->getLayerAs<tmx::ObjectGroup>().getObjects();
             if (objects.size() != 3)
                 throw std::runtime_error("Expected 3 creep spawn points in map");
-            creepSpawnZones.reserve(3);
+            creepSpawnZones.resize(3);
             for (int index = 0; index < 3; index++) {
                 if (std::stoi(objects[2 - index].getName()) != index + 1)
                     throw std::runtime_error("Creep spawn points must be named 1, 2, ... and ordered top down");
-                creepSpawnZones[index].left = static_cast<FPMNum>(objects[2 - index].getPosition().x / tileHeight);
-                creepSpawnZones[index].top = static_cast<FPMNum>(objects[2 - index].getPosition().y / tileHeight);
-                creepSpawnZones[index].width = static_cast<FPMNum>(objects[2 - index].getAABB().width / tileHeight);
-                creepSpawnZones[index].height = static_cast<FPMNum>(objects[2 - index].getAABB().height / tileHeight);
+                creepSpawnZones[index].left = pixelsToMap(objects[2 - index].getPosition().x);
+                creepSpawnZones[index].top = pixelsToMap(objects[2 - index].getPosition().y);
+                creepSpawnZones[index].width = pixelsToMap(objects[2 - index].getAABB().width);
+                creepSpawnZones[index].height = pixelsToMap(objects[2 - index].getAABB().height);
             }
         } else if (layer->getName() == "playerRespawn") {
             auto objects = layer->getLayerAs<tmx::ObjectGroup>().getObjects();
             if (objects.size() != 1)
                 throw std::runtime_error("Expected 1 player respawn zone in map");
-            playerRespawnZone.left = static_cast<FPMNum>(objects[0].getPosition().x / tileHeight);
-            playerRespawnZone.top = static_cast<FPMNum>(objects[0].getPosition().y / tileHeight);
-            playerRespawnZone.width = static_cast<FPMNum>(objects[0].getAABB().width / tileHeight);
-            playerRespawnZone.height = static_cast<FPMNum>(objects[0].getAABB().height / tileHeight);
+            playerRespawnZone.left = pixelsToMap(objects[0].getPosition().x);
+            playerRespawnZone.top = pixelsToMap(objects[0].getPosition().y);
+            playerRespawnZone.width = pixelsToMap(objects[0].getAABB().width);
+            playerRespawnZone.height = pixelsToMap(objects[0].getAABB().height);
         } else if (layer->getName() == "healingZone") {
             auto objects = layer->getLayerAs<tmx::ObjectGroup>().getObjects();
             if (objects.size() != 1)
                 throw std::runtime_error("Expected 1 healing zone in map");
-            healingZone.left = static_cast<FPMNum>(objects[0].getPosition().x / tileHeight);
-            healingZone.top = static_cast<FPMNum>(objects[0].getPosition().y / tileHeight);
-            healingZone.width = static_cast<FPMNum>(objects[0].getAABB().width / tileHeight);
-            healingZone.height = static_cast<FPMNum>(objects[0].getAABB().height / tileHeight);
+            healingZone.left = pixelsToMap(objects[0].getPosition().x);
+            healingZone.top = pixelsToMap(objects[0].getPosition().y);
+            healingZone.width = pixelsToMap(objects[0].getAABB().width);
+            healingZone.height = pixelsToMap(objects[0].getAABB().height);
         } else if (layer->getName() == "creepGoal") {
             auto objects = layer->getLayerAs<tmx::ObjectGroup>().getObjects();
             if (objects.size() != 1)
                 throw std::runtime_error("Expected 1 creep goal in map");
-            creepGoal.left = static_cast<FPMNum>(objects[0].getPosition().x / tileHeight);
-            creepGoal.top = static_cast<FPMNum>(objects[0].getPosition().y / tileHeight);
-            creepGoal.width = static_cast<FPMNum>(objects[0].getAABB().width / tileHeight);
-            creepGoal.height = static_cast<FPMNum>(objects[0].getAABB().height / tileHeight);
+            creepGoal.left = pixelsToMap(objects[0].getPosition().x);
+            creepGoal.top = pixelsToMap(objects[0].getPosition().y);
+            creepGoal.width = pixelsToMap(objects[0].getAABB().width);
+            creepGoal.height = pixelsToMap(objects[0].getAABB().height);
         } else if (layer->getName() == "shop") {
             auto objects = layer->getLayerAs<tmx::ObjectGroup>().getObjects();
             if (objects.size() != 1)
                 throw std::runtime_error("Expected 1 shop zone in map");
-            shop.left = static_cast<FPMNum>(objects[0].getPosition().x / tileHeight);
-            shop.top = static_cast<FPMNum>(objects[0].getPosition().y / tileHeight);
-            shop.width = static_cast<FPMNum>(objects[0].getAABB().width / tileHeight);
-            shop.height = static_cast<FPMNum>(objects[0].getAABB().height / tileHeight);
+            shop.left = pixelsToMap(objects[0].getPosition().x);
+            shop.top = pixelsToMap(objects[0].getPosition().y);
+            shop.width = pixelsToMap(objects[0].getAABB().width);
+            shop.height = pixelsToMap(objects[0].getAABB().height);
         } else if (layer->getName() == "obstacles") {
-            mapToObstacles.resize((width + 2) * (height + 2) + 1);
             auto objects = layer->getLayerAs<tmx::ObjectGroup>().getObjects();
             obstacles.reserve(objects.size());
             for (const auto& object : objects) {
                 assert(object.getShape() == tmx::Object::Shape::Rectangle);
-                auto newObstacle = std::make_shared<FPMRect>(static_cast<FPMNum>(object.getAABB().left / tileHeight), static_cast<FPMNum>(object.getAABB().top / tileHeight),
-                                                             static_cast<FPMNum>(object.getAABB().width / tileHeight), static_cast<FPMNum>(object.getAABB().height / tileHeight));
+                auto newObstacle = std::make_shared<FPMRect>(pixelsToMap(object.getAABB().left), pixelsToMap(object.getAABB().top),
+                                                             pixelsToMap(object.getAABB().width), pixelsToMap(object.getAABB().height));
                 FPMVector2 posInObstacle;
                 for (posInObstacle.x = newObstacle->left; posInObstacle.x < newObstacle->left + newObstacle->width; posInObstacle.x += 1) {
                     for (posInObstacle.y = newObstacle->top; posInObstacle.y < newObstacle->top + newObstacle->height; posInObstacle.y += 1) {
-                        getObstaclesAt(posInObstacle).push_back(newObstacle);
+                        getObstaclesAtForInsert(posInObstacle).push_back(newObstacle);
                     }
                 }
                 obstacles.emplace_back(newObstacle);
             }
         } else if (layer->getName() == "flowfield") {
             auto firstFlowfieldID = map.getTilesets()[1].getFirstGID();
-            flowfield.resize(width * height, ORIENTATIONS::NUM_ORIENTATIONS);
             auto tiles = layer->getLayerAs<tmx::TileLayer>().getTiles();
             for (int y = 0; y < height; ++y) {
                 for (int x = 0; x < width; ++x) {
@@ -110,12 +293,268 @@ Tilemap::Tilemap(const std::string &filename) {
                     if (tileID > 0) {
                         if (tileID < firstFlowfieldID || tileID >= firstFlowfieldID + 8)
                             throw std::runtime_error("Invalid tiles in flowfield layer");
-                        flowfield[y * width + x] = static_cast<ORIENTATIONS>(tileID - firstFlowfieldID);
+                        auto &chunk = flowfieldChunks[(y / MAP_CHUNK_SIZE) * chunksX + x / MAP_CHUNK_SIZE];
+                        if (!chunk) {
+                            chunk = std::make_unique<FlowfieldChunk>();
+                            chunk->fill(ORIENTATIONS::NUM_ORIENTATIONS);
+                        }
+                        (*chunk)[(y % MAP_CHUNK_SIZE) * MAP_CHUNK_SIZE + x % MAP_CHUNK_SIZE] = static_cast<ORIENTATIONS>(tileID - firstFlowfieldID);
                     }
                 }
             }
         }
     }
+    contentHash = computeContentHash();
+}
+
+sf::Uint64 Tilemap::computeContentHash() const {
+    ContentHasher hasher;
+    hasher.add(width);
+    hasher.add(height);
+    hasher.add(tileWidth);
+    hasher.add(tileHeight);
+    for (const auto &position : playerSpawnPositions) {
+        hasher.addNum(position.x);
+        hasher.addNum(position.y);
+    }
+    for (const auto &zone : creepSpawnZones)
+        hasher.addRect(zone);
+    hasher.addRect(playerRespawnZone);
+    hasher.addRect(shop);
+    hasher.addRect(healingZone);
+    hasher.addRect(creepGoal);
+    hasher.add(obstacles.size());
+    for (const auto &obstacle : obstacles)
+        hasher.addRect(*obstacle);
+    for (unsigned int i = 0; i < flowfieldChunks.size(); i++) {
+        if (!flowfieldChunks[i])
+            continue;
+        hasher.add(i);
+        for (auto flow : *flowfieldChunks[i])
+            hasher.add(static_cast<sf::Uint64>(flow));
+    }
+    return hasher.get();
+}
+
+sf::Uint64 Tilemap::readContentHash(const std::string &filename) {
+    const std::string cookedExtension = ".arenamap";
+    if (filename.size() >= cookedExtension.size() && filename.compare(filename.size() - cookedExtension.size(), cookedExtension.size(), cookedExtension) == 0) {
+        MappedFile file(filename);
+        auto header = CookedMapReader(file.getData(), file.getSize()).readHeader(filename);
+        return static_cast<sf::Uint64>(header.contentHashHigh) << 32 | header.contentHashLow;
+    }
+    return Tilemap(filename, false).getContentHash();
+}
+
+void Tilemap::initChunks() {
+    chunksX = (width + MAP_CHUNK_SIZE - 1) / MAP_CHUNK_SIZE;
+    chunksY = (height + MAP_CHUNK_SIZE - 1) / MAP_CHUNK_SIZE;
+    renderChunks.clear();
+    renderChunks.resize(chunksX * chunksY);
+    flowfieldChunks.clear();
+    flowfieldChunks.resize(chunksX * chunksY);
+    obstacleChunksX = (width + 2 + MAP_CHUNK_SIZE - 1) / MAP_CHUNK_SIZE;
+    obstacleChunksY = (height + 2 + MAP_CHUNK_SIZE - 1) / MAP_CHUNK_SIZE;
+    obstacleChunks.clear();
+    obstacleChunks.resize(obstacleChunksX * obstacleChunksY);
+    outsideObstacles.clear();
+}
+
+void Tilemap::loadFromCooked(const std::string &filename) {
+    MappedFile file(filename);
+    CookedMapReader reader(file.getData(), file.getSize());
+
+    auto header = reader.readHeader(filename);
+    width = header.width;
+    height = header.height;
+    tileWidth = header.tileWidth;
+    tileHeight = header.tileHeight;
+    tilesetTileWidth = header.tilesetTileWidth;
+    tilesetTileHeight = header.tilesetTileHeight;
+    tilesetTilesPerColumn = header.tilesetTilesPerColumn;
+    initChunks();
+
+    tilesetImagePath.resize(header.tilesetImagePathLength);
+    reader.read(&tilesetImagePath[0], tilesetImagePath.size());
+
+    playerSpawnPositions.reserve(header.numPlayerSpawnPositions);
+    for (unsigned int i = 0; i < header.numPlayerSpawnPositions; i++)
+        playerSpawnPositions.push_back(reader.readVector());
+    creepSpawnZones.reserve(header.numCreepSpawnZones);
+    for (unsigned int i = 0; i < header.numCreepSpawnZones; i++)
+        creepSpawnZones.push_back(reader.readRect());
+    playerRespawnZone = reader.readRect();
+    shop = reader.readRect();
+    healingZone = reader.readRect();
+    creepGoal = reader.readRect();
+
+    obstacles.reserve(header.numObstacles);
+    for (unsigned int i = 0; i < header.numObstacles; i++)
+        obstacles.emplace_back(std::make_shared<FPMRect>(reader.readRect()));
+
+    std::vector<sf::Uint32> obstacleChunkNumbers(header.numObstacleChunks);
+    reader.read(obstacleChunkNumbers.data(), obstacleChunkNumbers.size());
+    auto numObstacleIndexCells = obstacleChunkNumbers.size() * MAP_CHUNK_SIZE * MAP_CHUNK_SIZE + 1;
+    std::vector<sf::Uint32> obstacleIndexOffsets(numObstacleIndexCells + 1);
+    std::vector<sf::Uint32> obstacleIndexEntries(header.numObstacleIndexEntries);
+    reader.read(obstacleIndexOffsets.data(), obstacleIndexOffsets.size());
+    reader.read(obstacleIndexEntries.data(), obstacleIndexEntries.size());
+    auto readObstacleIndexCell = [&](std::size_t cell, std::vector<std::shared_ptr<FPMRect>> &out) {
+        auto begin = obstacleIndexOffsets[cell];
+        auto end = obstacleIndexOffsets[cell + 1];
+        if (begin > end || end > obstacleIndexEntries.size())
+            throw std::runtime_error("Invalid obstacle index in cooked map file " + filename);
+        out.reserve(end - begin);
+        for (auto entry = begin; entry < end; entry++) {
+            if (obstacleIndexEntries[entry] >= obstacles.size())
+                throw std::runtime_error("Invalid obstacle index in cooked map file " + filename);
+            out.push_back(obstacles[obstacleIndexEntries[entry]]);
+        }
+    };
+    for (std::size_t i = 0; i < obstacleChunkNumbers.size(); i++) {
+        if (obstacleChunkNumbers[i] >= obstacleChunks.size() || obstacleChunks[obstacleChunkNumbers[i]])
+            throw std::runtime_error("Invalid obstacle chunk in cooked map file " + filename);
+        auto &chunk = obstacleChunks[obstacleChunkNumbers[i]];
+        chunk = std::make_unique<ObstacleChunk>();
+        for (unsigned int tile = 0; tile < MAP_CHUNK_SIZE * MAP_CHUNK_SIZE; tile++)
+            readObstacleIndexCell(i * MAP_CHUNK_SIZE * MAP_CHUNK_SIZE + tile, (*chunk)[tile]);
+    }
+    readObstacleIndexCell(numObstacleIndexCells - 1, outsideObstacles);
+
+    std::vector<sf::Uint32> flowfieldChunkNumbers(header.numFlowfieldChunks);
+    reader.read(flowfieldChunkNumbers.data(), flowfieldChunkNumbers.size());
+    for (auto chunkNumber : flowfieldChunkNumbers) {
+        if (chunkNumber >= flowfieldChunks.size() || flowfieldChunks[chunkNumber])
+            throw std::runtime_error("Invalid flowfield chunk in cooked map file " + filename);
+        auto &chunk = flowfieldChunks[chunkNumber];
+        chunk = std::make_unique<FlowfieldChunk>();
+        reader.read(chunk->data(), chunk->size());
+        for (auto flow : *chunk)
+            if (flow > ORIENTATIONS::NUM_ORIENTATIONS)
+                throw std::runtime_error("Invalid flowfield in cooked map file " + filename);
+    }
+
+    std::vector<CookedRenderChunk> cookedRenderChunks(header.numRenderChunks);
+    reader.read(cookedRenderChunks.data(), cookedRenderChunks.size());
+    sf::Uint32 numVertices = 0;
+    for (const auto &cookedChunk : cookedRenderChunks) {
+        if (cookedChunk.chunkNumber >= renderChunks.size() || renderChunks[cookedChunk.chunkNumber] ||
+            cookedChunk.layerEnd[0] > cookedChunk.layerEnd[1] || cookedChunk.layerEnd[1] > cookedChunk.layerEnd[2] ||
+            cookedChunk.layerEnd[2] > MAP_CHUNK_SIZE * MAP_CHUNK_SIZE * 6 * 3)
+            throw std::runtime_error("Invalid render chunk in cooked map file " + filename);
+        auto &chunk = renderChunks[cookedChunk.chunkNumber];
+        chunk = std::make_unique<RenderChunk>();
+        std::copy(std::begin(cookedChunk.layerEnd), std::end(cookedChunk.layerEnd), chunk->layerEnd.begin());
+        chunk->bounds = sf::FloatRect(cookedChunk.bounds[0], cookedChunk.bounds[1], cookedChunk.bounds[2], cookedChunk.bounds[3]);
+        chunk->vertices.resize(cookedChunk.layerEnd[2]);
+        reader.read(chunk->vertices.data(), chunk->vertices.size());
+        numVertices += cookedChunk.layerEnd[2];
+    }
+    if (numVertices != header.numVertices)
+        throw std::runtime_error("Invalid vertex count in cooked map file " + filename);
+
+    if (!reader.atEnd())
+        throw std::runtime_error("Unexpected trailing data in cooked map file " + filename);
+    // The hash is taken from the header instead of being recomputed, so that it matches what readContentHash returns
+    contentHash = static_cast<sf::Uint64>(header.contentHashHigh) << 32 | header.contentHashLow;
+}
+
+void Tilemap::saveCooked(const std::string &filename) const {
+    std::unordered_map<const FPMRect *, sf::Uint32> obstacleNumbers;
+    for (unsigned int i = 0; i < obstacles.size(); i++)
+        obstacleNumbers[obstacles[i].get()] = i;
+    std::vector<sf::Uint32> obstacleChunkNumbers;
+    std::vector<sf::Uint32> obstacleIndexOffsets;
+    std::vector<sf::Uint32> obstacleIndexEntries;
+    auto writeObstacleIndexCell = [&](const std::vector<std::shared_ptr<FPMRect>> &cell) {
+        for (const auto &obstacle : cell)
+            obstacleIndexEntries.push_back(obstacleNumbers.at(obstacle.get()));
+        obstacleIndexOffsets.push_back(static_cast<sf::Uint32>(obstacleIndexEntries.size()));
+    };
+    obstacleIndexOffsets.push_back(0);
+    for (unsigned int i = 0; i < obstacleChunks.size(); i++) {
+        if (!obstacleChunks[i])
+            continue;
+        obstacleChunkNumbers.push_back(i);
+        for (const auto &cell : *obstacleChunks[i])
+            writeObstacleIndexCell(cell);
+    }
+    writeObstacleIndexCell(outsideObstacles);
+
+    std::vector<sf::Uint32> flowfieldChunkNumbers;
+    for (unsigned int i = 0; i < flowfieldChunks.size(); i++)
+        if (flowfieldChunks[i])
+            flowfieldChunkNumbers.push_back(i);
+
+    std::vector<CookedRenderChunk> cookedRenderChunks;
+    sf::Uint32 numVertices = 0;
+    for (unsigned int i = 0; i < renderChunks.size(); i++) {
+        if (!renderChunks[i])
+            continue;
+        const auto &chunk = *renderChunks[i];
+        CookedRenderChunk cookedChunk{};
+        cookedChunk.chunkNumber = i;
+        std::copy(chunk.layerEnd.begin(), chunk.layerEnd.end(), std::begin(cookedChunk.layerEnd));
+        cookedChunk.bounds[0] = chunk.bounds.left;
+        cookedChunk.bounds[1] = chunk.bounds.top;
+        cookedChunk.bounds[2] = chunk.bounds.width;
+        cookedChunk.bounds[3] = chunk.bounds.height;
+        cookedRenderChunks.push_back(cookedChunk);
+        numVertices += chunk.layerEnd[2];
+    }
+
+    CookedMapHeader header{};
+    std::memcpy(header.magic, COOKED_MAP_MAGIC, sizeof(COOKED_MAP_MAGIC));
+    header.version = COOKED_MAP_VERSION;
+    header.byteOrderMark = COOKED_MAP_BYTE_ORDER_MARK;
+    header.fixedPointFractionBits = FPM_FRACTION_BITS;
+    header.vertexSize = sizeof(Vertex3);
+    header.chunkSize = MAP_CHUNK_SIZE;
+    header.width = width;
+    header.height = height;
+    header.tileWidth = tileWidth;
+    header.tileHeight = tileHeight;
+    header.tilesetTileWidth = tilesetTileWidth;
+    header.tilesetTileHeight = tilesetTileHeight;
+    header.tilesetTilesPerColumn = tilesetTilesPerColumn;
+    header.tilesetImagePathLength = static_cast<sf::Uint32>(tilesetImagePath.size());
+    header.numPlayerSpawnPositions = static_cast<sf::Uint32>(playerSpawnPositions.size());
+    header.numCreepSpawnZones = static_cast<sf::Uint32>(creepSpawnZones.size());
+    header.numObstacles = static_cast<sf::Uint32>(obstacles.size());
+    header.numObstacleChunks = static_cast<sf::Uint32>(obstacleChunkNumbers.size());
+    header.numObstacleIndexEntries = static_cast<sf::Uint32>(obstacleIndexEntries.size());
+    header.numFlowfieldChunks = static_cast<sf::Uint32>(flowfieldChunkNumbers.size());
+    header.numRenderChunks = static_cast<sf::Uint32>(cookedRenderChunks.size());
+    header.numVertices = numVertices;
+    header.contentHashLow = static_cast<sf::Uint32>(contentHash);
+    header.contentHashHigh = static_cast<sf::Uint32>(contentHash >> 32);
+
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+    if (!file)
+        throw std::runtime_error("Could not open file " + filename + " for writing");
+    writeCooked(file, &header, 1);
+    writeCooked(file, tilesetImagePath.data(), tilesetImagePath.size());
+    for (const auto &position : playerSpawnPositions)
+        writeCookedVector(file, position);
+    for (const auto &zone : creepSpawnZones)
+        writeCookedRect(file, zone);
+    writeCookedRect(file, playerRespawnZone);
+    writeCookedRect(file, shop);
+    writeCookedRect(file, healingZone);
+    writeCookedRect(file, creepGoal);
+    for (const auto &obstacle : obstacles)
+        writeCookedRect(file, *obstacle);
+    writeCooked(file, obstacleChunkNumbers.data(), obstacleChunkNumbers.size());
+    writeCooked(file, obstacleIndexOffsets.data(), obstacleIndexOffsets.size());
+    writeCooked(file, obstacleIndexEntries.data(), obstacleIndexEntries.size());
+    writeCooked(file, flowfieldChunkNumbers.data(), flowfieldChunkNumbers.size());
+    for (auto chunkNumber : flowfieldChunkNumbers)
+        writeCooked(file, flowfieldChunks[chunkNumber]->data(), flowfieldChunks[chunkNumber]->size());
+    writeCooked(file, cookedRenderChunks.data(), cookedRenderChunks.size());
+    for (const auto &cookedChunk : cookedRenderChunks)
+        writeCooked(file, renderChunks[cookedChunk.chunkNumber]->vertices.data(), cookedChunk.layerEnd[2]);
+    if (!file)
+        throw std::runtime_error("Could not write file " + filename);
 }
 
 void Tilemap::createVertices(const tmx::Map &map, unsigned int tilesetIDOffset) {
@@ -125,9 +564,8 @@ void Tilemap::createVertices(const tmx::Map &map, unsigned int tilesetIDOffset)
     unsigned int offY = tileHeight / 2;
     int startX = ((width - 1) * tileWidth) / 2;
 
-    vertices.resize(width * height * 6 * 3); // Could also reserve based on actual contents
-
-    unsigned int renderOrder[3];
+    const unsigned int layerNotFound = map.getLayers().size();
+    unsigned int renderOrder[3] = {layerNotFound, layerNotFound, layerNotFound};
     for (unsigned int i = 0; i < map.getLayers().size(); i++) {
         if (map.getLayers()[i]->getName() == "ground") {
             renderOrder[0] = i;
@@ -138,8 +576,10 @@ void Tilemap::createVertices(const tmx::Map &map, unsigned int tilesetIDOffset)
         }
     }
 
-    totalNumVertices = 0;
-    for (unsigned int i: renderOrder) {
+    for (unsigned int layerNum = 0; layerNum < 3; layerNum++) {
+        auto i = renderOrder[layerNum];
+        if (i == layerNotFound)
+            throw std::runtime_error("Missing ground, walls or decor layer in map");
         auto layer = map.getLayers()[i]->getLayerAs<tmx::TileLayer>();
         auto tiles = layer.getTiles();
         for (int y = 0; y < height; ++y) {
@@ -154,12 +594,24 @@ void Tilemap::createVertices(const tmx::Map &map, unsigned int tilesetIDOffset)
                     unsigned int tilesetX = posInCol * tilesetTileWidth;
                     unsigned int tilesetY = col * tilesetTileHeight;
 
+                    auto &chunk = renderChunks[(y / MAP_CHUNK_SIZE) * chunksX + x / MAP_CHUNK_SIZE];
+                    if (!chunk) {
+                        chunk = std::make_unique<RenderChunk>();
+                        chunk->bounds = sf::FloatRect(drawX, drawY, tilesetTileWidth, tilesetTileHeight);
+                    }
+                    auto left = std::min(chunk->bounds.left, static_cast<float>(drawX));
+                    auto top = std::min(chunk->bounds.top, static_cast<float>(drawY));
+                    auto right = std::max(chunk->bounds.left + chunk->bounds.width, static_cast<float>(drawX + tilesetTileWidth));
+                    auto bottom = std::max(chunk->bounds.top + chunk->bounds.height, static_cast<float>(drawY + tilesetTileHeight));
+                    chunk->bounds = sf::FloatRect(left, top, right - left, bottom - top);
+
                     // https://www.sfml-dev.org/tutorials/2.6/graphics-vertex-array.php
-                    Vertex3 *triangles = &vertices[totalNumVertices];
+                    chunk->vertices.resize(chunk->vertices.size() + 6);
+                    Vertex3 *triangles = &chunk->vertices[chunk->vertices.size() - 6];
 
                     float depth = 1.f;
                     if (map.getLayers()[i]->getName() != "ground")
-                        depth = 1.f - (((float) y * width + x) / (height * width)); // 1.f - ((float) y / height);
+                        depth = getDepth(sf::Vector2u(x, y));
                     triangles[0].position3D = sf::Vector3f(drawX, drawY, depth);
                     triangles[1].position3D = sf::Vector3f(drawX + tilesetTileWidth, drawY, depth);
                     triangles[2].position3D = sf::Vector3f(drawX, drawY + tilesetTileHeight, depth);
@@ -173,21 +625,32 @@ void Tilemap::createVertices(const tmx::Map &map, unsigned int tilesetIDOffset)
                     triangles[3].texCoords = sf::Vector2f(tilesetX, tilesetY + tilesetTileHeight);
                     triangles[4].texCoords = sf::Vector2f(tilesetX + tilesetTileWidth, tilesetY);
                     triangles[5].texCoords = sf::Vector2f(tilesetX + tilesetTileWidth, tilesetY + tilesetTileHeight);
-
-                    totalNumVertices += 6;
                 }
                 drawX += offX;
                 drawY += offY;
             }
         }
+        for (auto &chunk : renderChunks)
+            if (chunk)
+                chunk->layerEnd[layerNum] = chunk->vertices.size();
     }
+    for (auto &chunk : renderChunks)
+        if (chunk)
+            chunk->vertices.shrink_to_fit();
 }
 
 // https://www.jordansavant.com/book/graphics/sfml/sfml2_depth_buffering.md
 // Re-implementation of sf::RenderTarget::draw() to allow depth testing
 void Tilemap::draw(sf::RenderTarget &target, sf::RenderStates states) const {
+    // Only draw chunks that intersect the current view
+    const auto &view = target.getView();
+    sf::FloatRect visibleArea(view.getCenter() - view.getSize() / 2.f, view.getSize());
+    std::vector<const RenderChunk *> visibleChunks;
+    for (const auto &chunk : renderChunks)
+        if (chunk && chunk->bounds.intersects(visibleArea))
+            visibleChunks.push_back(chunk.get());
     // If no vertices, do not render
-    if (vertices.empty() || totalNumVertices == 0)
+    if (visibleChunks.empty())
         return;
     states.texture = &tilesetTexture;
 
@@ -208,36 +671,64 @@ void Tilemap::draw(sf::RenderTarget &target, sf::RenderStates states) const {
     if (states.shader)
         sf::Shader::bind(states.shader);
 
-    // Setup the pointers to the vertices' components
-    const char *data = reinterpret_cast<const char *>(&vertices[0]);
-    glVertexPointer(3, GL_FLOAT, sizeof(Vertex3), data);
-    glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(Vertex3), data + 12);
-    glTexCoordPointer(2, GL_FLOAT, sizeof(Vertex3), data + 16);
-
-    // Draw the primitives
-    glDrawArrays(GL_TRIANGLES, 0, totalNumVertices);
+    // Draw layer by layer (so that, e.g., all ground tiles are drawn before the walls), and chunk by chunk within each layer
+    for (unsigned int layerNum = 0; layerNum < 3; layerNum++) {
+        for (const auto chunk : visibleChunks) {
+            unsigned int first = layerNum == 0 ? 0 : chunk->layerEnd[layerNum - 1];
+            if (chunk->layerEnd[layerNum] == first)
+                continue;
+
+            // Setup the pointers to the vertices' components
+            const char *data = reinterpret_cast<const char *>(&chunk->vertices[0]);
+            glVertexPointer(3, GL_FLOAT, sizeof(Vertex3), data);
+            glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(Vertex3), data + 12);
+            glTexCoordPointer(2, GL_FLOAT, sizeof(Vertex3), data + 16);
+
+            // Draw the primitives
+            glDrawArrays(GL_TRIANGLES, first, chunk->layerEnd[layerNum] - first);
+        }
+    }
 
     // Unbind the shader, if any
     if (states.shader)
         sf::Shader::bind(nullptr);
 }
 
-std::vector<std::shared_ptr<FPMRect>> &Tilemap::getObstaclesAt(const FPMVector2 &map) {
+const std::vector<std::shared_ptr<FPMRect>> &Tilemap::getObstaclesAt(const FPMVector2 &map) const {
     if (map.x < FPMNum(-1) or map.y < FPMNum(-1) or map.x >= FPMNum(width + 1) or map.y >= FPMNum(height + 1))
-        return mapToObstacles[(width + 2) * (height + 2)];
+        return outsideObstacles;
     else {
         unsigned int x = static_cast<unsigned int>(map.x + 1);
         unsigned int y = static_cast<unsigned int>(map.y + 1);
-        return mapToObstacles[y * (width + 2) + x];
+        const auto &chunk = obstacleChunks[(y / MAP_CHUNK_SIZE) * obstacleChunksX + x / MAP_CHUNK_SIZE];
+        if (!chunk)
+            return noObstacles;
+        return (*chunk)[(y % MAP_CHUNK_SIZE) * MAP_CHUNK_SIZE + x % MAP_CHUNK_SIZE];
     }
 }
 
-ORIENTATIONS Tilemap::getFlowAt(const FPMVector2 &map) {
+std::vector<std::shared_ptr<FPMRect>> &Tilemap::getObstaclesAtForInsert(const FPMVector2 &map) {
+    if (map.x < FPMNum(-1) or map.y < FPMNum(-1) or map.x >= FPMNum(width + 1) or map.y >= FPMNum(height + 1))
+        return outsideObstacles;
+    else {
+        unsigned int x = static_cast<unsigned int>(map.x + 1);
+        unsigned int y = static_cast<unsigned int>(map.y + 1);
+        auto &chunk = obstacleChunks[(y / MAP_CHUNK_SIZE) * obstacleChunksX + x / MAP_CHUNK_SIZE];
+        if (!chunk)
+            chunk = std::make_unique<ObstacleChunk>();
+        return (*chunk)[(y % MAP_CHUNK_SIZE) * MAP_CHUNK_SIZE + x % MAP_CHUNK_SIZE];
+    }
+}
+
+ORIENTATIONS Tilemap::getFlowAt(const FPMVector2 &map) const {
     auto x = static_cast<int>(map.x);
     auto y = static_cast<int>(map.y);
     if (x < 0 or y < 0 or x >= width or y >= height)
         return ORIENTATIONS::NUM_ORIENTATIONS;
-    return flowfield[y * width + x];
+    const auto &chunk = flowfieldChunks[(y / MAP_CHUNK_SIZE) * chunksX + x / MAP_CHUNK_SIZE];
+    if (!chunk)
+        return ORIENTATIONS::NUM_ORIENTATIONS;
+    return (*chunk)[(y % MAP_CHUNK_SIZE) * MAP_CHUNK_SIZE + x % MAP_CHUNK_SIZE];
 }
 
 bool Tilemap::lineOfSightCheck(const FPMVector2 &rayStart, const FPMVector2& rayNormalizedDirection,
@@ -7,6 +7,9 @@
 #include "../Render/Vertex3.h"
 #include "../Util.h"
 #include "../FPMUtil.h"
+#include "../Constants.h"
+
+class Pathfinder;
 
 /**
  * The Tilemap class stores all all information about the game world that can be read from the map.tmx file.
@@ -17,11 +20,39 @@
  * mapToWorld and worldToMap can be used to convert between the two coordinate systems.
  *
  * The class extends sf::Drawable, so the tilemap can easily be drawn using window->draw(tilemap).
- * Rendering is done efficiently with a single vertex array for the entire map.
+ * Per-tile data (vertices, flowfield, obstacle index) is stored in chunks of MAP_CHUNK_SIZE x MAP_CHUNK_SIZE tiles.
+ * Chunks without any content are not allocated, and only chunks intersecting the current view are drawn. So memory
+ * and rendering costs do not grow with the total number of tiles in the map.
+ *
+ * Maps can be loaded either from a Tiled .tmx file or from a cooked .arenamap file (see saveCooked).
+ * The cooked format stores the raw fixed point values, the obstacle index, the flowfield and the prebuilt vertices,
+ * so loading it is a single memory-mapped read and every peer sees bit-identical map data.
  */
 class Tilemap : public sf::Drawable {
 public:
-    explicit Tilemap(const std::string &filename);
+    /***
+     * @param filename Either a Tiled .tmx file or a cooked .arenamap file
+     * @param loadTexture If false, the tileset texture is not loaded (e.g., when only cooking the map)
+     */
+    explicit Tilemap(const std::string &filename, bool loadTexture = true);
+
+    ~Tilemap() override;
+
+    /***
+     * Write the map to a versioned binary .arenamap file which can later be passed to the constructor.
+     */
+    void saveCooked(const std::string &filename) const;
+
+    /***
+     * Hash of all map data that affects the simulation (spawn points, zones, obstacles, flowfield). Peers compare
+     * it before starting a game, since different maps lead to different simulations.
+     */
+    sf::Uint64 getContentHash() const { return contentHash; }
+
+    /***
+     * Get the content hash of a map file without loading it completely. For cooked maps, only the header is read.
+     */
+    static sf::Uint64 readContentHash(const std::string &filename);
 
     template <typename T> inline sf::Vector2f mapToWorld(const sf::Vector2<T> &map) const {
         auto x = static_cast<float>(map.x);
@@ -46,6 +77,14 @@ public:
         return map.x >= FPMNum(0) and map.y >= FPMNum(0) and map.x < FPMNum(width) and map.y < FPMNum(height);
     }
 
+    // Value for the depth buffer when rendering something at the given map position. Computed in double precision,
+    // since on large maps the float formula no longer distinguishes neighboring positions.
+    template <typename T> inline float getDepth(const sf::Vector2<T> &map) const {
+        auto y = std::floor(static_cast<double>(map.y));
+        auto x = static_cast<double>(map.x);
+        return static_cast<float>(1.0 - (y * width + x) / (static_cast<double>(height) * width));
+    }
+
     const std::vector<FPMVector2>& getPlayerSpawnPositions() const { return playerSpawnPositions; };
 
     const std::vector<FPMRect>& getCreepSpawnZones() const { return creepSpawnZones; };
@@ -58,9 +97,11 @@ public:
 
     const FPMRect& getCreepGoal() const { return creepGoal; };
 
-    std::vector<std::shared_ptr<FPMRect>>& getObstaclesAt(const FPMVector2 &map);
+    const std::vector<std::shared_ptr<FPMRect>>& getObstacles() const { return obstacles; };
 
-    ORIENTATIONS getFlowAt(const FPMVector2 &map);
+    const std::vector<std::shared_ptr<FPMRect>>& getObstaclesAt(const FPMVector2 &map) const;
+
+    ORIENTATIONS getFlowAt(const FPMVector2 &map) const;
 
     /***
      * Check whether there is an uninterrupted (i.e., no obstacle in the way) straight line from rayStart to
@@ -76,14 +117,44 @@ public:
      */
     bool lineOfSightCheck(const FPMVector2& rayStart, const FPMVector2& rayNormalizedDirection, const FPMNum& rayLength, FPMVector2 &collisionPosition, FPMVector2 &collisionNormal);
 
+    // Pathfinding on the obstacle grid. Created on first use.
+    Pathfinder& getPathfinder();
+
 private:
     void draw(sf::RenderTarget &target, sf::RenderStates states) const override;
 
+    void loadFromTmx(const std::string &filename);
+
+    void loadFromCooked(const std::string &filename);
+
+    sf::Uint64 computeContentHash() const;
+
     void createVertices(const tmx::Map &map, unsigned int tilesetIDOffset);
 
+    // Converts a pixel coordinate from the .tmx file to map coordinates without going through float arithmetic
+    FPMNum pixelsToMap(float pixels) const;
+
+    // Set up the (still empty) chunk tables once width and height are known
+    void initChunks();
+
+    // Like getObstaclesAt, but allocates the chunk if necessary. Only used while loading the map
+    std::vector<std::shared_ptr<FPMRect>>& getObstaclesAtForInsert(const FPMVector2 &map);
+
+    // Vertices of all tiles in one chunk, ordered by render layer (ground, walls, decor)
+    struct RenderChunk {
+        std::vector<Vertex3> vertices;
+        // Vertices of layer i end at index layerEnd[i]
+        std::array<unsigned int, 3> layerEnd{};
+        // Bounding box of all vertices in world coordinates, used for culling
+        sf::FloatRect bounds;
+    };
+    typedef std::array<ORIENTATIONS, MAP_CHUNK_SIZE * MAP_CHUNK_SIZE> FlowfieldChunk;
+    typedef std::array<std::vector<std::shared_ptr<FPMRect>>, MAP_CHUNK_SIZE * MAP_CHUNK_SIZE> ObstacleChunk;
+
+    std::string tilesetImagePath;
     sf::Texture tilesetTexture;
-    std::vector<Vertex3> vertices;
-    unsigned int totalNumVertices;
+
+    sf::Uint64 contentHash;
 
     unsigned int width;
     unsigned int height;
@@ -100,6 +171,23 @@ private:
     FPMRect healingZone;
     FPMRect creepGoal;
     std::vector<std::shared_ptr<FPMRect>> obstacles;
-    std::vector<std::vector<std::shared_ptr<FPMRect>>> mapToObstacles;
-    std::vector<ORIENTATIONS> flowfield;
+
+    // Number of chunks in x and y direction for render and flowfield chunks
+    unsigned int chunksX;
+    unsigned int chunksY;
+    // Chunks are nullptr if they contain no tiles
+    std::vector<std::unique_ptr<RenderChunk>> renderChunks;
+    // Chunks are nullptr if they contain no flowfield tiles
+    std::vector<std::unique_ptr<FlowfieldChunk>> flowfieldChunks;
+    // The obstacle index also covers a border of one tile around the map, so it has its own chunk counts
+    unsigned int obstacleChunksX;
+    unsigned int obstacleChunksY;
+    // Chunks are nullptr if no obstacle overlaps them
+    std::vector<std::unique_ptr<ObstacleChunk>> obstacleChunks;
+    // Obstacles overlapping tiles further outside of the map than the border
+    std::vector<std::shared_ptr<FPMRect>> outsideObstacles;
+    // Returned for tiles in chunks that are not allocated
+    const std::vector<std::shared_ptr<FPMRect>> noObstacles;
+
+    std::unique_ptr<Pathfinder> pathfinder;
 };
@@ -1,43 +1,97 @@
 #include "Game.h"
 #include "SFML/Network.hpp"
 #include <iostream>
+#include <fstream>
+#include <limits>
+#include <thread>
 #include "SFML/OpenGL.hpp"
 #include "../GameObjects/Items.h"
 #include "../GameObjects/Skills.h"
 #include "../Render/Arrow.h"
 #include "../Render/MapCircleShape.h"
+#include "../JobSystem.h"
+#include "../NetworkEvents/WireFormat.h"
 #include <fpm/ios.hpp>
 
+std::string Game::mapFilenameOverride;
+bool Game::udpEnabled = false;
+unsigned int Game::inputDelayOverride = 0;
+bool Game::logNetworkStats = false;
+bool Game::recordStepStalls = false;
+bool Game::traceLatency = false;
+
+std::string Game::getMapFilename() {
+    if (!mapFilenameOverride.empty())
+        return mapFilenameOverride;
+    // Prefer the cooked map (see Tilemap::saveCooked) and fall back to parsing the Tiled file
+    if (std::ifstream("Data/map/map.arenamap").good())
+        return "Data/map/map.arenamap";
+    return "Data/map/map.tmx";
+}
+
 void Game::start(std::shared_ptr<void> data) {
     auto startData = std::static_pointer_cast<GameStartData>(data);
     gen.seed(startData->randomSeed);
+    spectating = startData->spectating;
+    catchUpStep = startData->catchUpStep;
+    catchUpPlayerName = startData->playerName;
     std::cout << "Running simulation with seed " << startData->randomSeed << std::endl;
 
-    tilemap = std::make_shared<Tilemap>("Data/map/map.tmx");
+    tilemap = std::make_shared<Tilemap>(getMapFilename(), !headless);
     characterContainer = std::make_shared<CharacterContainer>(tilemap);
-    Character::loadStaticResources();
-    Arrow::loadStaticResources();
+    Character::loadStaticResources(!headless);
+    if (!headless)
+        Arrow::loadStaticResources();
     for (int i = 0; i < startData->playersList.size(); i++)
         playerCharacters.emplace_back(std::make_shared<Player>(i, startData->playersList[i].second, tilemap->getPlayerSpawnPositions()[i], tilemap, characterContainer, gen(), startData->playersList[i].first, defaultFont));
 
-    auto curWindowSize = window->getSize();
-    viewUI.reset(sf::FloatRect(0, 0, curWindowSize.x, curWindowSize.y));
-    viewWorld.reset(sf::FloatRect(0, 0, curWindowSize.x, curWindowSize.y));
-    viewWorld.setCenter(tilemap->mapToWorld(playerCharacters[playerIndex]->getMapPosition()));
-
     simulationStep = 0;
     simulationTimerMS = 0;
+    simulationTimer = sf::Time::Zero;
+    simulationPaceMS = SIMULATION_TIME_STEP_MS / 3;
     latestSimulationStepAvailable = 0;
+    inputDelaySteps = 1;
+    simulationTimingSum = sf::Time::Zero;
+    simulationTimingMax = sf::Time::Zero;
+    simulationTimingNumSteps = 0;
+    simulationStepAverageMS = 0;
+    simulationStepMaxMS = 0;
+    networkStatsClock.restart();
+    frameTimingSum = sf::Time::Zero;
+    frameTimingMax = sf::Time::Zero;
+    frameTimingNumFrames = 0;
+    stallMS = 0;
+    numStalls = 0;
+    stallTimeSumMS = 0;
+    stallTimeMaxMS = 0;
+    minStepsBuffered = std::numeric_limits<unsigned int>::max();
+    timingStatsLines.clear();
+    stepStallsMS.clear();
+    localClock.restart();
+    latencyTrace.clear();
     movementKeyStates.fill(false);
     justPressedShortcut.fill(false);
     autoAttackEnabled = true;
     justClickedLeft = false;
     justClickedRight = false;
+    autoAttackCheckedStep = 0;
 
     newCreepIDCounter = MAX_NUM_PLAYERS;
     maxLives = MAX_LIVES;
     lives = maxLives;
     outcome = GAME_OUTCOME::STILL_PLAYING;
+    newCheckpoint = nullptr;
+
+    if (headless) {
+        deltaClock.restart();
+        nextHeadlessTick = std::chrono::steady_clock::now();
+        return;
+    }
+
+    auto curWindowSize = window->getSize();
+    viewUI.reset(sf::FloatRect(0, 0, curWindowSize.x, curWindowSize.y));
+    viewWorld.reset(sf::FloatRect(0, 0, curWindowSize.x, curWindowSize.y));
+    viewWorld.setCenter(tilemap->mapToWorld(playerCharacters[playerIndex]->getMapPosition()));
 
     characterIDBuffer.create(curWindowSize.x, curWindowSize.y, sf::ContextSettings(24));
     characterIDBuffer.setView(viewWorld);
@@ -45,6 +99,7 @@ void Game::start(std::shared_ptr<void> data) {
 
     targetSelectionSkillNum = 0;
     hoveredCharacter = nullptr;
+    hoveredCharacterID = 0;
     targetSelectionGuidingShape = std::make_unique<MapCircleShape>(tilemap, FPMNum(0));
     playerAttackRangeShape = std::make_unique<MapCircleShape>(tilemap, FPMNum(0));
     playerAttackRangeShape->setFillColor(sf::Color(150, 150, 150, 50));
@@ -89,9 +144,20 @@ void Game::start(std::shared_ptr<void> data) {
     }
 
     deltaClock.restart();
+    publishRenderSnapshot();
+    stopSimulation = false;
+    simulationFailed = false;
+    simulationThread = std::thread(&Game::runSimulationThread, this);
+}
+
+Game::~Game() {
+    stopSimulationThread();
 }
 
 std::shared_ptr<void> Game::end() {
+    stopSimulationThread();
+    renderSnapshot = nullptr;
+    diedCreeps.clear();
     playerCharacters.clear();
     creeps.clear();
     guards.clear();
@@ -111,8 +177,15 @@ GameState::GAME_STATES Game::run() {
      *
      * First, we collect some key states and window events.
      */
+    if (headless)
+        return runHeadless();
+    if (simulationFailed) {
+        stopSimulationThread();
+        std::rethrow_exception(simulationError);
+    }
     auto elapsedTime = deltaClock.getElapsedTime();
     deltaClock.restart();
+    workerUtilization = JobSystem::describeUtilization();
 
     justClickedLeft = false;
     justClickedRight = false;
@@ -190,10 +263,25 @@ GameState::GAME_STATES Game::run() {
     }
 
     /***
-     * Before handling user input, we make sure we have the latest game state simulated.
+     * Before handling user input, we pass on the latest actions and events. From here on until the rendering, the
+     * game state must not change, so the simulation thread waits.
      */
+    std::unique_lock<std::mutex> worldLock(worldMutex);
     network();
-    simulate(elapsedTime);
+    updateNetworkStats(elapsedTime);
+
+    if (catchUpStep != 0) {
+        if (simulationStep < catchUpStep) {
+            auto step = simulationStep;
+            worldLock.unlock();
+            renderCatchUpProgress(step);
+            return nextState;
+        }
+        finishCatchUp();
+    }
+    // The hovered character may have been removed while the world was not locked
+    if (hoveredCharacter)
+        hoveredCharacter = characterContainer->isAlive(hoveredCharacterID) ? characterContainer->getCharacterByID(hoveredCharacterID) : nullptr;
 
     /***
      * Now, we process user input. Note that there is a second code section that deals with
@@ -204,11 +292,13 @@ GameState::GAME_STATES Game::run() {
      * If auto-attack is enabled, a new simulation step just started, and the player is not attacking something
      * nor moving in this step, start attacking something.
      */
-    if (autoAttackEnabled and simulationTimerMS == 0 and playerCharacters[playerIndex]->getAttackTargetID() == playerIndex and !playerCharacters[playerIndex]->isMoving()) {
+    bool newStepStarted = autoAttackCheckedStep != simulationStep;
+    autoAttackCheckedStep = simulationStep;
+    if (autoAttackEnabled and newStepStarted and playerCharacters[playerIndex]->getAttackTargetID() == playerIndex and !playerCharacters[playerIndex]->isMoving()) {
         auto nearbyCharacters = characterContainer->getCharactersAtWithTolerance(playerCharacters[playerIndex]->getMapPosition(), playerCharacters[playerIndex]->getAttackRange());
         for (const auto& c : *nearbyCharacters) {
             if (!c->isPlayerOrAlly() and playerCharacters[playerIndex]->canAttack(c->getMapPosition())) {
-                localActions.emplace(std::make_unique<Action>(Action::AttackCharacterAction{c->getID()}));
+                addLocalAction(std::make_unique<Action>(Action::AttackCharacterAction{c->getID()}));
                 break;
             }
         }
@@ -255,7 +345,7 @@ GameState::GAME_STATES Game::run() {
                        sf::Keyboard::isKeyPressed(sf::Keyboard::S),
                        sf::Keyboard::isKeyPressed(sf::Keyboard::D)};
         if (movementKeyStates != curKeys.keyStates) {
-            localActions.push(std::make_unique<Action>(curKeys));
+            addLocalAction(std::make_unique<Action>(curKeys));
             movementKeyStates = curKeys.keyStates;
         }
 
@@ -272,8 +362,10 @@ GameState::GAME_STATES Game::run() {
                 characterIDBufferUpdateTimer -= 1;
             auto hoveredPixel = characterIDImage.getPixel(mousePos.x, mousePos.y);
             auto decodedID = (static_cast<unsigned int>(hoveredPixel.r) << 16) + (static_cast<unsigned int>(hoveredPixel.g) << 8) + static_cast<unsigned int>(hoveredPixel.b) - 1;
-            if (characterContainer->isAlive(decodedID))
+            if (characterContainer->isAlive(decodedID)) {
                 hoveredCharacter = characterContainer->getCharacterByID(decodedID);
+                hoveredCharacterID = decodedID;
+            }
         }
 
         playerAttackRangeShape->setRadius(playerCharacters[playerIndex]->getAttackRange());
@@ -289,7 +381,7 @@ GameState::GAME_STATES Game::run() {
             switch (skillInfo.targetType) {
                 case SKILL_TARGET_TYPES::SELF: {
                     if (playerCharacters[playerIndex]->canUseSkill(targetSelectionSkillNum, 0, FPMVector2()))
-                        localActions.push(std::make_unique<Action>(Action::UseSelfSkillAction{{targetSelectionSkillNum}}));
+                        addLocalAction(std::make_unique<Action>(Action::UseSelfSkillAction{{targetSelectionSkillNum}}));
                     targetSelectionSkillNum = 0;
                 } break;
                 case SKILL_TARGET_TYPES::SINGLE_CREEP: {
@@ -298,9 +390,9 @@ GameState::GAME_STATES Game::run() {
                             hoveredCharacter->hover(sf::Color::Green);
                             if (justClickedLeft and imgui->getLastHotItem() <= 0) {
                                 if (targetSelectionSkillNum == 0)
-                                    localActions.push(std::make_unique<Action>(Action::AttackCharacterAction{hoveredCharacter->getID()}));
+                                    addLocalAction(std::make_unique<Action>(Action::AttackCharacterAction{hoveredCharacter->getID()}));
                                 else
-                                    localActions.push(std::make_unique<Action>(Action::UseCharacterTargetSkillAction{{targetSelectionSkillNum}, hoveredCharacter->getID()}));
+                                    addLocalAction(std::make_unique<Action>(Action::UseCharacterTargetSkillAction{{targetSelectionSkillNum}, hoveredCharacter->getID()}));
                                 targetSelectionSkillNum = 0;
                             }
                         } else
@@ -319,7 +411,7 @@ GameState::GAME_STATES Game::run() {
                                 c->hover(sf::Color::Green);
                         }
                         if (justClickedLeft and imgui->getLastHotItem() <= 0) {
-                            localActions.push(std::make_unique<Action>(Action::UsePositionTargetSkillAction{{targetSelectionSkillNum},mousePosInMap}));
+                            addLocalAction(std::make_unique<Action>(Action::UsePositionTargetSkillAction{{targetSelectionSkillNum},mousePosInMap}));
                             targetSelectionSkillNum = 0;
                         }
                     } else
@@ -330,7 +422,7 @@ GameState::GAME_STATES Game::run() {
                         if (playerCharacters[playerIndex]->canUseSkill(targetSelectionSkillNum, hoveredCharacter->getID(), FPMVector2())) {
                             hoveredCharacter->hover(sf::Color::Green);
                             if (justClickedLeft and imgui->getLastHotItem() <= 0) {
-                                localActions.push(std::make_unique<Action>(Action::UseCharacterTargetSkillAction{{targetSelectionSkillNum}, hoveredCharacter->getID()}));
+                                addLocalAction(std::make_unique<Action>(Action::UseCharacterTargetSkillAction{{targetSelectionSkillNum}, hoveredCharacter->getID()}));
                                 targetSelectionSkillNum = 0;
                             }
                         } else
@@ -347,7 +439,7 @@ GameState::GAME_STATES Game::run() {
                     else
                         targetSelectionGuidingShape->setFillColor(sf::Color(255, 0, 0, 96));
                     if (justClickedLeft and canUseSkill and imgui->getLastHotItem() <= 0) {
-                        localActions.push(std::make_unique<Action>(Action::UsePositionTargetSkillAction{{targetSelectionSkillNum}, mousePosInMap}));
+                        addLocalAction(std::make_unique<Action>(Action::UsePositionTargetSkillAction{{targetSelectionSkillNum}, mousePosInMap}));
                         targetSelectionSkillNum = 0;
                     }
                 } break;
@@ -359,17 +451,25 @@ GameState::GAME_STATES Game::run() {
     }
 
     /***
-     * Finally, render the game and process GUI interactions.
+     * Finally, render the game and process GUI interactions. The snapshot is taken together with the creeps that died
+     * since the last frame, so that a dying creep is always drawn by one of them.
      */
-    render(elapsedTime);
+    for (auto& c : diedCreeps)
+        deadCreeps.push_back(std::move(c));
+    diedCreeps.clear();
+    auto snapshot = renderSnapshot;
+    worldLock.unlock();
+    render(elapsedTime, *snapshot);
 
     return nextState;
 }
 
-void Game::render(const sf::Time& elapsedTime) {
+void Game::render(const sf::Time& elapsedTime, const RenderSnapshot& snapshot) {
     /***
      * Before the actual rendering, need to update animations (is necessary even if character is not visible at
      * the moment), perform rough culling and update drawing states (if not culled).
+     * Up to the drawing of the world, we only use the snapshot and the render state of the characters, so the
+     * simulation can continue in the meantime.
      * Could alternatively do culling by looping over characterContainer's characterMap, but that will only be
      * faster if we really have a ton of characters on the map
      */
@@ -380,44 +480,45 @@ void Game::render(const sf::Time& elapsedTime) {
                      viewWorld.getSize().y + 2.f * FRUSTUM_TOLERANCE);
     std::list<std::shared_ptr<Character>> charactersToDraw;
     float elapsedSeconds = elapsedTime.asSeconds();
-    for (auto& pc : playerCharacters) {
-        auto prevAnimationStep = static_cast<int>(pc->getAnimationStep());
-        if (pc->updateDrawables(frustum, elapsedSeconds, simulationTimerMS))
-            charactersToDraw.emplace_back(std::dynamic_pointer_cast<Character>(pc));
+    auto timerMS = snapshot.timerMS + static_cast<unsigned int>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - snapshot.publishedAt).count());
+    // Each character only updates its own drawables, so this runs in parallel
+    std::vector<int> prevAnimationSteps(snapshot.characters.size());
+    std::vector<char> visible(snapshot.characters.size());
+    JobSystem::parallelFor(snapshot.characters.size(), UPDATE_DRAWABLES_GRAIN_SIZE, [&](std::size_t begin, std::size_t end) {
+        for (auto i = begin; i < end; i++) {
+            const auto& [c, state] = snapshot.characters[i];
+            prevAnimationSteps[i] = static_cast<int>(c->getAnimationStep());
+            visible[i] = c->updateDrawables(state, frustum, elapsedSeconds, timerMS);
+        }
+    });
+    for (std::size_t i = 0; i < snapshot.characters.size(); i++) {
+        const auto& [c, state] = snapshot.characters[i];
+        if (visible[i])
+            charactersToDraw.emplace_back(c);
         // Show new arrows everytime an Archer player is attacking and restarts the attack animation
-        if (pc->getType() == CHARACTERS::ARCHER and pc->getAnimationState() == ANIMATION_STATE::ATTACK and
-            prevAnimationStep != static_cast<int>(pc->getAnimationStep()) and static_cast<int>(pc->getAnimationStep()) == ARCHER_ATTACK_ANIMATION_SHOOT_STEP
-            and characterContainer->isAlive(pc->getAttackTargetID()))
-            effects.push_back(std::make_shared<Arrow>(tilemap, pc->getMapPosition(), characterContainer->getCharacterByID(pc->getAttackTargetID())->getMapPosition()));
-    }
-    for (auto& c : creeps) {
-        if (c->updateDrawables(frustum, elapsedSeconds, simulationTimerMS))
-            charactersToDraw.emplace_back(std::dynamic_pointer_cast<Character>(c));
-    }
-    for (auto& g : guards) {
-        if (g->updateDrawables(frustum, elapsedSeconds, simulationTimerMS))
-            charactersToDraw.emplace_back(std::dynamic_pointer_cast<Character>(g));
-    }
-    for (auto& a : allies) {
-        if (a->updateDrawables(frustum, elapsedSeconds, simulationTimerMS))
-            charactersToDraw.emplace_back(std::dynamic_pointer_cast<Character>(a));
+        if (i < snapshot.numPlayers and c->getType() == CHARACTERS::ARCHER and state.animationState == ANIMATION_STATE::ATTACK and
+            prevAnimationSteps[i] != static_cast<int>(c->getAnimationStep()) and static_cast<int>(c->getAnimationStep()) == ARCHER_ATTACK_ANIMATION_SHOOT_STEP) {
+            const auto* target = snapshot.find(state.attackTargetID);
+            if (target and target->hpFraction > 0.f)
+                effects.push_back(std::make_shared<Arrow>(tilemap, state.mapPosition, target->mapPosition));
+        }
     }
     // For dead creeps, if their death animation is over, remove them completely
-    deadCreeps.remove_if([this, &elapsedSeconds, &frustum, &charactersToDraw](auto& c){
-        if (c->deathAnimationComplete())
+    deadCreeps.remove_if([&elapsedSeconds, &frustum, &charactersToDraw, timerMS](auto& c){
+        if (c.first->deathAnimationComplete())
             return true;
         else {
-            if (c->updateDrawables(frustum, elapsedSeconds, simulationTimerMS))
-                charactersToDraw.emplace_back(std::dynamic_pointer_cast<Character>(c));
+            if (c.first->updateDrawables(c.second, frustum, elapsedSeconds, timerMS))
+                charactersToDraw.emplace_back(std::dynamic_pointer_cast<Character>(c.first));
             return false;
         }
     });
     std::list<std::shared_ptr<Effect>> effectsToDraw;
-    effects.remove_if([this, &elapsedSeconds, &frustum, &effectsToDraw](auto& e){
+    effects.remove_if([&snapshot, &elapsedSeconds, &frustum, &effectsToDraw](auto& e){
         if (e->effectHasEnded())
             return true;
         else {
-            if (e->update(frustum, elapsedSeconds, simulationStep))
+            if (e->update(frustum, elapsedSeconds, snapshot.simulationStep))
                 effectsToDraw.emplace_back(e);
             return false;
         }
@@ -467,7 +568,11 @@ void Game::render(const sf::Time& elapsedTime) {
 
     /***
      * 2: Draw additional elements in world -> depth testing disabled, but still in viewWorld
+     * These and the GUI show the live game state, so from here on, the world is locked again.
      */
+    std::unique_lock<std::mutex> worldLock(worldMutex);
+    if (hoveredCharacter)
+        hoveredCharacter = characterContainer->isAlive(hoveredCharacterID) ? characterContainer->getCharacterByID(hoveredCharacterID) : nullptr;
     glDisable(GL_DEPTH_TEST);
     glDisable(GL_ALPHA_TEST);
     window->resetGLStates();
@@ -496,6 +601,8 @@ void Game::render(const sf::Time& elapsedTime) {
         for (int x = 0; x < tilemap->getWidth(); x++) {
             for (int y = 0; y < tilemap->getHeight(); y++) {
                 auto tileCenter = FPMVector2(FPMNum(x + 0.5f), FPMNum(y + 0.5f));
+                if (!frustum.contains(tilemap->mapToWorld(tileCenter)))
+                    continue;
                 sf::Text textDraw(std::to_string(characterContainer->getCharactersAt(tileCenter).size()), *defaultFont, 10);
                 textDraw.setPosition(tilemap->mapToWorld(tileCenter));
                 textDraw.setFillColor(sf::Color::White);
@@ -536,7 +643,7 @@ void Game::render(const sf::Time& elapsedTime) {
         }
     }
 
-    imgui->text(10, 650, toStr(playerCharacters[playerIndex]->getName(), " (Level ", playerCharacters[playerIndex]->getLevel(), ")"), 40);
+    imgui->text(10, 650, toStr(playerCharacters[playerIndex]->getName(), " (Level ", playerCharacters[playerIndex]->getLevel(), ")", spectating ? " - spectating" : ""), 40);
 
     float x = 70.f, y = 710.f, w = 200.f, h = 35.f;
     imgui->text(10, y, "HP:", 30);
@@ -570,9 +677,9 @@ void Game::render(const sf::Time& elapsedTime) {
     if (imgui->button(100, 1540, 840, "", &autoAttackTexture, 60, 60, 30, autoAttackEnabled, toStr("Auto attack ", autoAttackEnabled ? "on" : "off", "\nShortcut 0"), toolTipFontSize) or justPressedShortcut[0])
         autoAttackEnabled = !autoAttackEnabled;
     if ((imgui->button(108, 1540, 700, std::to_string(playerCharacters[playerIndex]->getNumHPPotions()), &hpPotionTexture, 60, 60, 30, false, toStr("Health potions: ", playerCharacters[playerIndex]->getNumHPPotions(), "\nHeal ", ITEM_HP_POTION_HP_GAIN, " HP\nShortcut 8"), toolTipFontSize) or justPressedShortcut[8]) and playerCharacters[playerIndex]->canUsePotion(POTIONS::HP))
-        localActions.push(std::make_unique<Action>(Action::UsePotionAction{POTIONS::HP}));
+        addLocalAction(std::make_unique<Action>(Action::UsePotionAction{POTIONS::HP}));
     if ((imgui->button(109, 1540, 770, std::to_string(playerCharacters[playerIndex]->getNumMPPotions()), &mpPotionTexture, 60, 60, 30, false, toStr("Mana potions: ", playerCharacters[playerIndex]->getNumMPPotions(), "\nRegain ", ITEM_MP_POTION_MP_GAIN, " MP\nShortcut 9"), toolTipFontSize) or justPressedShortcut[9]) and playerCharacters[playerIndex]->canUsePotion(POTIONS::MP))
-        localActions.push(std::make_unique<Action>(Action::UsePotionAction{POTIONS::MP}));
+        addLocalAction(std::make_unique<Action>(Action::UsePotionAction{POTIONS::MP}));
 
     // Buttons for skills (different per character type)
     if (targetSelectionSkillNum != 0) {
@@ -593,7 +700,7 @@ void Game::render(const sf::Time& elapsedTime) {
         if (playerCharacters[playerIndex]->getSkillTimerSec(skillSlot) > 0.f)
             imgui->fillBar(1540, 70 * (skillSlot - 1) + 25, playerCharacters[playerIndex]->getSkillTimerSec(skillSlot), playerCharacters[playerIndex]->getSkillCooldownSec(skillSlot), 60, 10, sf::Color::Blue, toolTipFontSize);
         if (playerCharacters[playerIndex]->canUpgradeSkill(skillSlot) and imgui->button(900 + skillSlot, 1510, 70 * (skillSlot - 1) + 15, "+", nullptr, 30, 30, 30, false, getSkillLevelupTooltipText(skill), toolTipFontSize))
-            localActions.push(std::make_unique<Action>(Action::UpgradeSkillAction{skillSlot}));
+            addLocalAction(std::make_unique<Action>(Action::UpgradeSkillAction{skillSlot}));
     }
 
     // Shop
@@ -622,7 +729,7 @@ void Game::render(const sf::Time& elapsedTime) {
                 itemToBuy = item;
         }
         if (itemToBuy != ITEMS::NUM_ITEMS)
-            localActions.push(std::make_unique<Action>(Action::BuyItemAction{itemToBuy}));
+            addLocalAction(std::make_unique<Action>(Action::BuyItemAction{itemToBuy}));
     }
 
     // Draw game outcomes
@@ -635,28 +742,235 @@ void Game::render(const sf::Time& elapsedTime) {
         sprite.setTexture(characterIDBuffer.getTexture());
         window->draw(sprite);
     }
-    if (sf::Keyboard::isKeyPressed(sf::Keyboard::F))  // Only for debugging
+    if (sf::Keyboard::isKeyPressed(sf::Keyboard::F)) {  // Only for debugging
         imgui->text(1400, 10, toStr("Visible characters: ", charactersToDraw.size()), 20);
+        imgui->text(1400, 35, toStr("Simulation step: ", simulationStepAverageMS, " ms avg, ", simulationStepMaxMS, " ms max (", FPM_FRACTION_BITS == 32 ? "32.32" : "16.16", ")"), 20);
+        imgui->text(1400, 60, workerUtilization, 20);
+        float y = 85;
+        for (const auto& line : timingStatsLines) {
+            imgui->text(1400, y, line, 20);
+            y += 25;
+        }
+        for (const auto& line : describeNetworkStats()) {
+            imgui->text(1400, y, line, 20);
+            y += 25;
+        }
+    }
     imgui->finish();
+    worldLock.unlock();
+
+    window->display();
+}
 
+void Game::renderCatchUpProgress(unsigned int step) {
+    // Rendering the world would only slow down the replay
+    window->setView(viewUI);
+    window->clear();
+    imgui->prepare(false, 0);
+    imgui->text(250, 400, toStr("Catching up with the running game: step ", step, " of ", catchUpStep), 40);
+    imgui->finish();
     window->display();
 }
 
+void Game::finishCatchUp() {
+    // Players who joined late only got their character during the replay
+    playerIndex = 0;
+    if (!spectating) {
+        auto player = std::find_if(playerCharacters.begin(), playerCharacters.end(), [this](const auto& p) { return p->getName() == catchUpPlayerName; });
+        if (player == playerCharacters.end())
+            throw std::runtime_error("Own character not found after catching up with the game");
+        playerIndex = std::distance(playerCharacters.begin(), player);
+    }
+    viewWorld.setCenter(tilemap->mapToWorld(playerCharacters[playerIndex]->getMapPosition()));
+    clearQueue(localActions);
+    catchUpStep = 0;
+    // No snapshots are published while replaying
+    if (!headless)
+        publishRenderSnapshot();
+    std::cout << "Caught up with the game at step " << simulationStep << std::endl;
+}
+
+void Game::saveCheckpoint(sf::Packet& packet) const {
+    writeVarUint(packet, simulationStep);
+    writeVarUint(packet, gen.getSeed());
+    writeVarUint(packet, gen.getNumDrawn());
+    writeVarInt(packet, maxLives);
+    writeVarInt(packet, lives);
+    writeVarUint(packet, newCreepIDCounter);
+    packet << static_cast<sf::Uint8>(outcome);
+    writeVarUint(packet, inputDelaySteps);
+    // The characters are written in the order in which they are simulated
+    writeVarUint(packet, playerCharacters.size());
+    for (const auto& p : playerCharacters) {
+        packet << p->getName() << static_cast<sf::Uint8>(p->getType());
+        p->saveState(packet);
+    }
+    writeVarUint(packet, guards.size());
+    for (const auto& g : guards) {
+        writeVarUint(packet, g->getID());
+        g->saveState(packet);
+    }
+    writeVarUint(packet, creeps.size());
+    for (const auto& c : creeps) {
+        writeVarUint(packet, c->getID());
+        c->saveState(packet);
+    }
+    writeVarUint(packet, allies.size());
+    for (const auto& a : allies) {
+        writeVarUint(packet, a->getID());
+        packet << static_cast<sf::Uint8>(a->getType());
+        a->saveState(packet);
+    }
+}
+
+void Game::loadCheckpoint(sf::Packet& packet) {
+    simulationStep = static_cast<unsigned int>(readVarUint(packet));
+    auto seed = static_cast<RandomGenerator::result_type>(readVarUint(packet));
+    gen.restore(seed, readVarUint(packet));
+    maxLives = static_cast<sf::Int32>(readVarInt(packet));
+    lives = static_cast<sf::Int32>(readVarInt(packet));
+    newCreepIDCounter = static_cast<sf::Uint32>(readVarUint(packet));
+    sf::Uint8 outcomeNum;
+    if (!(packet >> outcomeNum) or outcomeNum > static_cast<sf::Uint8>(GAME_OUTCOME::LOST))
+        throw std::runtime_error("Invalid checkpoint");
+    outcome = static_cast<GAME_OUTCOME>(outcomeNum);
+    inputDelaySteps = static_cast<unsigned int>(readVarUint(packet));
+
+    // All characters are created anew, in a new container. The constructors' values are then overwritten by the
+    // checkpoint, so their arguments only have to be valid
+    playerCharacters.clear();
+    guards.clear();
+    creeps.clear();
+    allies.clear();
+    diedCreeps.clear();
+    deadCreeps.clear();
+    effects.clear();
+    hoveredCharacter = nullptr;
+    characterContainer = std::make_shared<CharacterContainer>(tilemap);
+    // Each character takes dozens of bytes, which bounds the counts by the size of the checkpoint
+    auto readCount = [&packet](std::size_t max) {
+        auto count = readVarUint(packet);
+        if (count > max)
+            throw std::runtime_error("Invalid checkpoint");
+        return static_cast<std::size_t>(count);
+    };
+    auto readCreepID = [this, &packet]() {
+        auto ID = static_cast<sf::Uint32>(readVarUint(packet));
+        if (ID < MAX_NUM_PLAYERS or ID >= newCreepIDCounter)
+            throw std::runtime_error("Invalid checkpoint");
+        return ID;
+    };
+    auto numPlayers = readCount(MAX_NUM_PLAYERS);
+    for (std::size_t i = 0; i < numPlayers; i++) {
+        std::string name;
+        sf::Uint8 type;
+        if (!(packet >> name >> type))
+            throw std::runtime_error("Invalid checkpoint");
+        auto ID = static_cast<sf::Uint32>(i);
+        playerCharacters.emplace_back(std::make_shared<Player>(ID, static_cast<CHARACTERS>(type), tilemap->getPlayerSpawnPositions()[ID], tilemap, characterContainer, 0, name, defaultFont));
+        playerCharacters.back()->loadState(packet);
+    }
+    auto numGuards = readCount(tilemap->getCreepSpawnZones().size());
+    for (std::size_t i = 0; i < numGuards; i++) {
+        guards.emplace_back(std::make_shared<Guard>(readCreepID(), CHARACTERS::SHEEP, FPMVector2(), tilemap, characterContainer, 0));
+        guards.back()->loadState(packet);
+    }
+    auto numCreeps = readCount(packet.getDataSize());
+    for (std::size_t i = 0; i < numCreeps; i++) {
+        creeps.emplace_back(std::make_shared<Creep>(readCreepID(), 1, FPMVector2(), tilemap, characterContainer, 0));
+        creeps.back()->loadState(packet);
+    }
+    auto numAllies = readCount(packet.getDataSize());
+    for (std::size_t i = 0; i < numAllies; i++) {
+        auto ID = readCreepID();
+        sf::Uint8 type;
+        if (!(packet >> type) or type >= static_cast<sf::Uint8>(CHARACTERS::CHARACTERS_COUNT))
+            throw std::runtime_error("Invalid checkpoint");
+        allies.emplace_back(std::make_shared<Ally>(ID, static_cast<CHARACTERS>(type), FPMVector2(), tilemap, characterContainer, 0, FPMNum(1)));
+        allies.back()->loadState(packet);
+    }
+    if (!packet.endOfPacket())
+        throw std::runtime_error("Unexpected trailing data in checkpoint");
+
+    // Continue with the step after the checkpoint, as if it had just been executed on time
+    eventsToSimulate.clear();
+    latestSimulationStepAvailable = simulationStep;
+    simulationTimer = sf::Time::Zero;
+    simulationPaceMS = static_cast<double>(simulationStep) * SIMULATION_TIME_STEP_MS + SIMULATION_TIME_STEP_MS / 3;
+    autoAttackCheckedStep = simulationStep;
+}
+
+void Game::addLocalAction(std::unique_ptr<Action> action) {
+    action->trace.takenUS = localClock.getElapsedTime().asMicroseconds();
+    localActions.push(std::move(action));
+}
+
 void Game::simulate(const sf::Time& elapsedTime) {
-    // Simulate the game for one step IFF enough time has passed since the last simulation step AND we have a new simulation step ready in eventsToSimulate
-    simulationTimerMS += elapsedTime.asMilliseconds();
-    bool simulationStepOverdue = simulationTimerMS > SIMULATION_TIME_STEP_MS;
-    while ((latestSimulationStepAvailable > simulationStep + 1) or // we're lagging behind!
-           (simulationStepOverdue and latestSimulationStepAvailable > simulationStep)) {
-        simulationTimerMS = 0;
+    // Simulate the game for one step IFF enough time has passed since the last simulation step AND we have a new simulation step ready in eventsToSimulate.
+    // The steps are paced by simulationPaceMS, on which step s is due at stepDueMS(s). With the host's clock, the pace
+    // follows that clock, so neither rounding nor a clock running slightly faster or slower than the host's adds up over
+    // time. Otherwise, it follows the time passed locally since the last step.
+    simulationTimer += elapsedTime;
+    unsigned int stepsSimulated = 0;
+    auto scheduleTimeMS = getScheduleTimeMS();
+    auto stepDueMS = [](unsigned int step) { return static_cast<double>(step) * SIMULATION_TIME_STEP_MS + SIMULATION_TIME_STEP_MS / 3; };
+    auto elapsedMS = elapsedTime.asMicroseconds() / 1000.0;
+    // How many steps we are behind: on the host's clock, or by the steps buffered beyond the input delay
+    double targetMS = stepDueMS(simulationStep) + simulationTimer.asMicroseconds() / 1000.0;
+    double backlogSteps = 0;
+    if (scheduleTimeMS) {
+        targetMS = *scheduleTimeMS;
+        backlogSteps = (targetMS - simulationPaceMS) / SIMULATION_TIME_STEP_MS;
+    } else if (latestSimulationStepAvailable > simulationStep + inputDelaySteps) {
+        targetMS = std::numeric_limits<double>::infinity();
+        backlogSteps = latestSimulationStepAvailable - simulationStep - inputDelaySteps;
+    }
+    // A small backlog (e.g., after a network hiccup) is made up by running slightly faster until the pace has caught up
+    // with the target. It never runs backwards, e.g., when the host's clock becomes known
+    simulationPaceMS = std::max(simulationPaceMS, std::min(targetMS, simulationPaceMS + elapsedMS * CATCH_UP_SPEED_PERCENT / 100));
+    // Replaying the game's past (see catchUpStep) or a large backlog runs as many steps as the frame budget allows. But
+    // only up to the last step that is already due: on the host's clock if it is known, otherwise the steps beyond the
+    // input delay. The host sends steps ahead of their time, and running those early would only make us stall afterwards
+    bool fastForward = (catchUpStep != 0 and simulationStep < catchUpStep) or backlogSteps > CATCH_UP_MAX_BACKLOG_STEPS;
+    auto lastDueStep = simulationStep;
+    if (scheduleTimeMS)
+        lastDueStep = std::max(lastDueStep, static_cast<unsigned int>(std::max(0.0, (*scheduleTimeMS - SIMULATION_TIME_STEP_MS / 3) / SIMULATION_TIME_STEP_MS)));
+    else if (latestSimulationStepAvailable > simulationStep + inputDelaySteps)
+        lastDueStep = latestSimulationStepAvailable - inputDelaySteps;
+    if (catchUpStep != 0)
+        lastDueStep = std::max(lastDueStep, catchUpStep);
+    auto budget = sf::milliseconds(catchUpStep != 0 ? CATCH_UP_REPLAY_BUDGET_MS : CATCH_UP_FRAME_BUDGET_MS);
+    sf::Clock budgetClock;
+    while (latestSimulationStepAvailable > simulationStep and ((fastForward and simulationStep < lastDueStep) or simulationPaceMS >= stepDueMS(simulationStep + 1))) {
+        // At least one step per frame, so a step that takes longer than the budget still gets executed
+        if (stepsSimulated > 0 and budgetClock.getElapsedTime() >= budget)
+            break;
+        simulationTimer = sf::Time::Zero;
         simulationStep += 1;
+        stepsSimulated++;
+        simulationPaceMS = std::max(simulationPaceMS, stepDueMS(simulationStep));
+        sf::Clock simulationStepClock;
+        if (recordStepStalls)
+            stepStallsMS.push_back(stallMS);
+        if (stallMS > 0) {
+            numStalls++;
+            stallTimeSumMS += stallMS;
+            stallTimeMaxMS = std::max(stallTimeMaxMS, stallMS);
+            stallMS = 0;
+        }
 
         /***
          * Execute all events we received for this step
          */
         while (!eventsToSimulate.empty() and eventsToSimulate.front()->simulationStep <= simulationStep) {
             assert(eventsToSimulate.front()->simulationStep >= simulationStep); // Earlier steps should be processed by now
-            if (const auto* eventData = std::get_if<Event::PlayerActionEvent>(&eventsToSimulate.front()->data)) {
+            const auto* eventData = std::get_if<Event::PlayerActionEvent>(&eventsToSimulate.front()->data);
+            // Actions replayed while catching up were sent in an earlier session, so they are not traced
+            if (eventData and eventData->action.trace.sequence != 0 and eventData->characterID == playerIndex and !spectating and catchUpStep == 0)
+                latencyTrace.actionExecuted(eventData->action.trace, localClock.getElapsedTime().asMicroseconds(), [this](sf::Int64 t) { return toHostTimeUS(t); });
+            // The server creates events without looking at the game state, so actions of dead players and of players
+            // who joined after the action was sent are dropped here
+            if (eventData and eventData->characterID < playerCharacters.size() and !playerCharacters[eventData->characterID]->isDead()) {
                 if (const auto* data = std::get_if<Action::MovementKeysChangedAction>(&eventData->action.data))
                     playerCharacters[eventData->characterID]->movementKeysChanged(data->keyStates);
                 if (const auto* data = std::get_if<Action::AttackCharacterAction>(&eventData->action.data))
@@ -679,6 +993,14 @@ void Game::simulate(const sf::Time& elapsedTime) {
                 if (const auto* data = std::get_if<Action::UpgradeSkillAction>(&eventData->action.data))
                     playerCharacters[eventData->characterID]->upgradeSkill(data->skillNum);
             }                
+            if (const auto* eventData = std::get_if<Event::InputDelayChangedEvent>(&eventsToSimulate.front()->data))
+                inputDelaySteps = eventData->steps;
+            if (const auto* eventData = std::get_if<Event::PlayerJoinedEvent>(&eventsToSimulate.front()->data)) {
+                if (playerCharacters.size() < MAX_NUM_PLAYERS) {
+                    auto ID = static_cast<sf::Uint32>(playerCharacters.size());
+                    playerCharacters.emplace_back(std::make_shared<Player>(ID, eventData->characterType, tilemap->getPlayerSpawnPositions()[ID], tilemap, characterContainer, gen(), eventData->name, defaultFont));
+                }
+            }
             eventsToSimulate.pop_front();
         }
 
@@ -697,9 +1019,23 @@ void Game::simulate(const sf::Time& elapsedTime) {
          */
         for (auto& pc : playerCharacters)
             pc->simulate();
+        // Each creep sees the creeps before it in their new positions, so the creeps are simulated one after another.
+        // Only the parts of their movement that do not depend on the others are computed in parallel beforehand
+        std::vector<Creep*> creepsToPlan;
+        creepsToPlan.reserve(creeps.size());
+        for (auto& c : creeps) {
+            if (!c->isDead())
+                creepsToPlan.push_back(c.get());
+        }
+        JobSystem::parallelFor(creepsToPlan.size(), CREEP_PLANNING_GRAIN_SIZE, [&creepsToPlan](std::size_t begin, std::size_t end) {
+            for (auto i = begin; i < end; i++)
+                creepsToPlan[i]->planMovement();
+        });
         creeps.remove_if([this](auto& c){
             if (c->isDead()) {
-                deadCreeps.push_back(c);
+                // Kept for the death animation, which the dedicated server and the replay do not render
+                if (!headless and catchUpStep == 0)
+                    diedCreeps.emplace_back(c, c->getRenderState());
                 return true;
             }
             c->simulate();
@@ -726,7 +1062,132 @@ void Game::simulate(const sf::Time& elapsedTime) {
         }
         if (outcome == GAME_OUTCOME::STILL_PLAYING and guards.size() == 3 and guards[0]->isDead() and guards[1]->isDead() and guards[2]->isDead())
             outcome = GAME_OUTCOME::WON;
+
+        if (createCheckpoints and simulationStep % CHECKPOINT_INTERVAL_STEPS == 0) {
+            sf::Packet packet;
+            saveCheckpoint(packet);
+            auto data = static_cast<const char*>(packet.getData());
+            newCheckpoint = std::make_shared<Checkpoint>(Checkpoint{simulationStep, std::vector<char>(data, data + packet.getDataSize())});
+        }
+
+        auto stepTime = simulationStepClock.getElapsedTime();
+        simulationTimingSum += stepTime;
+        simulationTimingMax = std::max(simulationTimingMax, stepTime);
+        if (++simulationTimingNumSteps == SIMULATION_TIMING_WINDOW_STEPS) {
+            simulationStepAverageMS = simulationTimingSum.asSeconds() * 1000 / SIMULATION_TIMING_WINDOW_STEPS;
+            simulationStepMaxMS = simulationTimingMax.asSeconds() * 1000;
+            simulationTimingSum = sf::Time::Zero;
+            simulationTimingMax = sf::Time::Zero;
+            simulationTimingNumSteps = 0;
+        }
+    }
+    // Until the next step has been executed, the pace waits at its due time, so the time lost by a stall or the budget is
+    // made up for step by step instead of all at once
+    simulationPaceMS = std::min(simulationPaceMS, stepDueMS(simulationStep + 1));
+    // The time since the current step was due, which the rendering interpolates with
+    simulationTimerMS = static_cast<unsigned int>(std::max(0.0, simulationPaceMS - stepDueMS(simulationStep)));
+    // If the next step is overdue but its events have not arrived, it stalls
+    stallMS = 0;
+    if (latestSimulationStepAvailable == simulationStep and targetMS > stepDueMS(simulationStep + 1))
+        stallMS = static_cast<unsigned int>(targetMS - stepDueMS(simulationStep + 1));
+    if (stepsSimulated > 0 and !headless and catchUpStep == 0)
+        publishRenderSnapshot();
+}
+
+void Game::runSimulationThread() {
+    try {
+        sf::Clock clock;
+        while (!stopSimulation) {
+            {
+                std::lock_guard<std::mutex> lock(worldMutex);
+                simulate(clock.restart());
+            }
+            // The steps are due every SIMULATION_TIME_STEP_MS, so we do not need to check more often than this
+            std::this_thread::sleep_for(std::chrono::milliseconds(SIMULATION_THREAD_TICK_MS));
+        }
+    } catch (...) {
+        simulationError = std::current_exception();
+        simulationFailed = true;
+    }
+}
+
+void Game::stopSimulationThread() {
+    if (simulationThread.joinable()) {
+        stopSimulation = true;
+        simulationThread.join();
+    }
+}
+
+void Game::publishRenderSnapshot() {
+    auto snapshot = std::make_shared<RenderSnapshot>();
+    snapshot->simulationStep = simulationStep;
+    snapshot->timerMS = simulationTimerMS;
+    snapshot->publishedAt = std::chrono::steady_clock::now();
+    snapshot->characters.reserve(playerCharacters.size() + creeps.size() + guards.size() + allies.size());
+    auto add = [&snapshot](const std::shared_ptr<Character>& c) {
+        snapshot->indexByID[c->getID()] = snapshot->characters.size();
+        snapshot->characters.emplace_back(c, c->getRenderState());
+    };
+    for (auto& pc : playerCharacters)
+        add(pc);
+    snapshot->numPlayers = snapshot->characters.size();
+    for (auto& c : creeps)
+        add(c);
+    for (auto& g : guards)
+        add(g);
+    for (auto& a : allies)
+        add(a);
+    renderSnapshot = std::move(snapshot);
+}
+
+GameState::GAME_STATES Game::runHeadless() {
+    auto elapsedTime = deltaClock.restart();
+    network();
+    simulate(elapsedTime);
+    updateNetworkStats(elapsedTime);
+
+    // Sleep until the next tick. If we fell behind (e.g., after a slow simulation step), continue from now instead of
+    // running the missed ticks back to back
+    nextHeadlessTick += std::chrono::milliseconds(DEDICATED_SERVER_TICK_MS);
+    auto now = std::chrono::steady_clock::now();
+    if (nextHeadlessTick < now)
+        nextHeadlessTick = now;
+    else
+        std::this_thread::sleep_until(nextHeadlessTick);
+    return nextState;
+}
+
+void Game::updateNetworkStats(const sf::Time& elapsedTime) {
+    frameTimingSum += elapsedTime;
+    frameTimingMax = std::max(frameTimingMax, elapsedTime);
+    frameTimingNumFrames++;
+    minStepsBuffered = std::min(minStepsBuffered, latestSimulationStepAvailable - simulationStep);
+    if (networkStatsClock.getElapsedTime().asMilliseconds() < NETWORK_STATS_INTERVAL_MS)
+        return;
+
+    timingStatsLines.clear();
+    timingStatsLines.push_back(toStr("Frame: ", frameTimingSum.asSeconds() * 1000 / frameTimingNumFrames, " ms avg, ", frameTimingMax.asSeconds() * 1000, " ms max"));
+    timingStatsLines.push_back(toStr("Steps buffered: ", latestSimulationStepAvailable - simulationStep, " now, ", minStepsBuffered, " min (input delay ", inputDelaySteps, ")"));
+    timingStatsLines.push_back(toStr("Stalls: ", numStalls, ", ", stallTimeSumMS, " ms total, ", stallTimeMaxMS, " ms max",
+                                     stallMS > 0 ? toStr(", stalled for ", stallMS, " ms") : ""));
+    for (auto& line : latencyTrace.describe())
+        timingStatsLines.push_back(std::move(line));
+    if (logNetworkStats) {
+        std::cout << "Step " << simulationStep << ": simulation step " << simulationStepAverageMS << " ms avg, " << simulationStepMaxMS << " ms max" << std::endl;
+        for (const auto& line : timingStatsLines)
+            std::cout << "  " << line << std::endl;
+        for (const auto& line : describeNetworkStats())
+            std::cout << "  " << line << std::endl;
     }
+
+    networkStatsClock.restart();
+    frameTimingSum = sf::Time::Zero;
+    frameTimingMax = sf::Time::Zero;
+    frameTimingNumFrames = 0;
+    numStalls = 0;
+    stallTimeSumMS = 0;
+    stallTimeMaxMS = 0;
+    minStepsBuffered = std::numeric_limits<unsigned int>::max();
 }
 
 void Game::spawnCreep(int spawnPointIndex) {
@@ -3,6 +3,10 @@
 #include <queue>
 #include <random>
 #include <optional>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <atomic>
 #include "GameState.h"
 #include "SFML/Graphics.hpp"
 #include "SFML/Graphics/RenderTexture.hpp"
@@ -17,11 +21,23 @@
 #include "../GameObjects/Skills.h"
 #include "../NetworkEvents/Action.h"
 #include "../NetworkEvents/Event.h"
+#include "../NetworkEvents/LatencyTrace.h"
 #include "../Render/MapCircleShape.h"
+#include "../Render/RenderSnapshot.h"
 
 struct GameStartData {
     sf::Uint32 randomSeed;
     std::vector<std::pair<std::string, CHARACTERS>> playersList;
+    bool spectating = false;
+    // See Game::catchUpStep. The local player is then found by name once the game has caught up
+    sf::Uint32 catchUpStep = 0;
+    std::string playerName;
+};
+
+// The complete simulation state after a step, see Game::saveCheckpoint
+struct Checkpoint {
+    sf::Uint32 step;
+    std::vector<char> data;
 };
 
 /***
@@ -31,20 +47,84 @@ struct GameStartData {
  * run() handles user input, window resizing etc.
  * network() is implemented by the subclasses and is different for server and client.
  * simulate(...) executes the next simulation step once enough time has passed and the necessary events have been received.
+ * If the host's clock is known (getScheduleTimeMS), step s is due a third of a step after s * SIMULATION_TIME_STEP_MS
+ * on that clock. So all peers execute the steps at the same pace, instead of each adding up its own frame times.
+ * A peer that has fallen behind (e.g., after a network hiccup) runs slightly faster until it has caught up, and spends
+ * at most CATCH_UP_FRAME_BUDGET_MS at a time on the simulation, so rendering and input do not freeze in the meantime.
  * render(...) handles rendering and UI
+ *
+ * With a window, simulate(...) runs on its own thread (runSimulationThread), so a slow step does not delay the frame
+ * and a slow frame does not delay the steps. worldMutex guards the game state, which run() locks for network(), the
+ * input handling and the UI that needs the live state (HUD, tooltips, skill target checks). After each step, the
+ * simulation publishes a RenderSnapshot, from which render(...) updates and draws the characters without the lock.
+ *
+ * On the dedicated server (GameState::headless), there is no window and no local player. run() then only calls
+ * network() and simulate(...), paced by a steady clock in ticks of DEDICATED_SERVER_TICK_MS instead of VSync.
+ *
+ * A client that joins a running game (or reconnects) gets the latest checkpoint of the host's simulation state
+ * (saveCheckpoint, every CHECKPOINT_INTERVAL_STEPS steps) and replays the steps since then until it reaches catchUpStep.
+ * In the meantime, run() only shows the progress.
  */
 class Game : public GameState {
 public:
+    ~Game() override;
+
     GAME_STATES run() override;
 
     void start(std::shared_ptr<void> data) override;
 
     std::shared_ptr<void> end() override;
 
+    // If not empty, this map is loaded instead of the default one (set with the --map command line option)
+    static std::string mapFilenameOverride;
+    // The map file this peer plays on: mapFilenameOverride if set, else the cooked map if it exists, else the Tiled file
+    static std::string getMapFilename();
+    // If true, game traffic is additionally sent over UDP (set with the --udp command line option). Only used if both server and client enable it
+    static bool udpEnabled;
+    // If not 0, the host always schedules events this many steps ahead instead of adapting the delay (set with the --input-delay command line option)
+    static unsigned int inputDelayOverride;
+    // If true, the network statistics are printed to std::cout every NETWORK_STATS_INTERVAL_MS (set with the --net-stats command line option)
+    static bool logNetworkStats;
+    // If true, the stall before each simulation step is recorded in stepStallsMS (for the soak test, see NetworkSoak.h)
+    static bool recordStepStalls;
+    // If true, the host sends along with each action event when it received the action, so that the players can trace
+    // their input latency (see LatencyTrace.h; set with the --trace-latency command line option)
+    static bool traceLatency;
+
+    const std::vector<unsigned int>& getStepStallsMS() const { return stepStallsMS; }
+    std::vector<std::string> describeInputLatency() const { return latencyTrace.describe(); }
+    // Queue an action of the local player, stamped with the time it was taken. Also used for actions that do not come
+    // from the local user's input, e.g. the bots of the soak test
+    void addLocalAction(std::unique_ptr<Action> action);
+
 protected:
     virtual void network() = 0;
+    // The host's clock in ms (see GameServer), or nothing if it is not known yet. Then simulate paces the steps by the
+    // time passed locally instead
+    virtual std::optional<double> getScheduleTimeMS() const { return std::nullopt; }
+    // The time of the host's clock in µs at the given time of localClock, or nothing if it is not known yet
+    virtual std::optional<sf::Int64> toHostTimeUS(sf::Int64 localTimeUS) const { return std::nullopt; }
+    GAME_STATES runHeadless();
+    // One line per connection (rates, queues, round trip times) for the network statistics, see updateNetworkStats
+    virtual std::vector<std::string> describeNetworkStats() const = 0;
+    // Aggregates frame times, stalls and buffered steps over NETWORK_STATS_INTERVAL_MS, to tell apart whether a laggy game
+    // is caused by the frame rate, the network or the simulation
+    void updateNetworkStats(const sf::Time& elapsedTime);
     void simulate(const sf::Time& elapsedTime);
-    void render(const sf::Time& elapsedTime);
+    // Not on the dedicated server, see the class description. Must be stopped before anything it uses is destroyed
+    void runSimulationThread();
+    void stopSimulationThread();
+    void publishRenderSnapshot();
+    // The snapshot must have been taken together with the dead creeps, i.e., under the same lock of worldMutex
+    void render(const sf::Time& elapsedTime, const RenderSnapshot& snapshot);
+    void renderCatchUpProgress(unsigned int step);
+    void finishCatchUp();
+    // Write the simulation state after simulationStep: the global state, the random generators and all characters.
+    // Together with the events of the following steps, this is all a client needs to join the game
+    void saveCheckpoint(sf::Packet& packet) const;
+    // Replace the simulation state by a checkpoint. The events received so far are dropped, the next ones must be for
+    // the step after the checkpoint. Throws std::runtime_error on malformed data
+    void loadCheckpoint(sf::Packet& packet);
 
     void spawnCreep(int spawnPointIndex);
 
@@ -64,11 +144,21 @@ protected:
     std::vector<std::shared_ptr<Player>> playerCharacters;
     // ID of the local player. Can be used as index to playerCharacters. For the server, the ID is always 0.
     unsigned int playerIndex;
+    // True if the local user only watches the game. Spectators have no character of their own, so the view follows
+    // player 0 and no actions are taken (see GameClient)
+    bool spectating;
+    // Non-zero while replaying the steps that had passed before joining the game, see GameStartData
+    sf::Uint32 catchUpStep;
+    std::string catchUpPlayerName;
+    // Only on the host: simulate saves a checkpoint every CHECKPOINT_INTERVAL_STEPS steps into newCheckpoint, which
+    // GameServer then takes from there
+    bool createCheckpoints = false;
+    std::shared_ptr<const Checkpoint> newCheckpoint;
     std::list<std::shared_ptr<Creep>> creeps;
     std::vector<std::shared_ptr<Guard>> guards;
     std::list<std::shared_ptr<Ally>> allies;
     // Random generator which is initialized with the seed that gets distributed over the network at the game's start
-    std::mt19937 gen;
+    RandomGenerator gen;
 
     //////////////////////////////////////
     // Some variables related to global game state. Note that more of the game state is encoded in the Player and Creep classes.
@@ -85,6 +175,8 @@ protected:
     // Some variables related to rendering
     //////////////////////////////////////
     sf::Clock deltaClock;
+    // Only on the dedicated server: when the next tick is due
+    std::chrono::steady_clock::time_point nextHeadlessTick;
     // targetSelectionSkillNum != 0 if the player is currently choosing the target for a skill they want to use
     unsigned int targetSelectionSkillNum;
     // Some skills have AoE, which is indicated by this shape
@@ -99,10 +191,16 @@ protected:
     bool autoAttackEnabled;
     // The current state of the WASD keys
     std::array<bool, 4> movementKeyStates;
-    // hoveredCharacter != nullptr if the player is currently hovering a character with the mouse
+    // hoveredCharacter != nullptr if the player is currently hovering a character with the mouse. Only valid while
+    // worldMutex is held, so it is looked up again by hoveredCharacterID after locking
     Character* hoveredCharacter;
-    // Dead creeps no longer interact with the game logic but are kept around in this list until their death animation has completed
-    std::list<std::shared_ptr<Creep>> deadCreeps;
+    sf::Uint32 hoveredCharacterID;
+    // The last step for which auto-attack has been checked
+    unsigned int autoAttackCheckedStep;
+    // Dead creeps no longer interact with the game logic but are kept around in this list until their death animation has completed.
+    // The simulation hands them over in diedCreeps (guarded by worldMutex), together with their state when they died
+    std::list<std::pair<std::shared_ptr<Creep>, CharacterRenderState>> deadCreeps;
+    std::vector<std::pair<std::shared_ptr<Creep>, CharacterRenderState>> diedCreeps;
     // Effects (like flying arrows) do not interact with the game logic and are purely cosmetic. Objects are removed from this list once the effect has completed
     std::list<std::shared_ptr<Effect>> effects;
     // Textures for skill- and shop-buttons
@@ -115,12 +213,59 @@ protected:
 
     // If the player makes an interaction, this gets added to the localActions queue. This queue is constantly being drained by sending actions to the server.
     std::queue<std::unique_ptr<Action>> localActions;
-    // Once the events for the next simulation step have been determined, the server sends them to all clients and they are collected in the eventsToSimulate list. This gets processed by Game::simulate(...)
+    // Local time for timestamps that are compared with the host's clock (see ClockSync.h and LatencyTrace.h)
+    sf::Clock localClock;
+    // Input latency of the local player's actions
+    LatencyTrace latencyTrace;
+    // Once the events for the next simulation step have been determined, the server sends them to all clients (in an EventBatch) and they are collected in the eventsToSimulate list. This gets processed by Game::simulate(...)
     std::list<std::unique_ptr<Event>> eventsToSimulate; // Conceptually, should be queue; but list has efficient .splice()
     // The last simulation step that has been executed
     unsigned int simulationStep;
-    // Once enough time has passed in this timer, the next simulation step may be executed (provided all necessary events for it have been received)
+    // Time since the current simulation step was due on simulationPaceMS, which the rendering interpolates with
     unsigned int simulationTimerMS;
-    // The latest simulation step for which we have received a NoMoreEvents event, i.e., this step is ready to be executed in the simulation
+    // Once this has reached the due time of the next simulation step (see simulate), the step may be executed (provided
+    // all necessary events for it have been received). Follows the host's clock, or simulationTimer without it
+    double simulationPaceMS;
+    // Time passed locally since the last simulation step was executed, at sub-millisecond precision
+    sf::Time simulationTimer;
+    // The latest simulation step for which we have received all events (i.e., the lastStep of the latest EventBatch), so this step is ready to be executed in the simulation
     unsigned int latestSimulationStepAvailable;
+    // How many steps ahead of simulationStep the server schedules events, as published in the latest InputDelayChangedEvent.
+    // Up to this many steps may be buffered in eventsToSimulate before the simulation considers itself to lag behind
+    unsigned int inputDelaySteps;
+    // Only for debugging: Wall-clock time spent in simulation steps. Summed up over SIMULATION_TIMING_WINDOW_STEPS steps, then average and maximum are shown in the F overlay
+    sf::Time simulationTimingSum;
+    sf::Time simulationTimingMax;
+    unsigned int simulationTimingNumSteps;
+    float simulationStepAverageMS;
+    float simulationStepMaxMS;
+    // Only for debugging: Accumulated over the current interval of updateNetworkStats. A stall is when the next step is
+    // overdue but its events have not arrived yet; stallMS is how long the current one has lasted
+    sf::Clock networkStatsClock;
+    sf::Time frameTimingSum;
+    sf::Time frameTimingMax;
+    unsigned int frameTimingNumFrames;
+    unsigned int stallMS;
+    unsigned int numStalls;
+    unsigned int stallTimeSumMS;
+    unsigned int stallTimeMaxMS;
+    unsigned int minStepsBuffered;
+    // Summary of the last complete interval, shown in the F overlay
+    std::vector<std::string> timingStatsLines;
+    // How busy the job system's workers were in the last frame, shown in the F overlay
+    std::string workerUtilization;
+    // Only if recordStepStalls: for each executed simulation step, how long it was overdue in ms (mostly 0)
+    std::vector<unsigned int> stepStallsMS;
+
+    //////////////////////////////////////
+    // Simulation thread, see the class description
+    //////////////////////////////////////
+    std::mutex worldMutex;
+    std::thread simulationThread;
+    std::atomic<bool> stopSimulation{false};
+    // Set by the simulation thread. simulationError is only written before simulationFailed is set
+    std::atomic<bool> simulationFailed{false};
+    std::exception_ptr simulationError;
+    // The latest published snapshot. Only the pointer is guarded by worldMutex, the snapshot itself is immutable
+    std::shared_ptr<const RenderSnapshot> renderSnapshot;
 };
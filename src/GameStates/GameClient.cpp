@@ -1,54 +1,163 @@
 #include <iostream>
 #include "GameClient.h"
+#include "../NetworkEvents/GamePacketTypes.h"
+#include "../NetworkEvents/WireFormat.h"
+
+GameClient::~GameClient() {
+    // The simulation thread uses getScheduleTimeMS, which needs our members
+    stopSimulationThread();
+}
 
 void GameClient::start(std::shared_ptr<void> data) {
     auto startData = std::static_pointer_cast<GameClientStartData>(data);
-    this->socket = std::move(startData->socket);
+    this->connection = std::move(startData->connection);
     this->hostIP = startData->hostIP;
 
-    playerIndex = std::distance(startData->playersList.begin(),
-                                std::find_if(startData->playersList.begin(), startData->playersList.end(),
-                                             [&startData](auto a) {return a.first == startData->playerName;}));
+    // Spectators are not in the players list and follow the first player instead. When joining a running game, the own
+    // character may not exist yet, so Game::finishCatchUp looks it up later
+    if (startData->spectate or startData->catchUpStep != 0)
+        playerIndex = 0;
+    else
+        playerIndex = std::distance(startData->playersList.begin(),
+                                    std::find_if(startData->playersList.begin(), startData->playersList.end(),
+                                                 [&startData](auto a) {return a.first == startData->playerName;}));
 
     nextState = GAME_STATES::GameClient;
     sendPacket.clear();
     receivePacket.clear();
     isSending = false;
+    nextTcpActionSequence = 1;
+    tcpAckedStep = 0;
+
+    this->serverUdpPort = startData->serverUdpPort;
+    clearQueue(tcpActions);
+    unackedActions.clear();
+    nextActionSequence = 1;
+    datagramDue = false;
+    timeRequestClock.restart();
+    timeRequestOutstanding = false;
+    clockSync.clear();
+    sentReady = false;
+    matchStartServerUS = -1;
+    checkpointData.clear();
+    checkpointStep = 0;
+    udpSocket = nullptr;
+    // The server only sends to spectators over TCP
+    if (Game::udpEnabled and serverUdpPort != 0 and !startData->spectate) {
+        udpSocket = std::make_unique<sf::UdpSocket>();
+        if (udpSocket->bind(sf::Socket::AnyPort) == sf::Socket::Done) {
+            udpSocket->setBlocking(false);
+            // Tell the server our UDP endpoint right away
+            datagramDue = true;
+        } else {
+            std::cout << "Could not bind UDP socket, using TCP only" << std::endl;
+            udpSocket = nullptr;
+        }
+    } else if (Game::udpEnabled and serverUdpPort == 0) {
+        std::cout << "Server does not support UDP, using TCP only" << std::endl;
+    }
 
     auto gameStartData = std::make_shared<GameStartData>();
     gameStartData->randomSeed = startData->randomSeed;
     gameStartData->playersList = std::move(startData->playersList);
+    gameStartData->spectating = startData->spectate;
+    gameStartData->catchUpStep = startData->catchUpStep;
+    gameStartData->playerName = startData->playerName;
     Game::start(gameStartData);
 }
 
 std::shared_ptr<void> GameClient::end() {
     Game::end();
-    socket->setBlocking(true);
-    socket->disconnect();
-    socket = nullptr;
+    connection->disconnect();
+    connection = nullptr;
+    if (udpSocket) {
+        udpSocket->unbind();
+        udpSocket = nullptr;
+    }
     return nullptr;
 }
 
 void GameClient::network() {
-    sendLocalActionsToServer();
+    traffic.update();
+    // Receive first, so that newly completed steps are acknowledged without delay
     receiveEventsFromServer();
+    if (udpSocket)
+        receiveDatagramsFromServer();
+    // Spectators cannot take actions, and the server does not expect acknowledgements from them
+    if (spectating) {
+        clearQueue(localActions);
+        return;
+    }
+    sendLocalActionsToServer();
+    if (udpSocket)
+        sendDatagramToServer();
 }
 
 void GameClient::sendLocalActionsToServer() {
     // If we are not sending something else right now and there are Actions to be sent,
-    // prepare a packet containing the next Action.
-    if (!isSending and !localActions.empty()) {
+    // prepare a packet containing all of them. Movement key changes that have been superseded
+    // by a later one are dropped, since the server executes all actions of a packet in the same step.
+    // With UDP, actions are taken right away instead, since the datagrams do not have to wait for the TCP socket.
+    if (udpSocket and !localActions.empty()) {
+        removeSupersededActions(localActions);
+        auto nowUS = localClock.getElapsedTime().asMicroseconds();
+        while (!localActions.empty()) {
+            latencyTrace.actionSent(nextActionSequence, localActions.front()->trace.takenUS, nowUS);
+            unackedActions.push_back(*localActions.front());
+            tcpActions.push(std::move(localActions.front()));
+            localActions.pop();
+            nextActionSequence++;
+        }
+        // Older actions still arrive over TCP
+        while (unackedActions.size() > UDP_MAX_UNACKED_ACTIONS)
+            unackedActions.pop_front();
+        datagramDue = true;
+    }
+    // Without UDP, newly completed steps are acknowledged even if there are no actions to send
+    auto& actions = udpSocket ? tcpActions : localActions;
+    if (!isSending and (!actions.empty() or (!udpSocket and latestSimulationStepAvailable > tcpAckedStep))) {
+        if (!udpSocket)
+            removeSupersededActions(actions);
         sendPacket.clear();
-        sendPacket << *localActions.front();
-        localActions.pop();
+        auto numActions = std::min<std::size_t>(actions.size(), MAX_ACTIONS_PER_PACKET);
+        sendPacket << static_cast<sf::Uint8>(GameClientToServerPacketTypes::Actions);
+        writeVarUint(sendPacket, latestSimulationStepAvailable);
+        tcpAckedStep = latestSimulationStepAvailable;
+        writeVarUint(sendPacket, nextTcpActionSequence);
+        sendPacket << static_cast<sf::Uint8>(numActions);
+        auto nowUS = localClock.getElapsedTime().asMicroseconds();
+        for (std::size_t i = 0; i < numActions; i++) {
+            // With UDP, the actions were already sent in a datagram
+            if (!udpSocket)
+                latencyTrace.actionSent(nextTcpActionSequence + i, actions.front()->trace.takenUS, nowUS);
+            sendPacket << *actions.front();
+            actions.pop();
+        }
+        nextTcpActionSequence += numActions;
+        isSending = true;
+    }
+    // Game::start has loaded everything by now, so we are ready as soon as the clock is synchronized
+    if (!isSending and !sentReady and clockSync.isSynchronized()) {
+        sendPacket.clear();
+        sendPacket << static_cast<sf::Uint8>(GameClientToServerPacketTypes::Ready);
+        sentReady = true;
+        isSending = true;
+    }
+    // Actions go first, the clock can wait a little. Until it is known, samples are collected faster to start sooner
+    auto timeRequestIntervalMS = clockSync.isSynchronized() ? CLOCK_SYNC_INTERVAL_MS : CLOCK_SYNC_INITIAL_INTERVAL_MS;
+    if (!isSending and !timeRequestOutstanding and timeRequestClock.getElapsedTime().asMilliseconds() >= timeRequestIntervalMS) {
+        sendPacket.clear();
+        sendPacket << static_cast<sf::Uint8>(GameClientToServerPacketTypes::TimeRequest) << static_cast<sf::Int64>(localClock.getElapsedTime().asMicroseconds());
+        timeRequestOutstanding = true;
         isSending = true;
     }
     // Send a packet if we currently have one prepared. Since we are using non-blocking socket,
     // the send call must be repeated with the same packet in each iteration of the game loop, until
     // the packet has been sent.
     if (isSending) {
-        switch (socket->send(sendPacket)) {
+        switch (connection->send(sendPacket)) {
             case sf::Socket::Done:
+                traffic.countSent(sendPacket);
                 isSending = false;
                 break;
             case sf::Socket::Disconnected:
@@ -65,30 +174,159 @@ void GameClient::sendLocalActionsToServer() {
 }
 
 void GameClient::receiveEventsFromServer() {
-    // Constantly receive events from the server. If the server disconnected, return to main menu.
-    // On receiving an event, we either add it to the eventsToSimulate queue or update
-    // latestSimulationStepAvailable so that Game::simulate knows that it can execute the next
-    // step in the simulation.
-    switch (socket->receive(receivePacket)) {
-        case sf::Socket::Done: {
-            auto e = std::make_unique<Event>();
-            receivePacket >> *e;
-            if (std::holds_alternative<Event::NoMoreEvents>(e->data)) {
-                assert(latestSimulationStepAvailable < e->simulationStep);
-                latestSimulationStepAvailable = e->simulationStep;
+    // Constantly receive event batches from the server. If the server disconnected, return to main menu.
+    // Each batch completes a range of simulation steps: its events are added to the eventsToSimulate queue
+    // and latestSimulationStepAvailable is updated so that Game::simulate knows that it can execute these steps.
+    // All packets that have arrived are processed, so a slow frame does not delay later steps.
+    bool receiving = true;
+    while (receiving) {
+        switch (connection->receive(receivePacket)) {
+            case sf::Socket::Done: {
+                traffic.countReceived(receivePacket);
+                sf::Uint8 packetType;
+                receivePacket >> packetType;
+                if (packetType == static_cast<sf::Uint8>(GameServerToClientPacketTypes::EventBatch)) {
+                    EventBatch batch;
+                    receivePacket >> batch;
+                    addEventBatch(batch);
+                } else if (packetType == static_cast<sf::Uint8>(GameServerToClientPacketTypes::TimeResponse)) {
+                    sf::Int64 requestSentUS, serverReceivedUS, serverSentUS;
+                    receivePacket >> requestSentUS >> serverReceivedUS >> serverSentUS;
+                    if (!receivePacket)
+                        throw std::runtime_error("Truncated time response");
+                    clockSync.addSample(requestSentUS, serverReceivedUS, serverSentUS, localClock.getElapsedTime().asMicroseconds());
+                    timeRequestOutstanding = false;
+                    timeRequestClock.restart();
+                } else if (packetType == static_cast<sf::Uint8>(GameServerToClientPacketTypes::MatchStart)) {
+                    receivePacket >> matchStartServerUS;
+                    if (!receivePacket)
+                        throw std::runtime_error("Truncated match start");
+                } else if (packetType == static_cast<sf::Uint8>(GameServerToClientPacketTypes::Checkpoint)) {
+                    receiveCheckpointChunk(receivePacket);
+                } else
+                    throw std::runtime_error("Received unknown packet type from server");
+            } break;
+            case sf::Socket::Disconnected:
+            case sf::Socket::Error:
+                std::cout << "Error on receive, disconnecting..." << std::endl;
+                nextState = GAME_STATES::MainMenu;
+                receiving = false;
+                break;
+            case sf::Socket::Partial:
+                std::cout << "Partial on receive" << std::endl;
+                receiving = false;
+                break;
+            default:
+                receiving = false;
+                break;
+        }
+    }
+}
+
+void GameClient::addEventBatch(EventBatch& batch) {
+    // Over TCP, batches always directly follow each other. But with UDP, some of the steps may already have arrived
+    // over the other transport, and a datagram that arrives before a lost one cannot be used yet.
+    if (batch.firstStep > latestSimulationStepAvailable + 1 or batch.lastStep <= latestSimulationStepAvailable)
+        return;
+    for (auto& e : batch.events) {
+        if (e.simulationStep > latestSimulationStepAvailable)
+            eventsToSimulate.emplace_back(std::make_unique<Event>(std::move(e)));
+    }
+    latestSimulationStepAvailable = batch.lastStep;
+    datagramDue = true;
+}
+
+void GameClient::receiveCheckpointChunk(sf::Packet& packet) {
+    sf::Uint32 step, totalSize, offset;
+    std::string chunk;
+    packet >> step >> totalSize >> offset >> chunk;
+    if (!packet)
+        throw std::runtime_error("Truncated checkpoint");
+    // The server restarts with a newer checkpoint if the events after the old one are gone
+    if (offset == 0) {
+        checkpointData.clear();
+        checkpointStep = step;
+    }
+    if (step != checkpointStep or offset != checkpointData.size() or chunk.empty() or totalSize - offset < chunk.size())
+        throw std::runtime_error("Received invalid checkpoint chunk");
+    checkpointData += chunk;
+    if (checkpointData.size() < totalSize)
+        return;
+
+    sf::Packet checkpoint;
+    checkpoint.append(checkpointData.data(), checkpointData.size());
+    loadCheckpoint(checkpoint);
+    std::cout << "Loaded the checkpoint of step " << simulationStep << " (" << checkpointData.size() << " bytes)" << std::endl;
+    checkpointData.clear();
+    checkpointData.shrink_to_fit();
+    // Tell the server that we have the steps up to the checkpoint
+    datagramDue = true;
+}
+
+void GameClient::receiveDatagramsFromServer() {
+    // Datagrams from anyone but the server, and malformed ones, are ignored
+    sf::Packet packet;
+    sf::IpAddress sender;
+    unsigned short senderPort;
+    while (udpSocket->receive(packet, sender, senderPort) == sf::Socket::Done) {
+        if (sender != connection->getRemoteAddress() or senderPort != serverUdpPort)
+            continue;
+        traffic.countReceived(packet);
+        try {
+            sf::Uint8 packetType;
+            packet >> packetType;
+            if (!packet or packetType != static_cast<sf::Uint8>(GameServerToClientPacketTypes::EventWindow))
+                continue;
+            auto ackedSequence = static_cast<sf::Uint32>(readVarUint(packet));
+            EventBatch window;
+            packet >> window;
+            // Forget actions the server has acknowledged
+            auto firstUnackedSequence = nextActionSequence - static_cast<sf::Uint32>(unackedActions.size());
+            while (!unackedActions.empty() and firstUnackedSequence <= ackedSequence) {
+                unackedActions.pop_front();
+                firstUnackedSequence++;
             }
-            eventsToSimulate.emplace_back(std::move(e));
-            break;
+            addEventBatch(window);
+        } catch (const std::runtime_error& e) {
+            std::cout << "Ignoring invalid datagram from server: " << e.what() << std::endl;
         }
-        case sf::Socket::Disconnected:
-        case sf::Socket::Error:
-            std::cout << "Error on receive, disconnecting..." << std::endl;
-            nextState = GAME_STATES::MainMenu;
-            break;
-        case sf::Socket::Partial:
-            std::cout << "Partial on receive" << std::endl;
-            break;
-        default:
-            break;
     }
 }
+
+void GameClient::sendDatagramToServer() {
+    // Repeat all unacknowledged actions, so a lost datagram is covered by the next one
+    if (!datagramDue)
+        return;
+    sf::Packet packet;
+    packet << static_cast<sf::Uint8>(GameClientToServerPacketTypes::ActionWindow) << static_cast<sf::Uint8>(playerIndex);
+    writeVarUint(packet, latestSimulationStepAvailable);
+    writeVarUint(packet, nextActionSequence - unackedActions.size());
+    packet << static_cast<sf::Uint8>(unackedActions.size());
+    for (const auto& a : unackedActions)
+        packet << a;
+    if (udpSocket->send(packet, connection->getRemoteAddress(), serverUdpPort) == sf::Socket::Done)
+        traffic.countSent(packet);
+    else
+        std::cout << "Error on sending datagram" << std::endl;
+    datagramDue = false;
+}
+
+std::optional<double> GameClient::getScheduleTimeMS() const {
+    if (!clockSync.isSynchronized() or matchStartServerUS < 0)
+        return std::nullopt;
+    return (clockSync.toServerTimeUS(localClock.getElapsedTime().asMicroseconds()) - matchStartServerUS) / 1000.0 - CLOCK_SYNC_LEAD_MS;
+}
+
+std::optional<sf::Int64> GameClient::toHostTimeUS(sf::Int64 localTimeUS) const {
+    if (!clockSync.isSynchronized())
+        return std::nullopt;
+    return clockSync.toServerTimeUS(localTimeUS);
+}
+
+std::vector<std::string> GameClient::describeNetworkStats() const {
+    // The round trip time is measured by the server (see GameServer::describeNetworkStats)
+    auto actionsQueued = udpSocket ? tcpActions.size() : localActions.size();
+    return {toStr("Server: ", traffic.toString(), ", queued ", actionsQueued, " actions", isSending ? " + 1 packet" : "", " out",
+                  udpSocket ? toStr(", ", unackedActions.size(), " actions unacknowledged over UDP") : ""),
+            toStr("Server ", clockSync.toString())};
+}
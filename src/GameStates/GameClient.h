@@ -1,13 +1,23 @@
 #pragma once
 
+#include <deque>
 #include "Game.h"
+#include "../NetworkEvents/EventBatch.h"
+#include "../NetworkEvents/TrafficStats.h"
+#include "../NetworkEvents/Connection.h"
+#include "../NetworkEvents/ClockSync.h"
 
 struct GameClientStartData {
     std::vector<std::pair<std::string, CHARACTERS>> playersList;
     std::string playerName;
     std::string hostIP;
-    std::unique_ptr<sf::TcpSocket> socket;
+    std::unique_ptr<Connection> connection;
     sf::Uint32 randomSeed;
+    unsigned short serverUdpPort;
+    // Spectators have no character: they receive the events but never send anything
+    bool spectate;
+    // Non-zero if the game is already running, see Game::catchUpStep
+    sf::Uint32 catchUpStep;
 };
 
 /***
@@ -17,21 +27,72 @@ struct GameClientStartData {
  * Inside the Game class, all player Actions are added to the Game::localActions queue.
  * This queue is constantly being emptied by sendLocalActionsToServer. Additionally, receiveEventsFromServer
  * constantly fills the Game::eventsToSimulate queue. The received events are then processed in Game::simulate.
+ *
+ * Actions are numbered in the order they are sent. If UDP is enabled, each action is sent over TCP and is also repeated
+ * in every datagram (sendDatagramToServer) until the server acknowledges it. The datagrams also tell the server the latest
+ * complete simulation step, so the server's datagrams only repeat the steps we are still missing. Events arriving over
+ * both transports are merged in addEventBatch. Without UDP, the latest complete step is acknowledged in the Actions
+ * packets, which the server uses to measure round trip times.
+ *
+ * Between other packets, TimeRequests are sent to estimate the host's clock (see ClockSync.h). Once the game has loaded
+ * and the clock is known, we tell the server that we are Ready. When everyone is, the server sends MatchStart with the
+ * time at which step 0 begins on its clock, and from then on the simulation is paced by that clock (getScheduleTimeMS),
+ * CLOCK_SYNC_LEAD_MS behind the host.
+ *
+ * When joining a running game, the server may first send its latest checkpoint in chunks (receiveCheckpointChunk).
+ * Once complete, it replaces our simulation state, and the event batches continue with the step after it.
  */
 class GameClient : public Game {
 public:
+    ~GameClient() override;
+
     void start(std::shared_ptr<void> data) override;
 
     std::shared_ptr<void> end() override;
 
 private:
     void network() override;
+    std::optional<double> getScheduleTimeMS() const override;
+    std::optional<sf::Int64> toHostTimeUS(sf::Int64 localTimeUS) const override;
+    std::vector<std::string> describeNetworkStats() const override;
     void sendLocalActionsToServer();
     void receiveEventsFromServer();
+    void sendDatagramToServer();
+    void receiveDatagramsFromServer();
+    // Add the events of all steps after latestSimulationStepAvailable. Steps that were already received are skipped
+    void addEventBatch(EventBatch& batch);
+    void receiveCheckpointChunk(sf::Packet& packet);
 
     std::string hostIP;
-    std::unique_ptr<sf::TcpSocket> socket;
+    std::unique_ptr<Connection> connection;
     sf::Packet sendPacket;
     bool isSending;
     sf::Packet receivePacket;
+    // Sequence number of the next action to be put into a TCP packet
+    sf::Uint32 nextTcpActionSequence;
+    // Latest complete simulation step sent in a TCP packet
+    sf::Uint32 tcpAckedStep;
+
+    // nullptr if UDP is disabled
+    std::unique_ptr<sf::UdpSocket> udpSocket;
+    unsigned short serverUdpPort;
+    // With UDP, actions are numbered as soon as they are taken from localActions. They wait in tcpActions until the
+    // TCP socket is free, and stay in unackedActions (at most UDP_MAX_UNACKED_ACTIONS) until the server acknowledges them
+    std::queue<std::unique_ptr<Action>> tcpActions;
+    std::deque<Action> unackedActions;
+    sf::Uint32 nextActionSequence;
+    // Whether there is something new to tell the server (actions or a completed step)
+    bool datagramDue;
+    // TCP and UDP traffic to and from the server
+    TrafficStats traffic;
+    // The time since the last TimeRequest (only one is outstanding at a time). The requests use Game::localClock
+    sf::Clock timeRequestClock;
+    bool timeRequestOutstanding;
+    ClockSync clockSync;
+    bool sentReady;
+    // Server time at which step 0 begins, -1 until MatchStart has arrived
+    sf::Int64 matchStartServerUS;
+    // The chunks of the checkpoint being received so far
+    std::string checkpointData;
+    sf::Uint32 checkpointStep;
 };
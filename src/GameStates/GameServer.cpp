@@ -1,43 +1,468 @@
 #include <iostream>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <random>
 #include "GameServer.h"
 #include "../NetworkEvents/LobbyPacketTypes.h"
+#include "../NetworkEvents/GamePacketTypes.h"
+#include "../NetworkEvents/WireFormat.h"
+#include "LobbyServer.h"
+
+GameServer::GameServer() : scheduleOriginUS(-1), hostActions(NETWORK_THREAD_QUEUE_CAPACITY), completedSteps(NETWORK_THREAD_QUEUE_CAPACITY),
+                           checkpoints(NETWORK_THREAD_QUEUE_CAPACITY), stopNetworkThread(false), networkThreadFailed(false), allClientsLeft(false) { }
+
+GameServer::~GameServer() {
+    stopSimulationThread();
+    stopThread();
+}
 
 void GameServer::start(std::shared_ptr<void> data) {
     this->playerIndex = 0;
     auto startData = std::static_pointer_cast<GameServerStartData>(data);
     auto gameStartData = std::make_shared<GameStartData>();
     gameStartData->randomSeed = startData->randomSeed;
-    gameStartData->playersList.emplace_back(startData->playerName, startData->characterType);
+    // The dedicated server has no player of its own
+    if (!headless)
+        gameStartData->playersList.emplace_back(startData->playerName, startData->characterType);
     for (auto& cStartData : startData->clients) {
         gameStartData->playersList.emplace_back(cStartData.second.first, cStartData.second.second);
         auto newClient = std::make_unique<ClientRepresentation>();
-        newClient->socket = std::move(cStartData.first);
-        newClient->isConnected = true;
-        newClient->characterIndex = this->clients.size() + 1;
+        newClient->name = cStartData.second.first;
+        newClient->characterIndex = gameStartData->playersList.size() - 1;
+        auto token = startData->reconnectTokens.find(newClient->name);
+        newClient->reconnectToken = token != startData->reconnectTokens.end() ? token->second : createReconnectToken();
+        connectClient(*newClient, std::move(cStartData.first), false);
         this->clients.push_back(std::move(newClient));
     }
+    udpSocket = std::move(startData->udpSocket);
+    for (auto& s : startData->spectators) {
+        spectators.emplace_back();
+        spectators.back().connection = std::move(s);
+        spectators.back().sentBytes = 0;
+        spectators.back().catchUp = CatchUpState{false, nullptr, 0, 0};
+    }
+    listener = std::move(startData->listener);
+    randomSeed = startData->randomSeed;
+    initialPlayersList = gameStartData->playersList;
+    playerNames.clear();
+    for (const auto& p : initialPlayersList)
+        playerNames.push_back(p.first);
+    latestCheckpoint = nullptr;
+    eventHistory.clear();
+    pendingJoins.clear();
+    recentSteps.clear();
+    networkClock.restart();
+    stepCreationTimesMS.clear();
+    publishedInputDelaySteps = 0;
+    latestStepCreated = 0;
+    scheduleOriginUS = -1;
+    nextHostActionSequence = 1;
+    undeliveredSteps.clear();
+    networkStatsLines.clear();
+    poller.add(listener.get());
+    poller.add(udpSocket.get());
+    for (auto& c : clients)
+        poller.add(c->connection->getSocket());
+    for (auto& s : spectators)
+        poller.add(s.connection->getSocket());
 
     nextState = GAME_STATES::GameServer;
+    createCheckpoints = true;
     Game::start(gameStartData);
+
+    // From here on, only the network thread touches the connections and the state above
+    stopNetworkThread = false;
+    networkThreadFailed = false;
+    allClientsLeft = false;
+    networkThread = std::thread(&GameServer::runNetworkThread, this);
+}
+
+void GameServer::stopThread() {
+    if (networkThread.joinable()) {
+        stopNetworkThread = true;
+        poller.wake();
+        networkThread.join();
+    }
 }
 
 std::shared_ptr<void> GameServer::end() {
+    stopThread();
     Game::end();
+    // Drop whatever is still in the queues between the threads
+    std::unique_ptr<Action> action;
+    while (hostActions.tryPop(action)) { }
+    CompletedStep step;
+    while (completedSteps.tryPop(step)) { }
+    std::shared_ptr<const Checkpoint> checkpoint;
+    while (checkpoints.tryPop(checkpoint)) { }
     for (auto const& c: clients) {
-        if (c->isConnected) {
-            c->socket->setBlocking(true);
-            c->socket->disconnect();
-            c->socket = nullptr;
-        }
+        if (c->isConnected)
+            closeConnection(c->connection);
     }
     clients.clear();
+    for (auto& s : spectators)
+        closeConnection(s.connection);
+    spectators.clear();
+    for (auto& j : joiningConnections)
+        poller.remove(j.socket.get());
+    joiningConnections.clear();
+    if (listener) {
+        poller.remove(listener.get());
+        listener->setBlocking(true);
+        listener->close();
+        listener = nullptr;
+    }
+    latestCheckpoint = nullptr;
+    eventHistory.clear();
+    if (udpSocket) {
+        poller.remove(udpSocket.get());
+        udpSocket->unbind();
+        udpSocket = nullptr;
+    }
+    recentSteps.clear();
+    // The dedicated server goes back to its lobby for the next game
+    if (nextState == GAME_STATES::LobbyServer) {
+        auto lobbyStartData = LobbyServer::createDedicatedStartData();
+        if (!lobbyStartData)
+            throw std::runtime_error("Dedicated server could not return to the lobby");
+        return lobbyStartData;
+    }
     return nullptr;
 }
 
 void GameServer::network() {
-    receiveActionsFromClients();
-    processActionsToEvents();
-    sendEventsToClients();
+    // The actual networking happens in runNetworkThread. Here, we only exchange actions and steps with that thread
+    if (networkThreadFailed) {
+        stopThread();
+        std::rethrow_exception(networkThreadError);
+    }
+    if (allClientsLeft) {
+        std::cout << "All players have left, returning to the lobby" << std::endl;
+        nextState = GAME_STATES::LobbyServer;
+        return;
+    }
+    // If the queue is full, the remaining actions wait for the next frame
+    while (!localActions.empty()) {
+        auto trace = localActions.front()->trace;
+        if (traceLatency)
+            localActions.front()->trace.sequence = nextHostActionSequence;
+        if (!hostActions.tryPush(localActions.front()))
+            break;
+        localActions.pop();
+        if (traceLatency)
+            latencyTrace.actionSent(nextHostActionSequence++, trace.takenUS, localClock.getElapsedTime().asMicroseconds());
+    }
+    CompletedStep step;
+    while (completedSteps.tryPop(step)) {
+        for (auto& e : step.events)
+            eventsToSimulate.push_back(std::make_unique<Event>(std::move(e)));
+        latestSimulationStepAvailable = step.step;
+    }
+    // If the queue is full, the checkpoint is tried again next frame, unless a newer one replaces it in the meantime
+    if (newCheckpoint and checkpoints.tryPush(newCheckpoint))
+        newCheckpoint = nullptr;
+}
+
+void GameServer::runNetworkThread() {
+    try {
+        while (!stopNetworkThread) {
+            for (auto& c : clients)
+                c->traffic.update();
+            for (auto& s : spectators)
+                s.traffic.update();
+            if (headless and std::none_of(clients.begin(), clients.end(), [](const auto& c) { return c->isConnected; })) {
+                allClientsLeft = true;
+                return;
+            }
+            if (listener)
+                acceptConnections();
+            receiveActionsFromClients();
+            if (udpSocket and poller.isReadable(udpSocket.get()))
+                receiveDatagramsFromClients();
+            std::unique_ptr<Action> action;
+            while (hostActions.tryPop(action)) {
+                action->trace.hostReceivedUS = networkClock.getElapsedTime().asMicroseconds();
+                hostReceivedActions.push(std::move(action));
+            }
+            std::shared_ptr<const Checkpoint> checkpoint;
+            while (checkpoints.tryPop(checkpoint)) {
+                // Catch-ups start from this checkpoint from now on, so the events up to it are no longer needed
+                latestCheckpoint = std::move(checkpoint);
+                while (!eventHistory.empty() and eventHistory.front().simulationStep <= latestCheckpoint->step)
+                    eventHistory.pop_front();
+            }
+            if (scheduleOriginUS < 0)
+                updateStartBarrier();
+            processActionsToEvents();
+            deliverCompletedSteps();
+            sendEventsToClients();
+            sendEventsToSpectators();
+            // Only wait for writability where data is stuck, otherwise every idle socket would wake us up
+            for (auto& c : clients) {
+                if (c->isConnected)
+                    poller.setWantWrite(c->connection->getSocket(), c->isSending);
+            }
+            for (auto& s : spectators)
+                poller.setWantWrite(s.connection->getSocket(), !s.queue.empty());
+            if (statsSnapshotClock.getElapsedTime().asMilliseconds() >= NETWORK_STATS_INTERVAL_MS) {
+                auto lines = describeConnections();
+                std::lock_guard<std::mutex> lock(networkStatsMutex);
+                networkStatsLines = std::move(lines);
+                statsSnapshotClock.restart();
+            }
+            // Pending connections would wake us up again and again while we cannot accept them
+            if (listener and joiningConnections.size() < MAX_NUM_PLAYERS)
+                poller.add(listener.get());
+            else if (listener)
+                poller.remove(listener.get());
+            poller.wait(timeUntilNextWakeUp());
+        }
+    } catch (...) {
+        networkThreadError = std::current_exception();
+        networkThreadFailed = true;
+    }
+}
+
+std::optional<double> GameServer::getScheduleTimeMS() const {
+    // networkClock is only restarted before the network thread starts, so reading it from the game loop is safe
+    sf::Int64 originUS = scheduleOriginUS;
+    if (originUS < 0)
+        return std::nullopt;
+    return (networkClock.getElapsedTime().asMicroseconds() - originUS) / 1000.0;
+}
+
+std::optional<sf::Int64> GameServer::toHostTimeUS(sf::Int64 localTimeUS) const {
+    // Both clocks run on this machine, they only differ by when they were restarted
+    return localTimeUS + networkClock.getElapsedTime().asMicroseconds() - localClock.getElapsedTime().asMicroseconds();
+}
+
+void GameServer::updateStartBarrier() {
+    // Players who left while loading do not hold up the others
+    bool allReady = std::all_of(clients.begin(), clients.end(), [](const auto& c) { return !c->isConnected or c->isReady; });
+    bool timedOut = networkClock.getElapsedTime().asMilliseconds() >= START_BARRIER_TIMEOUT_MS;
+    if (!allReady and !timedOut)
+        return;
+    if (!allReady)
+        std::cout << "Not all players got ready within " << START_BARRIER_TIMEOUT_MS << " ms, starting anyway" << std::endl;
+    // The MatchStart packets are sent right away (see sendEventsToClients), before the first step is created
+    scheduleOriginUS = networkClock.getElapsedTime().asMicroseconds() + START_DELAY_MS * 1000;
+    std::cout << "Starting the match after " << networkClock.getElapsedTime().asMilliseconds() << " ms" << std::endl;
+}
+
+sf::Time GameServer::timeUntilNextWakeUp() const {
+    // Connections without a socket (LoopbackConnection) cannot wake us up, and neither can the game loop taking steps
+    // from a full completedSteps queue, so these are polled
+    bool mustPoll = !undeliveredSteps.empty();
+    for (const auto& c : clients)
+        mustPoll = mustPoll or (c->isConnected and !c->connection->getSocket());
+    for (const auto& s : spectators)
+        mustPoll = mustPoll or !s.connection->getSocket();
+    if (mustPoll)
+        return sf::milliseconds(NETWORK_THREAD_TICK_MS);
+    auto untilNextStepMS = nextStepDueMS() - networkClock.getElapsedTime().asMilliseconds();
+    auto untilStatsMS = NETWORK_STATS_INTERVAL_MS - statsSnapshotClock.getElapsedTime().asMilliseconds();
+    // Nothing wakes us up when the game loop queues host actions or checkpoints, or asks us to stop, so the wait is capped
+    return sf::milliseconds(static_cast<sf::Int32>(std::clamp<sf::Int64>(std::min<sf::Int64>(untilNextStepMS, untilStatsMS), 0, NETWORK_THREAD_MAX_WAIT_MS)));
+}
+
+sf::Int64 GameServer::nextStepDueMS() const {
+    // Step s is created a third of a step after step s - inputDelay is due. Before the match has started, never
+    sf::Int64 originUS = scheduleOriginUS;
+    if (originUS < 0)
+        return std::numeric_limits<sf::Int64>::max();
+    auto nextStep = static_cast<sf::Int64>(latestStepCreated) + 1;
+    return originUS / 1000 + (nextStep - chooseInputDelay(latestStepCreated + 1)) * SIMULATION_TIME_STEP_MS + SIMULATION_TIME_STEP_MS / 3;
+}
+
+void GameServer::closeConnection(std::unique_ptr<Connection>& connection) {
+    poller.remove(connection->getSocket());
+    connection->disconnect();
+    connection = nullptr;
+}
+
+void GameServer::deliverCompletedSteps() {
+    // If the game loop has not taken the steps for a long time, keep them here instead of waiting for it
+    while (!undeliveredSteps.empty() and completedSteps.tryPush(undeliveredSteps.front()))
+        undeliveredSteps.pop_front();
+}
+
+void GameServer::connectClient(ClientRepresentation& client, std::unique_ptr<Connection> connection, bool catchUp) const {
+    client.connection = std::move(connection);
+    client.isConnected = true;
+    client.isSending = false;
+    client.startPackets.clear();
+    client.receivePacket.clear();
+    client.pendingEvents.clear();
+    clearQueue(client.receivedActions);
+    // A reconnecting client numbers its actions from 1 again
+    client.lastActionSequence = 0;
+    client.udpPort = 0;
+    client.ackedStep = 0;
+    client.hasRttSample = false;
+    client.catchUp = CatchUpState{false, nullptr, 0, 0};
+    if (catchUp)
+        startCatchUp(client.catchUp);
+    client.timeRequests.clear();
+    client.isReady = false;
+    client.mergedActions = 0;
+    client.droppedActions = 0;
+    client.sentMatchStart = false;
+}
+
+void GameServer::acceptConnections() {
+    // Clients joining the running game are handled like in the lobby: they first send their name, then get the start signal
+    if (joiningConnections.size() < MAX_NUM_PLAYERS and poller.isReadable(listener.get())) {
+        auto newSocket = std::make_unique<sf::TcpSocket>();
+        if (listener->accept(*newSocket) == sf::Socket::Done) {
+            std::cout << "New client connected during the game" << std::endl;
+            newSocket->setBlocking(false);
+            poller.add(newSocket.get());
+            joiningConnections.push_back({std::move(newSocket), sf::Packet()});
+        }
+    }
+    for (auto iter = joiningConnections.begin(); iter != joiningConnections.end();) {
+        if (!poller.isReadable(iter->socket.get())) {
+            ++iter;
+            continue;
+        }
+        auto status = iter->socket->receive(iter->receivePacket);
+        if (status == sf::Socket::Done) {
+            // Either the socket has been taken over by a client or spectator (and stays in the poller), or the
+            // connection is closed when erasing it
+            try {
+                admitClient(*iter);
+            } catch (const std::runtime_error& e) {
+                std::cout << "Rejecting client: " << e.what() << std::endl;
+                poller.remove(iter->socket.get());
+            }
+            iter = joiningConnections.erase(iter);
+        } else if (status == sf::Socket::Disconnected or status == sf::Socket::Error) {
+            std::cout << "Joining client disconnected" << std::endl;
+            poller.remove(iter->socket.get());
+            iter = joiningConnections.erase(iter);
+        } else
+            ++iter;
+    }
+}
+
+void GameServer::admitClient(JoiningConnection& connection) {
+    auto& packet = connection.receivePacket;
+    sf::Uint8 type, protocolVersion, fractionBits, cType, isSpectator;
+    std::string name;
+    packet >> type >> protocolVersion >> fractionBits;
+    if (!packet or type != static_cast<sf::Uint8>(LobbyClientToServerPacketTypes::UpdatePlayerName))
+        throw std::runtime_error("Unexpected packet");
+    if (protocolVersion != NETWORK_PROTOCOL_VERSION or fractionBits != FPM_FRACTION_BITS)
+        throw std::runtime_error(toStr("Incompatible network protocol ", (int) protocolVersion, " with ", (int) fractionBits, " fraction bits"));
+    sf::Uint64 reconnectToken;
+    packet >> name >> cType >> isSpectator >> reconnectToken;
+    if (!packet or cType >= static_cast<sf::Uint8>(CHARACTERS::CHARACTERS_COUNT))
+        throw std::runtime_error("Invalid packet");
+
+    if (isSpectator) {
+        if (spectators.size() >= MAX_NUM_SPECTATORS)
+            throw std::runtime_error("No spectator slot left");
+        spectators.emplace_back();
+        spectators.back().connection = std::make_unique<TcpConnection>(std::move(connection.socket));
+        spectators.back().sentBytes = 0;
+        startCatchUp(spectators.back().catchUp);
+        for (const auto& p : createStartPackets(latestStepCreated, 0))
+            spectators.back().queue.push_back(encodeForSpectators(p));
+        std::cout << "Spectator " << name << " joined at step " << latestStepCreated << std::endl;
+        return;
+    }
+
+    auto knownName = std::find(playerNames.begin(), playerNames.end(), name);
+    if (knownName != playerNames.end()) {
+        // Take over the character again
+        auto characterIndex = static_cast<unsigned int>(std::distance(playerNames.begin(), knownName));
+        auto client = std::find_if(clients.begin(), clients.end(), [characterIndex](const auto& c) { return c->characterIndex == characterIndex; });
+        if (client == clients.end() or (*client)->isConnected)
+            throw std::runtime_error(toStr("Player ", name, " is already in the game"));
+        // Otherwise, anyone could take over a character by using its name
+        if (reconnectToken != (*client)->reconnectToken)
+            throw std::runtime_error(toStr("Wrong reconnect token for player ", name));
+        connectClient(**client, std::make_unique<TcpConnection>(std::move(connection.socket)), true);
+        for (const auto& p : createStartPackets(latestStepCreated, (*client)->reconnectToken))
+            (*client)->startPackets.push_back(p);
+        std::cout << "Player " << name << " reconnected at step " << latestStepCreated << std::endl;
+        return;
+    }
+
+    if (playerNames.size() >= MAX_NUM_PLAYERS)
+        throw std::runtime_error("No player slot left");
+    // The character is created in the next step, so the client has to catch up at least to that one
+    pendingJoins.push_back(Event::PlayerJoinedEvent{name, static_cast<CHARACTERS>(cType)});
+    auto newClient = std::make_unique<ClientRepresentation>();
+    newClient->name = name;
+    newClient->characterIndex = playerNames.size();
+    newClient->reconnectToken = createReconnectToken();
+    connectClient(*newClient, std::make_unique<TcpConnection>(std::move(connection.socket)), true);
+    for (const auto& p : createStartPackets(latestStepCreated + 1, newClient->reconnectToken))
+        newClient->startPackets.push_back(p);
+    clients.push_back(std::move(newClient));
+    playerNames.push_back(name);
+    std::cout << "Player " << name << " joined at step " << latestStepCreated + 1 << std::endl;
+}
+
+sf::Uint64 GameServer::createReconnectToken() {
+    std::random_device randomDevice;
+    return std::uniform_int_distribution<sf::Uint64>(1, std::numeric_limits<sf::Uint64>::max())(randomDevice);
+}
+
+std::vector<sf::Packet> GameServer::createStartPackets(sf::Uint32 catchUpStep, sf::Uint64 reconnectToken) const {
+    // They go through the same non-blocking sends as everything else, so a joining client that does not read cannot
+    // stall the network thread
+    sf::Packet playersPacket;
+    playersPacket << static_cast<sf::Uint8>(LobbyServerToClientPacketTypes::UpdatePlayersList);
+    playersPacket << static_cast<sf::Uint8>(initialPlayersList.size());
+    for (const auto& p : initialPlayersList)
+        playersPacket << p.first << static_cast<sf::Uint8>(p.second);
+    sf::Packet startPacket;
+    startPacket << static_cast<sf::Uint8>(LobbyServerToClientPacketTypes::StartGame);
+    startPacket << randomSeed << static_cast<sf::Uint16>(udpSocket ? udpSocket->getLocalPort() : 0) << catchUpStep << tilemap->getContentHash() << reconnectToken;
+    return {playersPacket, startPacket};
+}
+
+void GameServer::startCatchUp(CatchUpState& catchUp) const {
+    catchUp.isActive = true;
+    catchUp.checkpoint = latestCheckpoint;
+    catchUp.sentBytes = 0;
+    catchUp.sentStep = latestCheckpoint ? latestCheckpoint->step : 0;
+}
+
+bool GameServer::nextCatchUpPacket(CatchUpState& catchUp, sf::Packet& packet) const {
+    // eventHistory only reaches back to the latest checkpoint. If a newer one has arrived since this catch-up started,
+    // the events still to be sent may be gone, so the client gets the newer checkpoint instead
+    if (latestCheckpoint and catchUp.sentStep < latestCheckpoint->step)
+        startCatchUp(catchUp);
+    packet.clear();
+    if (catchUp.checkpoint and catchUp.sentBytes < catchUp.checkpoint->data.size()) {
+        const auto& data = catchUp.checkpoint->data;
+        auto chunkSize = std::min<std::size_t>(CHECKPOINT_CHUNK_BYTES, data.size() - catchUp.sentBytes);
+        packet << static_cast<sf::Uint8>(GameServerToClientPacketTypes::Checkpoint) << catchUp.checkpoint->step
+               << static_cast<sf::Uint32>(data.size()) << static_cast<sf::Uint32>(catchUp.sentBytes)
+               << std::string(data.data() + catchUp.sentBytes, chunkSize);
+        catchUp.sentBytes += chunkSize;
+        return true;
+    }
+    if (catchUp.sentStep >= latestStepCreated) {
+        catchUp.isActive = false;
+        return false;
+    }
+    EventBatch batch;
+    batch.firstStep = catchUp.sentStep + 1;
+    batch.lastStep = std::min<sf::Uint32>(catchUp.sentStep + CATCH_UP_CHUNK_STEPS, latestStepCreated);
+    auto event = std::lower_bound(eventHistory.begin(), eventHistory.end(), batch.firstStep,
+                                  [](const Event& e, sf::Uint32 step) { return e.simulationStep < step; });
+    for (; event != eventHistory.end() and event->simulationStep <= batch.lastStep; ++event)
+        batch.events.push_back(*event);
+    catchUp.sentStep = batch.lastStep;
+    // Steps created from now on are sent as usual, right after this batch
+    catchUp.isActive = catchUp.sentStep < latestStepCreated;
+    packet << static_cast<sf::Uint8>(GameServerToClientPacketTypes::EventBatch) << batch;
+    return true;
 }
 
 void GameServer::receiveActionsFromClients() {
@@ -45,101 +470,439 @@ void GameServer::receiveActionsFromClients() {
     // If a client disconnects, we just sent a flag that we don't need to read its socket anymore. So the character
     // will continue to exist in the game but just stop doing new actions.
     for (auto& c : clients) {
-        if (!c->isConnected)
+        if (!c->isConnected or !poller.isReadable(c->connection->getSocket()))
             continue;
-        switch (c->socket->receive(c->receivePacket)) {
-            case sf::Socket::Done: {
-                auto a = std::make_unique<Action>();
-                c->receivePacket >> *a;
-                c->receivedActions.push(std::move(a));
-            } break;
-            case sf::Socket::Disconnected:
-            case sf::Socket::Error:
-                std::cout << "Error on receive, disconnecting player " << playerCharacters[c->characterIndex]->getName() << std::endl;
-                c->socket->setBlocking(true);
-                c->socket->disconnect();
-                c->socket = nullptr;
-                c->isConnected = false;
-                break;
-            case sf::Socket::Partial:
-                std::cout << "Partial on receive from player " << playerCharacters[c->characterIndex]->getName() << std::endl;
-                break;
-            default:
-                break;
+        // Receive all packets that have arrived, each of which may contain several actions
+        bool receiving = true;
+        while (receiving) {
+            switch (c->connection->receive(c->receivePacket)) {
+                case sf::Socket::Done:
+                    // A malformed packet only ends the connection of the client that sent it, not the game for everyone
+                    try {
+                        c->traffic.countReceived(c->receivePacket);
+                        sf::Uint8 packetType;
+                        if (!(c->receivePacket >> packetType))
+                            throw std::runtime_error("Received empty packet from client");
+                        if (packetType == static_cast<sf::Uint8>(GameClientToServerPacketTypes::Actions))
+                            readActions(c->receivePacket, *c);
+                        else if (packetType == static_cast<sf::Uint8>(GameClientToServerPacketTypes::Ready))
+                            c->isReady = true;
+                        else if (packetType == static_cast<sf::Uint8>(GameClientToServerPacketTypes::TimeRequest)) {
+                            sf::Int64 clientTimeUS;
+                            c->receivePacket >> clientTimeUS;
+                            // A client only has one request outstanding, so more would be a misbehaving client
+                            if (c->receivePacket and c->timeRequests.size() < 4)
+                                c->timeRequests.emplace_back(clientTimeUS, networkClock.getElapsedTime().asMicroseconds());
+                        } else
+                            throw std::runtime_error("Received unknown packet type from client");
+                    } catch (const std::runtime_error& e) {
+                        std::cout << "Invalid packet from player " << c->name << " (" << e.what() << "), disconnecting" << std::endl;
+                        closeConnection(c->connection);
+                        c->isConnected = false;
+                        receiving = false;
+                    }
+                    break;
+                case sf::Socket::Disconnected:
+                case sf::Socket::Error:
+                    std::cout << "Error on receive, disconnecting player " << c->name << std::endl;
+                    closeConnection(c->connection);
+                    c->isConnected = false;
+                    receiving = false;
+                    break;
+                case sf::Socket::Partial:
+                    std::cout << "Partial on receive from player " << c->name << std::endl;
+                    receiving = false;
+                    break;
+                default:
+                    receiving = false;
+                    break;
+            }
+        }
+    }
+}
 
+void GameServer::receiveDatagramsFromClients() {
+    // Datagrams may be lost, duplicated or reordered, and anyone can send them. So malformed datagrams or those
+    // from unexpected senders are ignored instead of ending the game.
+    sf::Packet packet;
+    sf::IpAddress sender;
+    unsigned short senderPort;
+    while (udpSocket->receive(packet, sender, senderPort) == sf::Socket::Done) {
+        try {
+            sf::Uint8 packetType, characterIndex;
+            packet >> packetType >> characterIndex;
+            if (!packet or packetType != static_cast<sf::Uint8>(GameClientToServerPacketTypes::ActionWindow))
+                continue;
+            auto client = std::find_if(clients.begin(), clients.end(), [characterIndex](const auto& c) {
+                return c->characterIndex == characterIndex;
+            });
+            if (client == clients.end() or !(*client)->isConnected or (*client)->connection->getRemoteAddress() != sender)
+                continue;
+            auto& c = **client;
+            c.traffic.countReceived(packet);
+            readActions(packet, c);
+            c.udpAddress = sender;
+            c.udpPort = senderPort;
+        } catch (const std::runtime_error& e) {
+            std::cout << "Ignoring invalid datagram from " << sender.toString() << ": " << e.what() << std::endl;
         }
     }
 }
 
-void GameServer::processActionQueue(std::queue<std::unique_ptr<Action>>& actions, unsigned int characterID, unsigned int newSimulationStep,
-                                    std::list<std::unique_ptr<Event>>& resultingEvents) {
-    // Here, we process Actions to Events for one individual player.
+void GameServer::readActions(sf::Packet& packet, ClientRepresentation& client) {
+    // The same action may arrive over TCP and UDP, and a datagram repeats all actions that were not acknowledged yet.
+    // Only the action directly following the last accepted one is new; later ones are accepted once the gap is filled.
+    // The whole packet is decoded before anything is accepted, so a malformed one throws without leaving half of it behind
+    auto ackedStep = static_cast<sf::Uint32>(readVarUint(packet));
+    auto sequence = static_cast<sf::Uint32>(readVarUint(packet));
+    sf::Uint8 numActions;
+    if (!(packet >> numActions))
+        throw std::runtime_error("Truncated actions");
+    std::vector<std::unique_ptr<Action>> actions;
+    for (sf::Uint8 i = 0; i < numActions; i++) {
+        actions.push_back(std::make_unique<Action>());
+        packet >> *actions.back();
+    }
+    for (auto& a : actions) {
+        if (sequence == client.lastActionSequence + 1) {
+            // The action counts as received either way, so the client does not repeat it
+            client.lastActionSequence = sequence;
+            // Before anything is dropped, superseded actions make room. The latest movement change and attack target are
+            // never dropped (they replace the queued ones instead), since the client does not send them again, and e.g. a
+            // character whose key release was lost would keep walking. So the queue holds at most two more actions
+            bool supersedes = std::holds_alternative<Action::MovementKeysChangedAction>(a->data) or std::holds_alternative<Action::AttackCharacterAction>(a->data);
+            if (client.receivedActions.size() >= MAX_QUEUED_ACTIONS_PER_CLIENT)
+                client.mergedActions += removeSupersededActions(client.receivedActions);
+            if (std::holds_alternative<Action::Empty>(a->data) or (client.receivedActions.size() >= MAX_QUEUED_ACTIONS_PER_CLIENT and !supersedes))
+                client.droppedActions++;
+            else {
+                if (Game::traceLatency) {
+                    a->trace.sequence = sequence;
+                    a->trace.hostReceivedUS = networkClock.getElapsedTime().asMicroseconds();
+                }
+                client.receivedActions.push(std::move(a));
+                if (client.receivedActions.size() > MAX_QUEUED_ACTIONS_PER_CLIENT)
+                    client.mergedActions += removeSupersededActions(client.receivedActions);
+            }
+        }
+        sequence++;
+    }
+    if (ackedStep > client.ackedStep and ackedStep <= latestStepCreated) {
+        // While catching up, the acknowledgements are delayed by the replay
+        if (!client.catchUp.isActive)
+            updateRoundTripTime(client, ackedStep);
+        client.ackedStep = ackedStep;
+    }
+}
 
-    // Dead players can't take actions
-    if (playerCharacters[characterID]->isDead()) {
-        clearQueue(actions);
+void GameServer::updateRoundTripTime(ClientRepresentation& client, sf::Uint32 ackedStep) {
+    // Only the first acknowledgement of a step is a sample, later ones would include the time it was already waiting
+    auto age = latestStepCreated - ackedStep;
+    if (age >= stepCreationTimesMS.size())
         return;
+    auto sampleMS = static_cast<float>(networkClock.getElapsedTime().asMilliseconds() - stepCreationTimesMS[stepCreationTimesMS.size() - 1 - age]);
+    if (!client.hasRttSample) {
+        client.smoothedRttMS = sampleMS;
+        client.rttDeviationMS = sampleMS / 2;
+        client.hasRttSample = true;
+    } else {
+        client.rttDeviationMS += (std::abs(sampleMS - client.smoothedRttMS) - client.rttDeviationMS) / 4;
+        client.smoothedRttMS += (sampleMS - client.smoothedRttMS) / 8;
     }
+}
 
-    while (!actions.empty()) {
+unsigned int GameServer::chooseInputDelay(unsigned int newSimulationStep) const {
+    if (Game::inputDelayOverride != 0)
+        return Game::inputDelayOverride;
+    if (publishedInputDelaySteps != 0 and newSimulationStep % INPUT_DELAY_ADAPT_INTERVAL_STEPS != 0)
+        return publishedInputDelaySteps;
+    // A step is created a third of a step before it is due, plus one step for every further step of delay. Allow for
+    // delivery times fluctuating by four times the mean deviation of the round trip times of the worst client
+    float maxRttDeviationMS = 0;
+    for (const auto& c : clients) {
+        if (c->isConnected and c->hasRttSample)
+            maxRttDeviationMS = std::max(maxRttDeviationMS, c->rttDeviationMS);
+    }
+    auto inputDelay = std::clamp(1 + static_cast<int>(std::ceil(4 * maxRttDeviationMS / SIMULATION_TIME_STEP_MS)),
+                                 INPUT_DELAY_MIN_STEPS, INPUT_DELAY_MAX_STEPS);
+    // Increase right away, but decrease one step at a time, since every step less makes the clients skip a step
+    if (publishedInputDelaySteps != 0 and inputDelay < static_cast<int>(publishedInputDelaySteps))
+        return publishedInputDelaySteps - 1;
+    return inputDelay;
+}
+
+std::size_t GameServer::processActionQueue(std::queue<std::unique_ptr<Action>>& actions, unsigned int characterID, unsigned int newSimulationStep,
+                                           std::list<std::unique_ptr<Event>>& resultingEvents) {
+    // Here, we process Actions to Events for one individual player. Whether the player can take these actions (e.g.,
+    // is not dead) is decided when the events are simulated, since the network thread does not see the game state.
+
+    // Superseded movement changes and attack targets would only waste bandwidth to all clients and simulation time
+    auto numMerged = removeSupersededActions(actions);
+    // Actions over the budget are not lost but take effect in one of the next steps
+    for (unsigned int i = 0; i < MAX_ACTIONS_PER_STEP and !actions.empty(); i++) {
+        if (actions.front()->trace.sequence != 0)
+            actions.front()->trace.hostWaitUS = networkClock.getElapsedTime().asMicroseconds() - actions.front()->trace.hostReceivedUS;
         resultingEvents.push_back(std::make_unique<Event>(Event::PlayerActionEvent{characterID, *actions.front()}, newSimulationStep));
         actions.pop();
     }
+    return numMerged;
 }
 
 
 void GameServer::processActionsToEvents() {
-    // Just before the next simulation step is due on the server, prepare Events and send them to everyone
-    if (latestSimulationStepAvailable <= simulationStep and simulationTimerMS >= SIMULATION_TIME_STEP_MS / 3) {
-        auto newSimulationStep = latestSimulationStepAvailable + 1;
+    // Prepare Events for the step inputDelaySteps ahead of the one due now and send them to everyone. The steps in
+    // between are already on their way to the clients. Steps are paced by networkClock, not by the game loop, so a slow
+    // frame on the host does not delay them (see nextStepDueMS).
+    while (networkClock.getElapsedTime().asMilliseconds() >= nextStepDueMS()) {
+        auto inputDelay = chooseInputDelay(latestStepCreated + 1);
+        auto newSimulationStep = latestStepCreated + 1;
         std::list<std::unique_ptr<Event>> newEvents;
+        // Changes of the input delay take effect when the step is executed, so the server itself follows them just like the clients
+        if (inputDelay != publishedInputDelaySteps) {
+            newEvents.push_back(std::make_unique<Event>(Event::InputDelayChangedEvent{static_cast<sf::Uint8>(inputDelay)}, newSimulationStep));
+            publishedInputDelaySteps = inputDelay;
+        }
+        for (const auto& join : pendingJoins)
+            newEvents.push_back(std::make_unique<Event>(join, newSimulationStep));
+        pendingJoins.clear();
         // Create events from actions; consider receivedActions from clients but also localActions
         for (auto& c: clients) {
             if (!c->isConnected)
                 continue;
-            processActionQueue(c->receivedActions, c->characterIndex, newSimulationStep, newEvents);
-        }
-        processActionQueue(localActions, 0, newSimulationStep, newEvents);
-        newEvents.push_back(std::make_unique<Event>(Event::NoMoreEvents(), newSimulationStep));
-
-        // Fill sendPacketQueues of the clients (need to create packets from events for that)
-        for (auto & newEvent : newEvents) {
-            for (auto& c: clients) {
-                if (!c->isConnected)
-                    continue;
-                auto sendPacket = std::make_unique<sf::Packet>();
-                *sendPacket << *newEvent;
-                c->sendPacketQueue.push(std::move(sendPacket));
+            c->mergedActions += processActionQueue(c->receivedActions, c->characterIndex, newSimulationStep, newEvents);
+        }
+        if (!headless)
+            processActionQueue(hostReceivedActions, 0, newSimulationStep, newEvents);
+
+        // Add the step to the batches pending for the clients. They are serialized once the clients' sockets are ready
+        for (auto& c: clients) {
+            if (!c->isConnected or c->catchUp.isActive)
+                continue;
+            c->pendingEvents.addStep(newSimulationStep, newEvents);
+        }
+
+        if (!spectators.empty()) {
+            EventBatch step;
+            step.addStep(newSimulationStep, newEvents);
+            auto encodedStep = encodeForSpectators(step);
+            for (auto& s : spectators) {
+                if (!s.catchUp.isActive)
+                    s.queue.push_back(encodedStep);
             }
         }
+        // Kept for clients joining later, until the next checkpoint (see runNetworkThread)
+        for (const auto& e : newEvents)
+            eventHistory.push_back(*e);
 
-        // Also put events into local queue (eventsToSimulate) and update latestSimulationStepAvailable
-        // This is what receiveEventsFromServer does on the Client side
-        eventsToSimulate.splice(eventsToSimulate.end(), newEvents);
-        latestSimulationStepAvailable = newSimulationStep;
+        if (udpSocket) {
+            std::vector<Event> stepEvents;
+            for (const auto& e : newEvents)
+                stepEvents.push_back(*e);
+            recentSteps.emplace_back(newSimulationStep, std::move(stepEvents));
+            if (recentSteps.size() > UDP_REDUNDANT_STEPS)
+                recentSteps.pop_front();
+            sendDatagramsToClients();
+        }
+
+        // Also hand the events to the game loop (see network()). This is what receiveEventsFromServer does on the Client side
+        CompletedStep completedStep{newSimulationStep, {}};
+        for (const auto& e : newEvents)
+            completedStep.events.push_back(*e);
+        undeliveredSteps.push_back(std::move(completedStep));
+        latestStepCreated = newSimulationStep;
+        stepCreationTimesMS.push_back(networkClock.getElapsedTime().asMilliseconds());
+        if (stepCreationTimesMS.size() > RTT_HISTORY_STEPS)
+            stepCreationTimesMS.pop_front();
     }
 }
 
 void GameServer::sendEventsToClients() {
-    // Send the queues of events to be sent to clients
+    // Send all steps pending for a client in one packet, as soon as the previous packet to that client has been sent
     for (auto& c: clients) {
         if (!c->isConnected)
             continue;
-        if (!c->sendPacketQueue.empty()) {
-            switch (c->socket->send(*c->sendPacketQueue.front())) {
-                case sf::Socket::Done:
-                    c->sendPacketQueue.pop();
-                    break;
-                case sf::Socket::Disconnected:
-                case sf::Socket::Error:
-                    std::cout << "Error on send to " << playerCharacters[c->characterIndex]->getName() << ", attempting to continue..." << std::endl;
-                    break;
-                case sf::Socket::Partial:
-                    std::cout << "Partial on send to " << playerCharacters[c->characterIndex]->getName() << std::endl;
-                    break;
-                default:
-                    break;
+        if (!c->isSending and !c->startPackets.empty()) {
+            c->sendPacket = c->startPackets.front();
+            c->startPackets.pop_front();
+            c->isSending = true;
+        }
+        // Before any events, so the client knows when to execute them
+        if (!c->isSending and !c->sentMatchStart and scheduleOriginUS >= 0)
+            prepareMatchStart(*c);
+        if (!c->isSending and c->catchUp.isActive and nextCatchUpPacket(c->catchUp, c->sendPacket))
+            c->isSending = true;
+        if (!c->isSending and !c->pendingEvents.isEmpty()) {
+            c->sendPacket.clear();
+            c->sendPacket << static_cast<sf::Uint8>(GameServerToClientPacketTypes::EventBatch) << c->pendingEvents;
+            c->pendingEvents.clear();
+            c->isSending = true;
+        }
+        if (!c->isSending and !c->timeRequests.empty())
+            prepareTimeResponse(*c);
+        if (c->isSending)
+            sendPacketToClient(*c);
+        // Answer a time request right after the events, instead of waiting for the next wake-up
+        if (c->isConnected and !c->isSending and !c->timeRequests.empty()) {
+            prepareTimeResponse(*c);
+            sendPacketToClient(*c);
+        }
+    }
+}
+
+void GameServer::sendPacketToClient(ClientRepresentation& client) {
+    switch (client.connection->send(client.sendPacket)) {
+        case sf::Socket::Done:
+            client.traffic.countSent(client.sendPacket);
+            client.isSending = false;
+            break;
+        case sf::Socket::Disconnected:
+        case sf::Socket::Error:
+            // Like an error on receive. Otherwise, the poller would keep waking us up for the dead socket
+            std::cout << "Error on send, disconnecting player " << client.name << std::endl;
+            closeConnection(client.connection);
+            client.isConnected = false;
+            client.isSending = false;
+            break;
+        case sf::Socket::Partial:
+            std::cout << "Partial on send to " << client.name << std::endl;
+            break;
+        default:
+            break;
+    }
+}
+
+void GameServer::prepareMatchStart(ClientRepresentation& client) {
+    client.sendPacket.clear();
+    client.sendPacket << static_cast<sf::Uint8>(GameServerToClientPacketTypes::MatchStart) << static_cast<sf::Int64>(scheduleOriginUS);
+    client.sentMatchStart = true;
+    client.isSending = true;
+}
+
+void GameServer::prepareTimeResponse(ClientRepresentation& client) {
+    // The send time is taken when the packet is put together. If the socket is busy, the client sees a larger delay
+    // and discards the sample
+    auto request = client.timeRequests.front();
+    client.timeRequests.pop_front();
+    client.sendPacket.clear();
+    client.sendPacket << static_cast<sf::Uint8>(GameServerToClientPacketTypes::TimeResponse) << request.first << request.second
+                      << static_cast<sf::Int64>(networkClock.getElapsedTime().asMicroseconds());
+    client.isSending = true;
+}
+
+void GameServer::sendDatagramsToClients() {
+    // Send each client all recent steps it has not acknowledged yet, together with the acknowledgement of its actions.
+    // If the client is missing older steps than those, it has to wait for them to arrive over TCP.
+    for (auto& c: clients) {
+        if (!c->isConnected or c->udpPort == 0 or c->catchUp.isActive)
+            continue;
+        EventBatch window;
+        for (const auto& step : recentSteps) {
+            if (step.first > c->ackedStep)
+                window.addStep(step.first, step.second);
+        }
+        if (window.isEmpty())
+            continue;
+        sf::Packet packet;
+        packet << static_cast<sf::Uint8>(GameServerToClientPacketTypes::EventWindow);
+        writeVarUint(packet, c->lastActionSequence);
+        packet << window;
+        if (udpSocket->send(packet, c->udpAddress, c->udpPort) == sf::Socket::Done)
+            c->traffic.countSent(packet);
+        else
+            std::cout << "Error on sending datagram to " << c->name << std::endl;
+    }
+}
+
+std::shared_ptr<const std::vector<char>> GameServer::encodeForSpectators(const EventBatch& batch) {
+    sf::Packet packet;
+    packet << static_cast<sf::Uint8>(GameServerToClientPacketTypes::EventBatch) << batch;
+    return encodeForSpectators(packet);
+}
+
+std::shared_ptr<const std::vector<char>> GameServer::encodeForSpectators(const sf::Packet& packet) {
+    // Connections (like sf::TcpSocket) send the size of a packet as a 32 bit integer in network byte order in front of its data
+    auto size = static_cast<sf::Uint32>(packet.getDataSize());
+    auto buffer = std::make_shared<std::vector<char>>();
+    buffer->reserve(sizeof(size) + size);
+    for (int shift = 24; shift >= 0; shift -= 8)
+        buffer->push_back(static_cast<char>((size >> shift) & 0xFF));
+    auto data = static_cast<const char*>(packet.getData());
+    buffer->insert(buffer->end(), data, data + size);
+    return buffer;
+}
+
+void GameServer::sendEventsToSpectators() {
+    // Send the queued steps as raw bytes, continuing where the last call stopped. Spectators whose connection fails are
+    // dropped
+    for (auto iter = spectators.begin(); iter != spectators.end();) {
+        auto& s = *iter;
+        bool drop = false;
+        // Spectators that joined during the game get the checkpoint and the past steps one packet at a time
+        sf::Packet catchUpPacket;
+        if (s.queue.empty() and s.catchUp.isActive and nextCatchUpPacket(s.catchUp, catchUpPacket))
+            s.queue.push_back(encodeForSpectators(catchUpPacket));
+        while (!s.queue.empty()) {
+            const auto& buffer = *s.queue.front();
+            std::size_t sent = 0;
+            auto status = s.connection->send(buffer.data() + s.sentBytes, buffer.size() - s.sentBytes, sent);
+            s.sentBytes += sent;
+            if (status == sf::Socket::Done or (status == sf::Socket::Partial and s.sentBytes == buffer.size())) {
+                s.traffic.countSent(buffer.size() - sizeof(sf::Uint32));
+                s.queue.pop_front();
+                s.sentBytes = 0;
+            } else if (status == sf::Socket::Partial or status == sf::Socket::NotReady) {
+                break;
+            } else {
+                std::cout << "Error on send to spectator, disconnecting" << std::endl;
+                drop = true;
+                break;
             }
         }
+        if (!drop and s.queue.size() > SPECTATOR_MAX_QUEUED_STEPS) {
+            // Instead of buffering more and more steps, start over from the latest checkpoint. Only a partially sent
+            // buffer is kept, since the stream would be broken without its rest
+            std::cout << "Spectator is " << s.queue.size() << " steps behind, resyncing from the latest checkpoint" << std::endl;
+            s.queue.erase(s.sentBytes > 0 ? std::next(s.queue.begin()) : s.queue.begin(), s.queue.end());
+            startCatchUp(s.catchUp);
+        }
+        if (drop) {
+            closeConnection(s.connection);
+            iter = spectators.erase(iter);
+        } else
+            ++iter;
     }
-}
\ No newline at end of file
+}
+
+std::vector<std::string> GameServer::describeNetworkStats() const {
+    std::lock_guard<std::mutex> lock(networkStatsMutex);
+    return networkStatsLines;
+}
+
+std::vector<std::string> GameServer::describeConnections() const {
+    std::vector<std::string> lines;
+    for (const auto& c : clients) {
+        const auto& name = c->name;
+        if (!c->isConnected) {
+            lines.push_back(toStr(name, ": disconnected"));
+            continue;
+        }
+        // Send queue: steps waiting for the socket, plus the packet currently being sent
+        auto stepsQueued = c->pendingEvents.isEmpty() ? 0 : c->pendingEvents.lastStep - c->pendingEvents.firstStep + 1;
+        lines.push_back(toStr(name, ": RTT ", c->hasRttSample ? toStr(static_cast<int>(c->smoothedRttMS), " +- ", static_cast<int>(c->rttDeviationMS), " ms") : "?",
+                              ", acked ", latestStepCreated - std::min(c->ackedStep, latestStepCreated), " steps behind, ",
+                              c->traffic.toString(), ", queued ", stepsQueued, " steps", c->isSending ? " + 1 packet" : "",
+                              " out, ", c->receivedActions.size(), " actions in (", c->mergedActions, " merged, ", c->droppedActions, " dropped)",
+                              c->udpPort != 0 ? ", UDP" : "",
+                              c->catchUp.isActive ? toStr(", catching up (", c->catchUp.sentStep, " steps sent)") : ""));
+    }
+    if (!spectators.empty()) {
+        std::size_t maxQueued = 0;
+        float bytesSentPerSec = 0;
+        for (const auto& s : spectators) {
+            maxQueued = std::max(maxQueued, s.queue.size());
+            bytesSentPerSec += s.traffic.bytesSentPerSec;
+        }
+        lines.push_back(toStr(spectators.size(), " spectator(s): out ", static_cast<int>(bytesSentPerSec), " B/s in total, up to ", maxQueued, " steps queued"));
+    }
+    return lines;
+}
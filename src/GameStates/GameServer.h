@@ -1,49 +1,289 @@
 #pragma once
 
 #include <list>
+#include <map>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <exception>
 #include <SFML/Network.hpp>
 #include "Game.h"
+#include "../NetworkEvents/EventBatch.h"
+#include "../NetworkEvents/TrafficStats.h"
+#include "../NetworkEvents/Connection.h"
+#include "../NetworkEvents/SocketPoller.h"
+#include "../SpscQueue.h"
 
 struct GameServerStartData {
-    std::list<std::pair<std::unique_ptr<sf::TcpSocket>, std::pair<std::string, CHARACTERS>>> clients;
+    std::list<std::pair<std::unique_ptr<Connection>, std::pair<std::string, CHARACTERS>>> clients;
+    // The players' reconnect tokens by name, see LobbyPacketTypes.h. Players without one get a new one
+    std::map<std::string, sf::Uint64> reconnectTokens;
     std::string playerName;
     CHARACTERS characterType;
     sf::Uint32 randomSeed;
+    // Bound and non-blocking, or nullptr if UDP is disabled
+    std::unique_ptr<sf::UdpSocket> udpSocket;
+    std::list<std::unique_ptr<Connection>> spectators;
+    // The lobby's listener, for players joining or reconnecting during the game
+    std::unique_ptr<sf::TcpListener> listener;
 };
 
 /***
  * This class implements network functionality for the game on the server side.
  * For game logic, see the super class Game.
  *
- * There are individual queues of received Actions and Events to be sent for each client.
+ * There are individual queues of received Actions and batches of Events to be sent for each client.
  * We constantly fill those action queues by receiving from the players in receiveActionsFromClients.
- * We also drain the event queues by sending to them in sendEventsToClients.
- * When it is time to execute the next simulation step, we create Events from all the actions in processActionsToEvents.
+ * When it is time to execute the next simulation step, we create Events from all the actions in processActionsToEvents
+ * and add them to each client's pendingEvents batch. sendEventsToClients then sends all pending steps to a client in a
+ * single packet as soon as the previous packet to that client has been sent. So if the game loop runs slower than the
+ * simulation, several steps simply share one packet instead of piling up in a queue.
  *
- * The queues for the players are processed separately. So processActionQueue is called once for each player.
+ * The queues for the players are processed separately. So processActionQueue is called once for each player. Actions
+ * that a later one overrides are merged, and at most MAX_ACTIONS_PER_STEP of each player become events of one step, so
+ * the work per step stays bounded no matter how many actions a client sends.
+ * On the dedicated server (GameState::headless), there is no local player, so character indices start at 0 for the
+ * first client. Once all clients have disconnected, the dedicated server returns to the lobby.
+ *
+ * If UDP is enabled, the events of the last UDP_REDUNDANT_STEPS steps are kept in recentSteps, and after every step each
+ * client gets a datagram with all of those it has not acknowledged yet (sendDatagramsToClients). Actions arrive over
+ * both transports and are numbered by the client, so each one is accepted exactly once, from whichever transport
+ * delivers it first. A client's UDP endpoint is learned from its first datagram (receiveDatagramsFromClients).
+ *
+ * The host's clock is networkClock: step s is due a third of a step after scheduleOriginUS + s * SIMULATION_TIME_STEP_MS
+ * of it, both for the host's own simulation and, with a synchronized clock (see ClockSync.h), for the clients. The
+ * clients measure their offset to it with TimeRequests, which are answered right after the next events
+ * (prepareTimeResponse).
+ *
+ * Since the peers take different amounts of time to load the game, no steps are created until all players have
+ * reported to be ready (updateStartBarrier). Then scheduleOriginUS is set START_DELAY_MS ahead and sent to everyone in
+ * MatchStart, so all peers execute step 1 at the same time instead of the slow ones starting with a backlog.
+ *
+ * Events are scheduled inputDelaySteps ahead of the current simulation step, so several steps are in flight and clients
+ * can absorb network jitter without stalling. Clients acknowledge the steps they have received; the time between
+ * creating a step and its acknowledgement is a round trip time sample. Unless the delay is fixed with --input-delay,
+ * chooseInputDelay derives it from the variation of these samples and publishes changes as InputDelayChangedEvents.
+ *
+ * Spectators get the same events but cannot send actions. Since there may be many of them, each step is serialized only
+ * once (encodeForSpectators) into an immutable buffer that all spectators' queues share. A spectator that falls more
+ * than SPECTATOR_MAX_QUEUED_STEPS behind does not get the missed steps, but is resynced like a client joining the game
+ * (see below), so slow spectators never hold up the players or make the host buffer more and more steps.
+ *
+ * Clients can also connect while the game is running (acceptConnections). A player whose name belongs to a disconnected
+ * client takes over that character again, a new name gets a new character through a PlayerJoinedEvent (if there is a
+ * free slot), and spectators are admitted as in the lobby. Every CHECKPOINT_INTERVAL_STEPS steps, the game loop saves
+ * a checkpoint of the simulation state (Game::saveCheckpoint) and hands it to the network thread in checkpoints. Since
+ * the simulation is deterministic, the latest checkpoint plus the events since then is a complete snapshot of the game
+ * (before the first checkpoint, the state at the game's start takes its place). So the server only keeps the events
+ * after the latest checkpoint in eventHistory. It streams the checkpoint to the new client in chunks of
+ * CHECKPOINT_CHUNK_BYTES and then the events in batches of CATCH_UP_CHUNK_STEPS steps, one packet at a time, before it
+ * continues with the live steps (nextCatchUpPacket). The client replays the steps as fast as it can. So neither the
+ * host's memory nor the time to join grows with the length of the game.
+ *
+ * All of the above runs on a separate thread (runNetworkThread), which paces the creation of steps by its own clock.
+ * So a slow frame on the host (e.g., loading or a long render) does not hold up the steps for everyone else. The game
+ * loop only exchanges data with that thread through two single-producer/single-consumer queues: the host's actions go
+ * to the network thread in hostActions, and the events of each created step come back in completedSteps (see network()).
+ * Apart from these queues and a few flags, the two threads share nothing but the statistics lines, which are guarded by
+ * a mutex. Since the network thread does not see the game state, whether an action can be executed is decided in
+ * Game::simulate.
+ *
+ * The network thread does not poll its sockets but sleeps in a SocketPoller (epoll on Linux) until a socket is readable,
+ * a socket with unsent data is writable again, or the next step is due (timeUntilNextWakeUp). After a wake-up, it only
+ * reads from the sockets that are ready, but receives everything that has arrived on them at once.
  */
 class GameServer : public Game {
 public:
+    // Progress of streaming the game's state to a client that joined the running game
+    struct CatchUpState {
+        bool isActive;
+        // nullptr if the client starts from the state at the game's start
+        std::shared_ptr<const Checkpoint> checkpoint;
+        // Bytes of the checkpoint already sent
+        std::size_t sentBytes;
+        // The last step already sent (the checkpoint's step until the first events are sent)
+        sf::Uint32 sentStep;
+    };
+
     struct ClientRepresentation {
+        std::string name;
+        // Sent to the client with the start signal. Only who knows it can take the character back after a disconnect
+        sf::Uint64 reconnectToken;
         sf::Packet receivePacket;
-        std::queue<std::unique_ptr<sf::Packet>> sendPacketQueue;
-        std::unique_ptr<sf::TcpSocket> socket;
+        // The packet currently being sent. With non-blocking sockets, the same packet must be sent again until it is done
+        sf::Packet sendPacket;
+        bool isSending;
+        // Only for clients joining during the game: the players list and start signal, which are sent before anything else
+        std::deque<sf::Packet> startPackets;
+        // Events of the steps that have not been put into sendPacket yet
+        EventBatch pendingEvents;
+        std::unique_ptr<Connection> connection;
         bool isConnected;
         std::queue<std::unique_ptr<Action>> receivedActions;
         unsigned int characterIndex;
+        // Sequence number of the last action accepted from this client (0 if none)
+        sf::Uint32 lastActionSequence;
+        // UDP endpoint of the client, udpPort is 0 until the first datagram has arrived
+        sf::IpAddress udpAddress;
+        unsigned short udpPort;
+        // Latest simulation step the client reported to have received completely
+        sf::Uint32 ackedStep;
+        // Smoothed round trip time and its mean deviation (as for TCP's retransmission timer), valid if hasRttSample
+        bool hasRttSample;
+        float smoothedRttMS;
+        float rttDeviationMS;
+        // TCP and UDP traffic to and from this client
+        TrafficStats traffic;
+        // While active, new steps are not added to pendingEvents since the client still gets older ones
+        CatchUpState catchUp;
+        // TimeRequests not answered yet: the client's time of sending and our time of receiving each one
+        std::deque<std::pair<sf::Int64, sf::Int64>> timeRequests;
+        // Actions removed since a later one overrides them (see removeSupersededActions), and actions dropped since too
+        // many were waiting (more than MAX_QUEUED_ACTIONS_PER_CLIENT) or they were invalid
+        sf::Uint64 mergedActions;
+        sf::Uint64 droppedActions;
+        // Whether the client has loaded the game and synchronized its clock, and whether it has been sent MatchStart
+        bool isReady;
+        bool sentMatchStart;
+    };
+
+    struct SpectatorRepresentation {
+        std::unique_ptr<Connection> connection;
+        // Encoded steps not sent completely yet, oldest first. The buffers are shared with the other spectators
+        std::deque<std::shared_ptr<const std::vector<char>>> queue;
+        // Bytes of queue.front() that have already been sent
+        std::size_t sentBytes;
+        TrafficStats traffic;
+        CatchUpState catchUp;
+    };
+
+    // A client that connected during the game and has not sent its name yet
+    struct JoiningConnection {
+        std::unique_ptr<sf::TcpSocket> socket;
+        sf::Packet receivePacket;
+    };
+
+    // The events of one step, as handed from the network thread to the game loop
+    struct CompletedStep {
+        sf::Uint32 step;
+        std::vector<Event> events;
     };
 
+    GameServer();
+    ~GameServer() override;
+
     void start(std::shared_ptr<void> data) override;
 
     std::shared_ptr<void> end() override;
 
+    // A random, non-zero token for a player to take the character back after losing the connection
+    static sf::Uint64 createReconnectToken();
+
 private:
     void network() override;
+    std::optional<double> getScheduleTimeMS() const override;
+    std::optional<sf::Int64> toHostTimeUS(sf::Int64 localTimeUS) const override;
+    // Start the match once all players are ready or START_BARRIER_TIMEOUT_MS has passed
+    void updateStartBarrier();
+    std::vector<std::string> describeNetworkStats() const override;
+    void runNetworkThread();
+    void stopThread();
+    sf::Time timeUntilNextWakeUp() const;
+    // When the next step has to be created, in ms of networkClock
+    sf::Int64 nextStepDueMS() const;
+    // Stop watching the connection's socket, then disconnect it
+    void closeConnection(std::unique_ptr<Connection>& connection);
+    // Move undeliveredSteps to completedSteps as far as there is space
+    void deliverCompletedSteps();
+    std::vector<std::string> describeConnections() const;
+    void acceptConnections();
+    // Handle the UpdatePlayerName packet of a joining client. Throws if the client cannot join
+    void admitClient(JoiningConnection& connection);
+    // The same packets as LobbyServer sends at the start of the game, with the step up to which the client has to catch
+    // up and the client's reconnect token (0 for spectators)
+    std::vector<sf::Packet> createStartPackets(sf::Uint32 catchUpStep, sf::Uint64 reconnectToken) const;
+    void connectClient(ClientRepresentation& client, std::unique_ptr<Connection> connection, bool catchUp) const;
+    // Start streaming the latest checkpoint and the events after it
+    void startCatchUp(CatchUpState& catchUp) const;
+    // Put the next chunk of the checkpoint or the next CATCH_UP_CHUNK_STEPS steps of eventHistory into packet. Returns
+    // false if everything has been sent
+    bool nextCatchUpPacket(CatchUpState& catchUp, sf::Packet& packet) const;
     void receiveActionsFromClients();
+    void receiveDatagramsFromClients();
     void sendEventsToClients();
+    // Send the client's sendPacket, or continue sending it
+    void sendPacketToClient(ClientRepresentation& client);
+    // Put a TimeResponse to the oldest of the client's timeRequests into its sendPacket
+    void prepareTimeResponse(ClientRepresentation& client);
+    void prepareMatchStart(ClientRepresentation& client);
+    void sendDatagramsToClients();
+    void sendEventsToSpectators();
+    // A ready-to-send EventBatch packet, including the size prefix that sf::TcpSocket puts in front of packets
+    static std::shared_ptr<const std::vector<char>> encodeForSpectators(const EventBatch& batch);
+    static std::shared_ptr<const std::vector<char>> encodeForSpectators(const sf::Packet& packet);
+    // Read the acknowledged step and the numbered actions (as in the Actions packet). Keep those actions that directly
+    // follow the client's lastActionSequence. Throws std::runtime_error on malformed packets, upon which the caller drops
+    // the packet (UDP) or the client's connection (TCP)
+    void readActions(sf::Packet& packet, ClientRepresentation& client);
+    void updateRoundTripTime(ClientRepresentation& client, sf::Uint32 ackedStep);
+    unsigned int chooseInputDelay(unsigned int newSimulationStep) const;
     void processActionsToEvents();
-    void processActionQueue(std::queue<std::unique_ptr<Action>>& actions, unsigned int characterID, unsigned int newSimulationStep, std::list<std::unique_ptr<Event>>& resultingEvents);
+    // Returns the number of actions merged into later ones
+    std::size_t processActionQueue(std::queue<std::unique_ptr<Action>>& actions, unsigned int characterID, unsigned int newSimulationStep, std::list<std::unique_ptr<Event>>& resultingEvents);
 
     std::list<std::unique_ptr<ClientRepresentation>> clients;
+    std::list<SpectatorRepresentation> spectators;
+    std::unique_ptr<sf::TcpListener> listener;
+    std::list<JoiningConnection> joiningConnections;
+    // Clients joining the game start from the state at the game's start, which the random seed and the players list
+    // define. Then they load latestCheckpoint (nullptr before the first one) and simulate the events in eventHistory
+    sf::Uint32 randomSeed;
+    std::vector<std::pair<std::string, CHARACTERS>> initialPlayersList;
+    std::shared_ptr<const Checkpoint> latestCheckpoint;
+    // All events after latestCheckpoint's step, in the order of their steps
+    std::deque<Event> eventHistory;
+    // Names of all characters by ID, including those whose PlayerJoinedEvent has not been simulated yet
+    std::vector<std::string> playerNames;
+    // Players who joined since the last step was created
+    std::vector<Event::PlayerJoinedEvent> pendingJoins;
+    // nullptr if UDP is disabled
+    std::unique_ptr<sf::UdpSocket> udpSocket;
+    // Events of the last UDP_REDUNDANT_STEPS simulation steps, oldest first
+    std::deque<std::pair<sf::Uint32, std::vector<Event>>> recentSteps;
+
+    // Number of steps for which the creation time is kept to measure round trip times
+    static constexpr unsigned int RTT_HISTORY_STEPS = 100;
+    sf::Clock networkClock;
+    // Creation times of the steps up to latestStepCreated (the last one is that step), in ms of networkClock
+    std::deque<sf::Int32> stepCreationTimesMS;
+    // Input delay of the latest InputDelayChangedEvent, 0 before the first one
+    unsigned int publishedInputDelaySteps;
+    // The latest step created by the network thread. The game loop has its own latestSimulationStepAvailable
+    sf::Uint32 latestStepCreated;
+    // Time of networkClock at which step 0 begins, -1 until the match has started. Set by the network thread, read by the game loop
+    std::atomic<sf::Int64> scheduleOriginUS;
+
+    std::thread networkThread;
+    // Only used by the network thread, except for wake()
+    SocketPoller poller;
+    SpscQueue<std::unique_ptr<Action>> hostActions;
+    SpscQueue<CompletedStep> completedSteps;
+    // Checkpoints saved by the game loop, see Game::newCheckpoint
+    SpscQueue<std::shared_ptr<const Checkpoint>> checkpoints;
+    // Only if Game::traceLatency: sequence number for the next host action handed to the network thread
+    sf::Uint32 nextHostActionSequence;
+    // Owned by the network thread: host actions taken from hostActions, and created steps that did not fit into completedSteps
+    std::queue<std::unique_ptr<Action>> hostReceivedActions;
+    std::deque<CompletedStep> undeliveredSteps;
+    std::atomic<bool> stopNetworkThread;
+    // Set by the network thread. networkThreadError is only written before networkThreadFailed is set
+    std::atomic<bool> networkThreadFailed;
+    std::exception_ptr networkThreadError;
+    std::atomic<bool> allClientsLeft;
+    // describeConnections() of the network thread, refreshed every NETWORK_STATS_INTERVAL_MS
+    mutable std::mutex networkStatsMutex;
+    std::vector<std::string> networkStatsLines;
+    sf::Clock statsSnapshotClock;
 
 };
@@ -6,8 +6,13 @@
 std::shared_ptr<sf::Font> GameState::defaultFont;
 std::unique_ptr<IMGUI> GameState::imgui;
 std::shared_ptr<sf::RenderWindow> GameState::window;
+bool GameState::headless = false;
+
+void GameState::loadStaticResources(bool headless) {
+    GameState::headless = headless;
+    if (headless)
+        return;
 
-void GameState::loadStaticResources() {
     // Request type depth buffer
     sf::ContextSettings settings;
     settings.depthBits = 24;
@@ -34,7 +39,8 @@ void GameState::loadStaticResources() {
 }
 
 void GameState::unloadStaticResources() {
-    window->close();
+    if (window)
+        window->close();
     imgui = nullptr;
     defaultFont = nullptr;
     window = nullptr;
@@ -18,7 +18,8 @@ public:
 
     virtual GAME_STATES run() { return GAME_STATES::End; }
 
-    static void loadStaticResources();
+    // Without a window (headless), window, imgui and defaultFont stay nullptr
+    static void loadStaticResources(bool headless = false);
 
     static void unloadStaticResources();
 
@@ -26,4 +27,6 @@ protected:
     static std::shared_ptr<sf::Font> defaultFont;
     static std::unique_ptr<IMGUI> imgui;
     static std::shared_ptr<sf::RenderWindow> window;
+    // True on the dedicated server (--dedicated), which has no window, rendering or local player
+    static bool headless;
 };
@@ -3,6 +3,7 @@
 #include "../NetworkEvents/LobbyPacketTypes.h"
 #include <iostream>
 
+std::map<std::pair<std::string, std::string>, sf::Uint64> LobbyClient::reconnectTokens;
 
 void LobbyClient::start(std::shared_ptr<void> data) {
     auto startData = std::static_pointer_cast<LobbyClientStartData>(data);
@@ -10,16 +11,21 @@ void LobbyClient::start(std::shared_ptr<void> data) {
     this->socket = std::move(startData->socket);
     this->hostIP = startData->hostIP;
     this->characterType = startData->characterType;
+    this->spectate = startData->spectate;
 
-    // Send own name and type to server
-    // Here, for convenience, we use a blocking socket (thus avoiding a repeated sending loop as done in LobbyServer)
-    this->socket->setBlocking(true);
-    packet.clear();
-    packet << static_cast<sf::Uint8>(LobbyClientToServerPacketTypes::UpdatePlayerName);
-    packet << playerName;
-    packet << static_cast<sf::Uint8>(characterType);
-    this->socket->send(packet);
+    // Send own name and type to server. The socket stays non-blocking, so run() finishes sending if it only took part
     this->socket->setBlocking(false);
+    handshakePacket.clear();
+    handshakePacket << static_cast<sf::Uint8>(LobbyClientToServerPacketTypes::UpdatePlayerName);
+    handshakePacket << static_cast<sf::Uint8>(NETWORK_PROTOCOL_VERSION) << static_cast<sf::Uint8>(FPM_FRACTION_BITS);
+    handshakePacket << playerName;
+    handshakePacket << static_cast<sf::Uint8>(characterType);
+    handshakePacket << static_cast<sf::Uint8>(spectate);
+    auto token = reconnectTokens.find({hostIP, playerName});
+    handshakePacket << (token != reconnectTokens.end() and !spectate ? token->second : static_cast<sf::Uint64>(0));
+    handshakeSent = false;
+    handshakeAnswered = false;
+    handshakeClock.restart();
 
     playersList.clear();
     nextState = GAME_STATES::LobbyClient;
@@ -36,6 +42,26 @@ GameState::GAME_STATES LobbyClient::run() {
         }
     }
 
+    if (!handshakeSent) {
+        switch (socket->send(handshakePacket)) {
+            case sf::Socket::Done:
+                handshakeSent = true;
+                break;
+            case sf::Socket::NotReady:
+            case sf::Socket::Partial:
+                // SFML continues a partially sent packet when it is passed again
+                break;
+            default:
+                std::cout << "Error on socket.send, disconnecting..." << std::endl;
+                nextState = GAME_STATES::MainMenu;
+                break;
+        }
+    }
+    if (!handshakeAnswered and handshakeClock.getElapsedTime() > sf::milliseconds(LOBBY_HANDSHAKE_TIMEOUT_MS)) {
+        std::cout << "Host did not answer within " << LOBBY_HANDSHAKE_TIMEOUT_MS << " ms, disconnecting..." << std::endl;
+        nextState = GAME_STATES::MainMenu;
+    }
+
     /***
      * Receive what the server is sending.
      * Note that we use non-blocking sockets and thus need to poll in every iteration of this loop.
@@ -44,13 +70,24 @@ GameState::GAME_STATES LobbyClient::run() {
      */
     switch (socket->receive(packet)) {
         case sf::Socket::Done:
+            handshakeAnswered = true;
             std::cout << "Received type packet of type ";
             sf::Uint8 type;
             packet >> type;
             std::cout << (int) type << std::endl;
             if (type == static_cast<sf::Uint8>(LobbyServerToClientPacketTypes::StartGame)) {
-                packet >> randomSeed;
-                nextState = GAME_STATES::GameClient;
+                sf::Uint16 udpPort;
+                sf::Uint64 mapHash, reconnectToken;
+                packet >> randomSeed >> udpPort >> catchUpStep >> mapHash >> reconnectToken;
+                serverUdpPort = udpPort;
+                if (reconnectToken != 0)
+                    reconnectTokens[{hostIP, playerName}] = reconnectToken;
+                auto mapFilename = Game::getMapFilename();
+                if (mapHash != Tilemap::readContentHash(mapFilename)) {
+                    std::cout << "The host plays on a different map than " << mapFilename << ", disconnecting..." << std::endl;
+                    nextState = GAME_STATES::MainMenu;
+                } else
+                    nextState = GAME_STATES::GameClient;
             } else { // LobbyServerToClientPacketTypes::UpdatePlayersList
                 sf::Uint8 numPlayers;
                 packet >> numPlayers;
@@ -82,8 +119,8 @@ GameState::GAME_STATES LobbyClient::run() {
      */
     window->clear();
     imgui->prepare(false, 0);
-    imgui->text(250, 50, toStr("Connected to host at ", hostIP));
-    imgui->text(250, 150, toStr("Your name: ", playerName));
+    imgui->text(250, 50, handshakeAnswered ? toStr("Connected to host at ", hostIP) : toStr("Joining host at ", hostIP, "..."));
+    imgui->text(250, 150, toStr("Your name: ", playerName, spectate ? " (watching)" : ""));
     imgui->text(250, 250, "List of players:");
     for (int i = 0; i < playersList.size(); i++)
         imgui->text(350, 320 + 70 * i, toStr(playersList[i].first, " (", Character::characterTypeToString(playersList[i].second), ")"));
@@ -99,11 +136,14 @@ GameState::GAME_STATES LobbyClient::run() {
 std::shared_ptr<void> LobbyClient::end() {
     if (nextState == GAME_STATES::GameClient) {
         auto returnData = std::make_shared<GameClientStartData>();
-        returnData->socket = std::move(socket);
+        returnData->connection = std::make_unique<TcpConnection>(std::move(socket));
         returnData->playerName = playerName;
         returnData->hostIP = hostIP;
         returnData->playersList = std::move(playersList);
         returnData->randomSeed = randomSeed;
+        returnData->serverUdpPort = serverUdpPort;
+        returnData->spectate = spectate;
+        returnData->catchUpStep = catchUpStep;
         return returnData;
     } else {
         socket->setBlocking(true);
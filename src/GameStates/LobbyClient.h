@@ -1,6 +1,7 @@
 #pragma once
 
 #include <queue>
+#include <map>
 #include <SFML/Network.hpp>
 #include "GameState.h"
 #include "../GameObjects/Character.h"
@@ -10,11 +11,15 @@ struct LobbyClientStartData {
     std::string hostIP;
     std::unique_ptr<sf::TcpSocket> socket;
     CHARACTERS characterType;
+    bool spectate;
 };
 
 /***
- * Client version of the lobby. At the start, sends the player's name to the server.
- * Then, listens to the server to get updated player lists or the start signal (which includes the random seed).
+ * Client version of the lobby. At the start, sends the player's name to the server (without blocking; the first answer
+ * of the server completes this handshake, and if none arrives within LOBBY_HANDSHAKE_TIMEOUT_MS, the client returns to
+ * the MainMenu).
+ * Then, listens to the server to get updated player lists or the start signal (which includes the random seed and
+ * the server's UDP port). Spectators are not part of the players list and only watch the game.
  * Next state is either GameClient (then, the server's socket etc. is passed on as a
  * GameClientStartData object returned by LobbyClient::end()) or MainMenu.
  */
@@ -27,15 +32,28 @@ public:
     std::shared_ptr<void> end() override;
 
 private:
+    // The tokens the hosts gave us for taking our character back after losing the connection, by host and player name
+    static std::map<std::pair<std::string, std::string>, sf::Uint64> reconnectTokens;
+
     std::vector<std::pair<std::string, CHARACTERS>> playersList;
 
     // The local player's name and type
     std::string playerName;
     CHARACTERS characterType;
+    bool spectate;
 
     GameState::GAME_STATES nextState;
+    // Only non-zero when joining a running game, see LobbyPacketTypes.h
+    sf::Uint32 catchUpStep;
     std::string hostIP;
     sf::Uint32 randomSeed;
+    // Port of the server's UDP socket, 0 if the server does not use UDP
+    unsigned short serverUdpPort;
     std::unique_ptr<sf::TcpSocket> socket;
     sf::Packet packet;
+    // The own name and type. Sent again each frame while the socket only takes part of it
+    sf::Packet handshakePacket;
+    bool handshakeSent;
+    bool handshakeAnswered;
+    sf::Clock handshakeClock;
 };
\ No newline at end of file
@@ -1,9 +1,12 @@
 #include "LobbyServer.h"
 #include <iostream>
 #include <cassert>
+#include <algorithm>
 #include "../NetworkEvents/LobbyPacketTypes.h"
 #include "GameServer.h"
 
+unsigned int LobbyServer::dedicatedMinPlayers = 1;
+
 void LobbyServer::start(std::shared_ptr<void> data) {
     auto startData = std::static_pointer_cast<LobbyServerStartData>(data);
     this->playerName = startData->playerName;
@@ -11,16 +14,31 @@ void LobbyServer::start(std::shared_ptr<void> data) {
     this->listener = std::move(startData->listener);
 
     listener->setBlocking(false);
+    poller.add(listener.get());
     nextState = GAME_STATES::LobbyServer;
     clients.clear();
     updatePlayersList();
 
     randomSeed = std::mt19937(std::random_device{}())();
+    startCountdown.restart();
+    if (headless)
+        std::cout << "Dedicated server waiting for " << dedicatedMinPlayers << " player(s) on port " << NETWORK_PORT << std::endl;
+}
+
+std::shared_ptr<LobbyServerStartData> LobbyServer::createDedicatedStartData() {
+    auto startData = std::make_shared<LobbyServerStartData>();
+    startData->listener = std::make_unique<sf::TcpListener>();
+    if (startData->listener->listen(NETWORK_PORT) != sf::Socket::Done) {
+        std::cout << "Error on listener.listen" << std::endl;
+        return nullptr;
+    }
+    startData->characterType = CHARACTERS::KNIGHT;
+    return startData;
 }
 
 GameState::GAME_STATES LobbyServer::run() {
     sf::Event e;
-    while (window->pollEvent(e)) {
+    while (!headless and window->pollEvent(e)) {
         if (e.type == sf::Event::EventType::Closed)
             nextState = GAME_STATES::End;
         if (e.type == sf::Event::Resized) {
@@ -29,24 +47,42 @@ GameState::GAME_STATES LobbyServer::run() {
         }
     }
 
+    /***
+     * The dedicated server sleeps until a socket is ready or the start countdown may have run out. With a window, we
+     * only check which sockets are ready, since the frame rate paces the loop.
+     */
+    // Pending connections would wake us up again and again while we cannot accept them
+    bool acceptingClients = playersList.size() < MAX_NUM_PLAYERS or clients.size() - numConnectedPlayers() < MAX_NUM_SPECTATORS;
+    if (acceptingClients)
+        poller.add(listener.get());
+    else
+        poller.remove(listener.get());
+    if (headless) {
+        auto untilStart = sf::seconds(DEDICATED_SERVER_START_DELAY_SEC) - startCountdown.getElapsedTime();
+        poller.wait(std::clamp(untilStart, sf::Time::Zero, sf::milliseconds(NETWORK_THREAD_MAX_WAIT_MS)));
+    } else
+        poller.wait(sf::Time::Zero);
+
     /***
      * Wait for new clients to connect.
      * Once a new client connected, their name and type are initialized to dummy values and replaced
      * once we get the first message from them.
      */
     bool playersListChanged = false;
-    if (playersList.size() < MAX_NUM_PLAYERS) {
+    if (acceptingClients and poller.isReadable(listener.get())) {
         // Listen to new connections
         auto newSocket = std::make_unique<sf::TcpSocket>();
         switch (listener->accept(*newSocket)) {
             case sf::Socket::Done: {
                 std::cout << "New client connected" << std::endl;
                 newSocket->setBlocking(false);
+                poller.add(newSocket.get());
                 auto newClientRepresentation = std::make_unique<ClientRepresentation>();
                 newClientRepresentation->socket = std::move(newSocket);
                 newClientRepresentation->name = "Unknown";
                 newClientRepresentation->sendPacket = nullptr;
                 newClientRepresentation->characterType = CHARACTERS::KNIGHT;
+                newClientRepresentation->isSpectator = false;
                 clients.push_back(std::move(newClientRepresentation));
                 playersListChanged = true;
                 break;
@@ -66,16 +102,38 @@ GameState::GAME_STATES LobbyServer::run() {
      */
     std::list<std::list<std::unique_ptr<ClientRepresentation>>::const_iterator> disconnectedClients;
     for (auto iter = clients.cbegin(); iter != clients.end(); ++iter) {
+        if (!poller.isReadable((*iter)->socket.get()))
+            continue;
         switch ((*iter)->socket->receive((*iter)->receivePacket)) {
             case sf::Socket::Done:
-                sf::Uint8 type;
+                sf::Uint8 type, protocolVersion, fractionBits;
                 (*iter)->receivePacket >> type;
                 assert(type == static_cast<sf::Uint8>(LobbyClientToServerPacketTypes::UpdatePlayerName));
+                (*iter)->receivePacket >> protocolVersion >> fractionBits;
+                if (protocolVersion != NETWORK_PROTOCOL_VERSION or fractionBits != FPM_FRACTION_BITS) {
+                    std::cout << "Client uses incompatible network protocol " << (int) protocolVersion << " with " << (int) fractionBits
+                              << " fraction bits (expected " << NETWORK_PROTOCOL_VERSION << " with " << FPM_FRACTION_BITS << "), disconnecting" << std::endl;
+                    (*iter)->socket->setBlocking(true);
+                    (*iter)->socket->disconnect();
+                    disconnectedClients.push_back(iter);
+                    playersListChanged = true;
+                    break;
+                }
                 (*iter)->receivePacket >> (*iter)->name;
-                sf::Uint8 cType;
-                (*iter)->receivePacket >> cType;
+                sf::Uint8 cType, isSpectator;
+                (*iter)->receivePacket >> cType >> isSpectator;
                 (*iter)->characterType = static_cast<CHARACTERS>(cType);
-                std::cout << "Received packet, got name from " << (*iter)->name << std::endl;
+                (*iter)->isSpectator = isSpectator != 0;
+                // The accept above may have let in a player while only spectator slots were left
+                if (!(*iter)->isSpectator and playersList.size() > MAX_NUM_PLAYERS) {
+                    std::cout << "No player slot left for " << (*iter)->name << ", disconnecting" << std::endl;
+                    (*iter)->socket->setBlocking(true);
+                    (*iter)->socket->disconnect();
+                    disconnectedClients.push_back(iter);
+                    playersListChanged = true;
+                    break;
+                }
+                std::cout << "Received packet, got name from " << (*iter)->name << ((*iter)->isSpectator ? " (spectator)" : "") << std::endl;
                 playersListChanged = true;
                 break;
             case sf::Socket::Disconnected:
@@ -93,8 +151,10 @@ GameState::GAME_STATES LobbyServer::run() {
                 break;
         }
     }
-    for (auto iter: disconnectedClients)
+    for (auto iter: disconnectedClients) {
+        poller.remove((*iter)->socket.get());
         clients.erase(iter);
+    }
 
     /***
      * When a client connected, disconnected, or updated their name, all clients must be informed.
@@ -135,6 +195,25 @@ GameState::GAME_STATES LobbyServer::run() {
                     break;
             }
         }
+        // Wake up when the rest of the packet can be sent
+        poller.setWantWrite(c->socket.get(), c->sendPacket != nullptr);
+    }
+
+    /***
+     * The dedicated server has no GUI. It starts the game once enough players with valid names have joined and the
+     * players list has not changed for DEDICATED_SERVER_START_DELAY_SEC, so that late joiners can still make it.
+     */
+    if (headless) {
+        bool canStart = playersList.size() >= dedicatedMinPlayers and playerNamesValid();
+        if (playersListChanged) {
+            startCountdown.restart();
+            if (canStart)
+                std::cout << "Starting game with " << playersList.size() << " player(s) in " << DEDICATED_SERVER_START_DELAY_SEC << " seconds" << std::endl;
+        }
+        bool everythingSent = std::none_of(clients.begin(), clients.end(), [](const auto& c) { return c->sendPacket != nullptr; });
+        if (canStart and everythingSent and startCountdown.getElapsedTime() >= sf::seconds(DEDICATED_SERVER_START_DELAY_SEC))
+            nextState = GAME_STATES::GameServer;
+        return nextState;
     }
 
     /***
@@ -145,15 +224,9 @@ GameState::GAME_STATES LobbyServer::run() {
     imgui->text(250, 50, "Waiting for players to join...");
     imgui->text(250, 150, toStr("Your name: ", playerName));
     imgui->text(250, 250, "List of players:");
-    std::vector<std::string> playersNames;
-    for (int i = 0; i < playersList.size(); i++) {
-        playersNames.push_back(playersList[i].first);
+    for (int i = 0; i < playersList.size(); i++)
         imgui->text(350, 320 + 70 * i, toStr(playersList[i].first, " (", Character::characterTypeToString(playersList[i].second), ")"));
-    }
-    // Check that no player name appears twice and no name is "Unknown"
-    std::sort(playersNames.begin(), playersNames.end());
-    if (std::unique(playersNames.begin(), playersNames.end()) == playersNames.end() &&
-        std::find(playersNames.begin(), playersNames.end(), "Unknown") == std::end(playersNames)) {
+    if (playerNamesValid()) {
         if (imgui->button(5, 250, 785, "Start game")) {
             bool everythingSent = true;
             for (auto const& c: clients) {
@@ -174,22 +247,48 @@ GameState::GAME_STATES LobbyServer::run() {
 }
 
 std::shared_ptr<void> LobbyServer::end() {
-    listener->setBlocking(true);
-    listener->close();
-    listener = nullptr;
+    // The sockets are either closed or handed over to GameServer, which watches them with its own poller
+    for (auto& c : clients)
+        poller.remove(c->socket.get());
+    poller.remove(listener.get());
     if (nextState == GAME_STATES::GameServer) {
         auto returnData = std::make_shared<GameServerStartData>();
+        // Players can still join or reconnect while the game is running
+        returnData->listener = std::move(listener);
         returnData->playerName = playerName;
         returnData->randomSeed = randomSeed;
         returnData->characterType = characterType;
+        // The UDP socket for the game is opened here already, since its port is sent to the clients with the start signal
+        sf::Uint16 udpPort = 0;
+        if (Game::udpEnabled) {
+            returnData->udpSocket = std::make_unique<sf::UdpSocket>();
+            if (returnData->udpSocket->bind(NETWORK_PORT) == sf::Socket::Done) {
+                returnData->udpSocket->setBlocking(false);
+                udpPort = returnData->udpSocket->getLocalPort();
+            } else {
+                std::cout << "Could not bind UDP socket to port " << NETWORK_PORT << ", using TCP only" << std::endl;
+                returnData->udpSocket = nullptr;
+            }
+        }
+        // Clients compare this with their own map and refuse to start on a different one
+        auto mapHash = Tilemap::readContentHash(Game::getMapFilename());
         for (auto& c: clients) {
             c->socket->setBlocking(true);
             sf::Packet startPacket;
             startPacket << static_cast<sf::Uint8>(LobbyServerToClientPacketTypes::StartGame);
-            startPacket << randomSeed;
+            startPacket << randomSeed << udpPort << static_cast<sf::Uint32>(0) << mapHash;
+            sf::Uint64 reconnectToken = 0;
+            if (!c->isSpectator) {
+                reconnectToken = GameServer::createReconnectToken();
+                returnData->reconnectTokens[c->name] = reconnectToken;
+            }
+            startPacket << reconnectToken;
             c->socket->send(startPacket);
             c->socket->setBlocking(false);
-            returnData->clients.emplace_back(std::move(c->socket), std::pair<std::string, CHARACTERS>(c->name, c->characterType));
+            if (c->isSpectator)
+                returnData->spectators.push_back(std::make_unique<TcpConnection>(std::move(c->socket)));
+            else
+                returnData->clients.emplace_back(std::make_unique<TcpConnection>(std::move(c->socket)), std::pair<std::string, CHARACTERS>(c->name, c->characterType));
         }
         clients.clear();
         return returnData;
@@ -199,13 +298,33 @@ std::shared_ptr<void> LobbyServer::end() {
             c->socket->disconnect();
         }
         clients.clear();
+        listener->setBlocking(true);
+        listener->close();
+        listener = nullptr;
         return nullptr;
     }
 }
 
+bool LobbyServer::playerNamesValid() const {
+    // Check that no player name appears twice and no name is "Unknown"
+    std::vector<std::string> playersNames;
+    for (const auto& p : playersList)
+        playersNames.push_back(p.first);
+    std::sort(playersNames.begin(), playersNames.end());
+    return std::unique(playersNames.begin(), playersNames.end()) == playersNames.end() &&
+           std::find(playersNames.begin(), playersNames.end(), "Unknown") == std::end(playersNames);
+}
+
 void LobbyServer::updatePlayersList() {
     playersList.clear();
-    playersList.emplace_back(playerName, characterType);
-    for (auto const& client: clients)
-        playersList.emplace_back(client->name, client->characterType);
+    if (!headless)
+        playersList.emplace_back(playerName, characterType);
+    for (auto const& client: clients) {
+        if (!client->isSpectator)
+            playersList.emplace_back(client->name, client->characterType);
+    }
+}
+
+unsigned int LobbyServer::numConnectedPlayers() const {
+    return std::count_if(clients.begin(), clients.end(), [](const auto& c) { return !c->isSpectator; });
 }
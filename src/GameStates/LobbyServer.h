@@ -4,6 +4,7 @@
 #include <queue>
 #include <SFML/Network.hpp>
 #include "GameState.h"
+#include "../NetworkEvents/SocketPoller.h"
 #include "../GameObjects/Character.h"
 
 struct LobbyServerStartData {
@@ -17,6 +18,13 @@ struct LobbyServerStartData {
  * all clients (updated list of players and start signal once the game begins).
  * Next state is either GameServer (then, the clients' sockets etc. are passed on as a
  * GameServerStartData object returned by LobbyServer::end()) or MainMenu.
+ *
+ * On the dedicated server (GameState::headless), there is no local player, so all MAX_NUM_PLAYERS slots are open to
+ * clients. Instead of a button, the game starts DEDICATED_SERVER_START_DELAY_SEC after at least dedicatedMinPlayers
+ * players with valid names have joined.
+ *
+ * Up to MAX_NUM_SPECTATORS further clients may join as spectators. They are not part of the players list and do not
+ * count towards starting the game, but get the start signal like everyone else.
  */
 class LobbyServer : public GameState {
 public:
@@ -26,6 +34,8 @@ public:
         std::unique_ptr<sf::Packet> sendPacket;
         std::string name;
         CHARACTERS characterType;
+        // Known once the client's first packet has arrived, until then the client counts as a player
+        bool isSpectator;
         std::unique_ptr<sf::TcpSocket> socket;
     };
 
@@ -35,7 +45,17 @@ public:
 
     std::shared_ptr<void> end() override;
 
+    // Start data for the dedicated server's lobby: listens on NETWORK_PORT. Returns nullptr if that fails
+    static std::shared_ptr<LobbyServerStartData> createDedicatedStartData();
+
+    // Set with the --players command line option
+    static unsigned int dedicatedMinPlayers;
+
 private:
+    // Player names must be unique and set (not "Unknown") before the game can start
+    bool playerNamesValid() const;
+    unsigned int numConnectedPlayers() const;
+
     // When a new player joins or a player's name is changed, all connected clients are informed
     void updatePlayersList();
 
@@ -46,6 +66,10 @@ private:
     sf::Uint32 randomSeed;
     GameState::GAME_STATES nextState;
     std::unique_ptr<sf::TcpListener> listener;
+    // Watches the listener and the clients' sockets
+    SocketPoller poller;
     std::list<std::unique_ptr<ClientRepresentation>> clients;
     std::vector<std::pair<std::string, CHARACTERS>> playersList;
+    // Only on the dedicated server: time since the players list last changed
+    sf::Clock startCountdown;
 };
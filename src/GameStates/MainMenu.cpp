@@ -14,10 +14,13 @@ MainMenu::MainMenu() : nextState(GAME_STATES::MainMenu), hostIP("localhost") {
     std::uniform_int_distribution<> dis(0, 9);
     playerName = possibleNames[dis(gen)];
     characterType = CHARACTERS::KNIGHT;
+    spectate = false;
 }
 
 void MainMenu::start(std::shared_ptr<void> data) {
     nextState = GAME_STATES::MainMenu;
+    connector = nullptr;
+    connectStatus.clear();
 }
 
 GameState::GAME_STATES MainMenu::run() {
@@ -75,21 +78,35 @@ GameState::GAME_STATES MainMenu::run() {
     }
     imgui->text(555, 710, "or");
     imgui->textBox(2, 660, 700, &hostIP, 15);
-    if (imgui->button(3, 1140, 700, "Join") and nameOK()) {
-        clientSocket = std::make_unique<sf::TcpSocket>();
-        clientSocket->setBlocking(true);
-        switch (clientSocket->connect(hostIP, NETWORK_PORT)) {
-            case sf::Socket::Done:
+    if (imgui->checkBox(14, 1140, 790, "Only watch", spectate, 40.f))
+        spectate = !spectate;
+    if (!connector) {
+        if (imgui->button(3, 1140, 700, "Join") and nameOK())
+            connector = std::make_unique<TcpConnector>(hostIP, NETWORK_PORT);
+    } else if (imgui->button(4, 1140, 700, "Cancel")) {
+        std::cout << "Cancelled connecting to " << hostIP << std::endl;
+        connector = nullptr;
+        connectStatus.clear();
+    }
+    if (connector and nextState == GAME_STATES::MainMenu) {
+        switch (connector->update()) {
+            case TcpConnector::STATUS::CONNECTED:
+                clientSocket = connector->takeSocket();
                 nextState = GAME_STATES::LobbyClient;
-                std::cout << "Client connected to host at " << hostIP << " on port " << NETWORK_PORT
-                          << std::endl;
+                connectStatus.clear();
+                connector = nullptr;
+                break;
+            case TcpConnector::STATUS::FAILED:
+                connectStatus = connector->describe();
+                connector = nullptr;
                 break;
             default:
-                clientSocket = nullptr;
-                std::cout << "Error on clientSocket.connect" << std::endl;
+                connectStatus = connector->describe();
                 break;
         }
     }
+    if (!connectStatus.empty())
+        imgui->text(300, 850, connectStatus);
     imgui->finish();
     window->display();
 
@@ -97,6 +114,8 @@ GameState::GAME_STATES MainMenu::run() {
 }
 
 std::shared_ptr<void> MainMenu::end() {
+    // Hosting (or quitting) while still joining abandons the pending attempts
+    connector = nullptr;
     if (nextState == GAME_STATES::LobbyServer) {
         auto returnData = std::make_shared<LobbyServerStartData>();
         returnData->listener = std::move(listener);
@@ -110,6 +129,7 @@ std::shared_ptr<void> MainMenu::end() {
         returnData->hostIP = hostIP;
         returnData->playerName = playerName;
         returnData->characterType = characterType;
+        returnData->spectate = spectate;
         return returnData;
     }
     return nullptr;
@@ -7,6 +7,7 @@
 #include "SFML/Graphics.hpp"
 #include "SFML/Network.hpp"
 #include "../GameObjects/Character.h"
+#include "../NetworkEvents/TcpConnector.h"
 
 /**
  * Initial screen of the game. Allows users to start hosting or join an existing game.
@@ -31,7 +32,13 @@ private:
     std::string hostIP;
     std::string playerName;
     CHARACTERS characterType;
+    // Join the game only to watch, without a character
+    bool spectate;
 
     std::unique_ptr<sf::TcpListener> listener;
     std::unique_ptr<sf::TcpSocket> clientSocket;
+    // While joining. Connecting never blocks, so the menu keeps running and the user can cancel
+    std::unique_ptr<TcpConnector> connector;
+    // Progress of joining, or why it failed
+    std::string connectStatus;
 };
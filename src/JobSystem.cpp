@@ -0,0 +1,212 @@
+#include "JobSystem.h"
+#include <algorithm>
+#include <stdexcept>
+#include "Constants.h"
+#include "Util.h"
+
+std::vector<std::unique_ptr<JobSystem::Worker>> JobSystem::workers;
+JobSystem::Worker JobSystem::fallbackQueue;
+std::atomic<bool> JobSystem::stopping(false);
+std::atomic<unsigned int> JobSystem::queuedJobs(0);
+std::atomic<unsigned int> JobSystem::nextQueue(0);
+std::mutex JobSystem::sleepMutex;
+std::condition_variable JobSystem::wakeUp;
+sf::Clock JobSystem::utilizationClock;
+thread_local int JobSystem::currentWorker = -1;
+
+unsigned int JobSystem::getDefaultNumWorkers() {
+    // hardware_concurrency may return 0 if it is not known
+    auto numCores = std::max(1u, std::thread::hardware_concurrency());
+    return std::min<unsigned int>(numCores - 1, JOB_SYSTEM_MAX_WORKERS);
+}
+
+void JobSystem::start(unsigned int numWorkers) {
+    if (!workers.empty())
+        throw std::runtime_error("Job system started twice");
+    stopping = false;
+    for (unsigned int i = 0; i < std::min<unsigned int>(numWorkers, JOB_SYSTEM_MAX_WORKERS); i++)
+        workers.push_back(std::make_unique<Worker>());
+    // Only start the threads once all queues exist, since they steal from each other
+    for (unsigned int i = 0; i < workers.size(); i++)
+        workers[i]->thread = std::thread(&JobSystem::runWorker, i);
+    utilizationClock.restart();
+}
+
+void JobSystem::stop() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wakeUp.notify_all();
+    for (auto& w : workers)
+        w->thread.join();
+    workers.clear();
+    std::lock_guard<std::mutex> lock(fallbackQueue.mutex);
+    fallbackQueue.queue.clear();
+    queuedJobs = 0;
+}
+
+JobSystem::JobHandle JobSystem::submit(std::function<void()> work, const std::vector<JobHandle>& dependencies) {
+    auto job = std::make_shared<Job>();
+    job->work = std::move(work);
+    for (const auto& d : dependencies) {
+        std::lock_guard<std::mutex> lock(d->mutex);
+        if (!d->finished) {
+            job->unfinishedDependencies++;
+            d->dependents.push_back(job);
+        } else if (d->error) {
+            std::lock_guard<std::mutex> jobLock(job->mutex);
+            if (!job->error)
+                job->error = d->error;
+        }
+    }
+    if (--job->unfinishedDependencies == 0)
+        enqueue(job);
+    return job;
+}
+
+void JobSystem::enqueue(const JobHandle& job) {
+    Worker* target = &fallbackQueue;
+    if (currentWorker >= 0)
+        target = workers[currentWorker].get();
+    else if (!workers.empty())
+        target = workers[nextQueue++ % workers.size()].get();
+    {
+        // Counted before the job can be taken, so the count never drops below zero. Taking the lock makes sure that a
+        // worker that has just found no job is already waiting
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        queuedJobs++;
+    }
+    {
+        std::lock_guard<std::mutex> lock(target->mutex);
+        target->queue.push_back(job);
+    }
+    wakeUp.notify_one();
+}
+
+bool JobSystem::runOneJob() {
+    JobHandle job;
+    // The own queue from the back, then the others from the front
+    if (currentWorker >= 0) {
+        auto& own = *workers[currentWorker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.queue.empty()) {
+            job = std::move(own.queue.back());
+            own.queue.pop_back();
+        }
+    }
+    auto numQueues = workers.size() + 1;
+    auto first = static_cast<std::size_t>(currentWorker + 1);
+    for (std::size_t i = 0; !job and i < numQueues; i++) {
+        auto index = (first + i) % numQueues;
+        auto& victim = index < workers.size() ? *workers[index] : fallbackQueue;
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.queue.empty()) {
+            job = std::move(victim.queue.front());
+            victim.queue.pop_front();
+        }
+    }
+    if (!job)
+        return false;
+    queuedJobs--;
+    if (currentWorker >= 0) {
+        sf::Clock clock;
+        run(job);
+        workers[currentWorker]->busyUS += clock.getElapsedTime().asMicroseconds();
+        workers[currentWorker]->jobsRun++;
+    } else
+        run(job);
+    return true;
+}
+
+void JobSystem::run(const JobHandle& job) {
+    // No dependency can set the error anymore, so it needs no lock here
+    if (!job->error) {
+        try {
+            job->work();
+        } catch (...) {
+            job->error = std::current_exception();
+        }
+    }
+    job->work = nullptr;
+    std::vector<JobHandle> dependents;
+    {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        job->finished = true;
+        dependents.swap(job->dependents);
+    }
+    job->done.store(true, std::memory_order_release);
+    for (auto& d : dependents) {
+        if (job->error) {
+            std::lock_guard<std::mutex> lock(d->mutex);
+            if (!d->error)
+                d->error = job->error;
+        }
+        if (--d->unfinishedDependencies == 0)
+            enqueue(d);
+    }
+}
+
+void JobSystem::wait(const JobHandle& job) {
+    while (!job->done.load(std::memory_order_acquire)) {
+        // The job may be running on another thread, or blocked by dependencies that are
+        if (!runOneJob())
+            std::this_thread::yield();
+    }
+    if (job->error)
+        std::rethrow_exception(job->error);
+}
+
+void JobSystem::parallelFor(std::size_t count, std::size_t grainSize, const std::function<void(std::size_t, std::size_t)>& body) {
+    grainSize = std::max<std::size_t>(grainSize, 1);
+    if (count <= grainSize or workers.empty()) {
+        if (count > 0)
+            body(0, count);
+        return;
+    }
+    std::vector<JobHandle> jobs;
+    for (std::size_t begin = grainSize; begin < count; begin += grainSize) {
+        auto end = std::min(begin + grainSize, count);
+        jobs.push_back(submit([&body, begin, end]() { body(begin, end); }));
+    }
+    // body is referenced by the jobs, so we wait for all of them even if one failed
+    std::exception_ptr error;
+    try {
+        body(0, grainSize);
+    } catch (...) {
+        error = std::current_exception();
+    }
+    for (auto& j : jobs) {
+        try {
+            wait(j);
+        } catch (...) {
+            if (!error)
+                error = std::current_exception();
+        }
+    }
+    if (error)
+        std::rethrow_exception(error);
+}
+
+void JobSystem::runWorker(unsigned int index) {
+    currentWorker = static_cast<int>(index);
+    while (!stopping) {
+        if (runOneJob())
+            continue;
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wakeUp.wait(lock, []() { return stopping or queuedJobs > 0; });
+    }
+}
+
+std::string JobSystem::describeUtilization() {
+    if (workers.empty())
+        return "Workers: none";
+    auto elapsedUS = std::max<sf::Int64>(1, utilizationClock.restart().asMicroseconds());
+    std::string line = "Workers:";
+    unsigned int jobsRun = 0;
+    for (auto& w : workers) {
+        line += toStr(" ", static_cast<int>(std::min<sf::Int64>(100, w->busyUS.exchange(0) * 100 / elapsedUS)), "%");
+        jobsRun += w->jobsRun.exchange(0);
+    }
+    return line + toStr(" busy, ", jobsRun, " jobs");
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <mutex>
+#include <deque>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+#include <SFML/System.hpp>
+
+/***
+ * A fixed pool of worker threads for small jobs, shared by all subsystems (the rendering, the simulation thread, loading).
+ *
+ * Each worker has its own queue. Jobs submitted by a worker go to the back of its own queue, from where it also takes its
+ * next job, so the data of related jobs tends to stay in the same core's cache. A worker whose queue is empty steals the
+ * oldest job of another one. Jobs submitted by other threads are spread over the workers' queues.
+ *
+ * A job can depend on other jobs and is only queued once all of them have finished. If one of them failed, the job does
+ * not run but fails with the same exception. Threads that wait for a job (wait, parallelFor) run queued jobs in the
+ * meantime instead of blocking, so waiting from within a job cannot deadlock. Without workers (start was not called,
+ * or on a single core), all jobs run on the threads that wait for them.
+ *
+ * Jobs must not depend on the order in which they run. E.g., the simulation only uses it for phases that give the same
+ * result no matter how the characters are split among the threads, so all peers stay in sync.
+ */
+class JobSystem {
+public:
+    class Job;
+    using JobHandle = std::shared_ptr<Job>;
+
+    // One less than the number of cores (the main thread does work, too), at most JOB_SYSTEM_MAX_WORKERS
+    static unsigned int getDefaultNumWorkers();
+    // Called by main.cpp before any job is submitted
+    static void start(unsigned int numWorkers);
+    // Waits for the running jobs. Jobs still queued are dropped
+    static void stop();
+    static unsigned int getNumWorkers() { return static_cast<unsigned int>(workers.size()); }
+
+    static JobHandle submit(std::function<void()> work, const std::vector<JobHandle>& dependencies = {});
+    // Runs other jobs until the job has finished. Rethrows the exception of a failed job
+    static void wait(const JobHandle& job);
+    // Calls body(begin, end) for consecutive ranges of at most grainSize indices covering [0, count) in parallel (the
+    // calling thread takes the first range) and returns once all have finished. Rethrows the first exception
+    static void parallelFor(std::size_t count, std::size_t grainSize, const std::function<void(std::size_t, std::size_t)>& body);
+
+    // For the F overlay, e.g. "Workers: 35% 20% 0% busy, 120 jobs". Covers the time since the last call, i.e., one frame
+    static std::string describeUtilization();
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<JobHandle> queue;
+        std::thread thread;
+        std::atomic<sf::Int64> busyUS{0};
+        std::atomic<unsigned int> jobsRun{0};
+    };
+
+    static void runWorker(unsigned int index);
+    static void enqueue(const JobHandle& job);
+    // Runs one queued job, preferably from the own queue. False if there was none
+    static bool runOneJob();
+    static void run(const JobHandle& job);
+
+    static std::vector<std::unique_ptr<Worker>> workers;
+    // Jobs submitted before start or without workers
+    static Worker fallbackQueue;
+    static std::atomic<bool> stopping;
+    static std::atomic<unsigned int> queuedJobs;
+    static std::atomic<unsigned int> nextQueue;
+    // Idle workers sleep on this until a job is queued
+    static std::mutex sleepMutex;
+    static std::condition_variable wakeUp;
+    static sf::Clock utilizationClock;
+    // Index of the worker running on this thread, -1 for other threads
+    static thread_local int currentWorker;
+};
+
+class JobSystem::Job {
+private:
+    friend class JobSystem;
+
+    std::function<void()> work;
+    // Plus one while submit is still registering the job with its dependencies
+    std::atomic<unsigned int> unfinishedDependencies{1};
+    std::atomic<bool> done{false};
+    // Guards finished, dependents and error (until the job runs)
+    std::mutex mutex;
+    bool finished = false;
+    std::vector<JobHandle> dependents;
+    std::exception_ptr error;
+};
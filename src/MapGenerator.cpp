@@ -0,0 +1,273 @@
+#include "MapGenerator.h"
+#include <fstream>
+#include <filesystem>
+#include <queue>
+#include <stdexcept>
+#include <algorithm>
+#include <limits>
+#include "Constants.h"
+
+namespace {
+    // Must match Data/map/map.tmx, since the generated map uses the same tilesets
+    const int TILE_WIDTH = 64;
+    const int TILE_HEIGHT = 32;
+    const int FIRST_GID_CAVE = 1;
+    const int FIRST_GID_FLOWFIELD = 241;
+    const std::string TILESET_DIRECTORY = "Data/map";
+
+    // Widths of the open areas on the left (creep spawns) and right (player base) of the lanes
+    const int SPAWN_AREA_WIDTH = 6;
+    const int BASE_AREA_WIDTH = 10;
+    const int MIN_LANE_HEIGHT = 3;
+
+    // Step in map coordinates for each ORIENTATIONS value (see getDirectionVector)
+    const sf::Vector2i ORIENTATION_STEPS[8] = {{1, -1}, {-1, -1}, {0, -1}, {-1, 0}, {1, 1}, {1, 0}, {0, 1}, {-1, 1}};
+
+    // Pixel coordinates of a position given in tiles. Tiled stores object positions of isometric maps in multiples of the tile height
+    int toPixels(int tiles) { return tiles * TILE_HEIGHT; }
+
+    void writeRectObject(std::ofstream &file, int &nextObjectID, const sf::IntRect &rect, const std::string &name = "") {
+        file << "  <object id=\"" << nextObjectID++ << "\"";
+        if (!name.empty())
+            file << " name=\"" << name << "\"";
+        file << " x=\"" << toPixels(rect.left) << "\" y=\"" << toPixels(rect.top) << "\" width=\"" << toPixels(rect.width) << "\" height=\"" << toPixels(rect.height) << "\"/>\n";
+    }
+
+    void writeTileLayer(std::ofstream &file, int id, const std::string &name, int size, const std::vector<int> &tiles) {
+        file << " <layer id=\"" << id << "\" name=\"" << name << "\" width=\"" << size << "\" height=\"" << size << "\">\n";
+        file << "  <data encoding=\"csv\">\n";
+        for (int y = 0; y < size; y++) {
+            for (int x = 0; x < size; x++) {
+                file << tiles[y * size + x];
+                if (x < size - 1 || y < size - 1)
+                    file << ",";
+            }
+            file << "\n";
+        }
+        file << "</data>\n";
+        file << " </layer>\n";
+    }
+}
+
+MapGenerator::MapGenerator(int size, float obstacleDensity, int numLanes, sf::Uint32 seed) : size(size), gen(seed) {
+    if (size < MIN_SIZE)
+        throw std::runtime_error("Map size must be at least " + std::to_string(MIN_SIZE));
+    if (obstacleDensity < 0 || obstacleDensity > 0.9f)
+        throw std::runtime_error("Obstacle density must be between 0 and 0.9");
+    if (numLanes < 1)
+        throw std::runtime_error("There must be at least one lane");
+    // Each lane gets a band of (size - 2) / numLanes rows: the lane itself plus at least one row of walls separating it from the next lane
+    int bandHeight = (size - 2) / numLanes;
+    if (bandHeight < MIN_LANE_HEIGHT + 1)
+        throw std::runtime_error("Map of size " + std::to_string(size) + " is too small for " + std::to_string(numLanes) + " lanes");
+
+    blocked.assign(size * size, 0);
+
+    // Border
+    addObstacle({0, 0, size, 1});
+    addObstacle({0, size - 1, size, 1});
+    addObstacle({0, 1, 1, size - 2});
+    addObstacle({size - 1, 1, 1, size - 2});
+
+    // Lanes between the spawn area and the base. Lanes take two thirds of their band, walls the rest
+    int lanesLeft = 1 + SPAWN_AREA_WIDTH;
+    int lanesRight = size - 1 - BASE_AREA_WIDTH;
+    int laneHeight = std::max(MIN_LANE_HEIGHT, bandHeight * 2 / 3);
+    int y = 1;
+    for (int lane = 0; lane < numLanes; lane++) {
+        // The last band also takes the rows left over by the integer division
+        int curBandHeight = lane < numLanes - 1 ? bandHeight : size - 1 - y;
+        int curLaneHeight = lane < numLanes - 1 ? laneHeight : curBandHeight - (bandHeight - laneHeight);
+        int wallsAbove = (curBandHeight - curLaneHeight) / 2;
+        if (wallsAbove > 0)
+            addObstacle({lanesLeft, y, lanesRight - lanesLeft, wallsAbove});
+        if (curBandHeight - curLaneHeight - wallsAbove > 0)
+            addObstacle({lanesLeft, y + wallsAbove + curLaneHeight, lanesRight - lanesLeft, curBandHeight - curLaneHeight - wallsAbove});
+        sf::IntRect laneRect(lanesLeft, y + wallsAbove, lanesRight - lanesLeft, curLaneHeight);
+        addScatteredObstacles(laneRect, laneRect.top + laneRect.height / 2, obstacleDensity);
+        y += curBandHeight;
+    }
+
+    // Creep spawn zones, evenly distributed over the height of the spawn area
+    for (int i = 0; i < 3; i++)
+        creepSpawnZones.emplace_back(2, (size * (i + 1)) / 4 - 2, 4, 4);
+
+    // The player base: healing zone on top, creep goal directly above the player respawn zone in the middle, shop at the bottom
+    int baseLeft = lanesRight + 2;
+    healingZone = {baseLeft, 2, 6, 6};
+    creepGoal = {baseLeft, size / 2 - 4, 6, 1};
+    playerRespawnZone = {baseLeft, size / 2 - 3, 6, 6};
+    shop = {baseLeft, size - 7, 6, 5};
+    for (int i = 0; i < MAX_NUM_PLAYERS; i++)
+        playerSpawnPositions.emplace_back(playerRespawnZone.left + 1 + 2 * (i % 3), playerRespawnZone.top + 1 + 2 * (i / 3));
+
+    createFlowfield();
+    createTileLayers();
+}
+
+void MapGenerator::addObstacle(const sf::IntRect &rect) {
+    obstacles.push_back(rect);
+    for (int y = rect.top; y < rect.top + rect.height; y++)
+        for (int x = rect.left; x < rect.left + rect.width; x++)
+            blocked[y * size + x] = 1;
+}
+
+void MapGenerator::addScatteredObstacles(const sf::IntRect &lane, int freeRow, float obstacleDensity) {
+    // Place non-overlapping blocks of 1x1 to 3x3 tiles until the requested share of the lane is covered.
+    // Blocks never touch freeRow, so the lane always stays passable
+    int targetTiles = static_cast<int>(obstacleDensity * static_cast<float>(lane.width * (lane.height - 1)));
+    int coveredTiles = 0;
+    int maxAttempts = 20 * targetTiles;
+    for (int attempt = 0; attempt < maxAttempts && coveredTiles < targetTiles; attempt++) {
+        sf::IntRect block(lane.left + random(lane.width), lane.top + random(lane.height), 1 + random(3), 1 + random(3));
+        if (block.left + block.width > lane.left + lane.width || block.top + block.height > lane.top + lane.height)
+            continue;
+        if (block.top <= freeRow && block.top + block.height > freeRow)
+            continue;
+        bool free = true;
+        for (int y = block.top; y < block.top + block.height && free; y++)
+            for (int x = block.left; x < block.left + block.width && free; x++)
+                free = !isBlocked(x, y);
+        if (!free)
+            continue;
+        addObstacle(block);
+        coveredTiles += block.width * block.height;
+    }
+}
+
+void MapGenerator::createFlowfield() {
+    // Dijkstra from the creep goal (straight steps cost 10, diagonal steps 14, no cutting of blocked corners).
+    // Then each tile flows towards its neighbor on a shortest path
+    const auto UNREACHABLE = std::numeric_limits<unsigned int>::max();
+    std::vector<unsigned int> cost(size * size, UNREACHABLE);
+    std::priority_queue<std::pair<unsigned int, int>, std::vector<std::pair<unsigned int, int>>, std::greater<>> queue;
+    for (int y = creepGoal.top; y < creepGoal.top + creepGoal.height; y++) {
+        for (int x = creepGoal.left; x < creepGoal.left + creepGoal.width; x++) {
+            cost[y * size + x] = 0;
+            queue.emplace(0, y * size + x);
+        }
+    }
+    auto canStep = [this](int x, int y, const sf::Vector2i &step) {
+        int nx = x + step.x, ny = y + step.y;
+        if (nx < 0 || ny < 0 || nx >= size || ny >= size || isBlocked(nx, ny))
+            return false;
+        return step.x == 0 || step.y == 0 || (!isBlocked(nx, y) && !isBlocked(x, ny));
+    };
+    while (!queue.empty()) {
+        auto [curCost, index] = queue.top();
+        queue.pop();
+        if (curCost > cost[index])
+            continue;
+        int x = index % size, y = index / size;
+        for (const auto &step : ORIENTATION_STEPS) {
+            if (!canStep(x, y, step))
+                continue;
+            auto newCost = curCost + (step.x != 0 && step.y != 0 ? 14 : 10);
+            auto newIndex = (y + step.y) * size + x + step.x;
+            if (newCost < cost[newIndex]) {
+                cost[newIndex] = newCost;
+                queue.emplace(newCost, newIndex);
+            }
+        }
+    }
+
+    flowfield.assign(size * size, ORIENTATIONS::NUM_ORIENTATIONS);
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            if (cost[y * size + x] == UNREACHABLE || cost[y * size + x] == 0)
+                continue;
+            auto bestCost = UNREACHABLE;
+            for (int o = 0; o < 8; o++) {
+                const auto &step = ORIENTATION_STEPS[o];
+                if (!canStep(x, y, step))
+                    continue;
+                auto neighborCost = cost[(y + step.y) * size + x + step.x];
+                if (neighborCost < bestCost) {
+                    bestCost = neighborCost;
+                    flowfield[y * size + x] = static_cast<ORIENTATIONS>(o);
+                }
+            }
+        }
+    }
+}
+
+void MapGenerator::createTileLayers() {
+    groundTiles.assign(size * size, 0);
+    wallTiles.assign(size * size, 0);
+    decorTiles.assign(size * size, 0);
+    auto isInZone = [this](int x, int y) {
+        sf::Vector2i tile(x, y);
+        for (const auto &zone : creepSpawnZones)
+            if (zone.contains(tile))
+                return true;
+        return healingZone.contains(tile) || playerRespawnZone.contains(tile) || creepGoal.contains(tile) || shop.contains(tile);
+    };
+    for (int y = 1; y < size - 1; y++) {
+        for (int x = 1; x < size - 1; x++) {
+            // Mostly plain ground, sometimes one of the rarer variants
+            groundTiles[y * size + x] = random(10) == 0 ? 33 + random(8) : 1 + random(16);
+            if (isBlocked(x, y)) {
+                // Only obstacle tiles next to free tiles get walls; the inside of large obstacles shows plain ground
+                bool nextToFreeTile = false;
+                for (const auto &step : ORIENTATION_STEPS)
+                    nextToFreeTile = nextToFreeTile || !isBlocked(x + step.x, y + step.y);
+                if (nextToFreeTile)
+                    wallTiles[y * size + x] = 49 + random(8);
+            } else if (!isInZone(x, y) && random(100) == 0)
+                decorTiles[y * size + x] = 117 + random(4);
+        }
+    }
+}
+
+void MapGenerator::save(const std::string &filename) const {
+    std::ofstream file(filename);
+    if (!file)
+        throw std::runtime_error("Could not open file " + filename + " for writing");
+
+    // Tileset paths are relative to the map file
+    auto mapDirectory = std::filesystem::absolute(std::filesystem::path(filename)).parent_path();
+    auto tilesetDirectory = std::filesystem::relative(std::filesystem::absolute(TILESET_DIRECTORY), mapDirectory);
+
+    file << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+    file << "<map version=\"1.10\" tiledversion=\"1.11.0\" orientation=\"isometric\" renderorder=\"right-down\" width=\"" << size
+         << "\" height=\"" << size << "\" tilewidth=\"" << TILE_WIDTH << "\" tileheight=\"" << TILE_HEIGHT << "\" infinite=\"0\" nextlayerid=\"12\" nextobjectid=\""
+         << obstacles.size() + creepSpawnZones.size() + playerSpawnPositions.size() + 5 << "\">\n";
+    file << " <tileset firstgid=\"" << FIRST_GID_CAVE << "\" source=\"" << (tilesetDirectory / "cave.tsx").lexically_normal().generic_string() << "\"/>\n";
+    file << " <tileset firstgid=\"" << FIRST_GID_FLOWFIELD << "\" source=\"" << (tilesetDirectory / "flowfield.tsx").lexically_normal().generic_string() << "\"/>\n";
+
+    std::vector<int> flowfieldTiles(size * size, 0);
+    for (int i = 0; i < size * size; i++)
+        if (flowfield[i] != ORIENTATIONS::NUM_ORIENTATIONS)
+            flowfieldTiles[i] = FIRST_GID_FLOWFIELD + static_cast<int>(flowfield[i]);
+    writeTileLayer(file, 1, "ground", size, groundTiles);
+    writeTileLayer(file, 2, "walls", size, wallTiles);
+    writeTileLayer(file, 3, "decor", size, decorTiles);
+    writeTileLayer(file, 4, "flowfield", size, flowfieldTiles);
+
+    // Tilemap expects spawn points to be listed in reverse order of their names
+    int nextObjectID = 1;
+    file << " <objectgroup id=\"5\" name=\"creepSpawn\">\n";
+    for (int i = 2; i >= 0; i--)
+        writeRectObject(file, nextObjectID, creepSpawnZones[i], std::to_string(i + 1));
+    file << " </objectgroup>\n";
+    file << " <objectgroup id=\"6\" name=\"playerSpawn\">\n";
+    for (int i = MAX_NUM_PLAYERS - 1; i >= 0; i--)
+        file << "  <object id=\"" << nextObjectID++ << "\" name=\"" << i + 1 << "\" x=\"" << toPixels(playerSpawnPositions[i].x) + TILE_HEIGHT / 2
+             << "\" y=\"" << toPixels(playerSpawnPositions[i].y) + TILE_HEIGHT / 2 << "\"/>\n";
+    file << " </objectgroup>\n";
+    const std::pair<std::string, sf::IntRect> zones[] = {{"playerRespawn", playerRespawnZone}, {"healingZone", healingZone},
+                                                         {"shop", shop}, {"creepGoal", creepGoal}};
+    int layerID = 7;
+    for (const auto &[name, rect] : zones) {
+        file << " <objectgroup id=\"" << layerID++ << "\" name=\"" << name << "\">\n";
+        writeRectObject(file, nextObjectID, rect);
+        file << " </objectgroup>\n";
+    }
+    file << " <objectgroup id=\"" << layerID++ << "\" name=\"obstacles\">\n";
+    for (const auto &obstacle : obstacles)
+        writeRectObject(file, nextObjectID, obstacle);
+    file << " </objectgroup>\n";
+    file << "</map>\n";
+    if (!file)
+        throw std::runtime_error("Could not write file " + filename);
+}
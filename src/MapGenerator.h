@@ -0,0 +1,64 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <random>
+#include "SFML/Graphics.hpp"
+#include "Util.h"
+
+/***
+ * Generates Tiled .tmx maps of arbitrary size, e.g. for measuring how the game scales with map size and obstacle density.
+ *
+ * Layout (x grows to the right, y downwards in map coordinates):
+ * - The map is surrounded by a border of obstacles.
+ * - The creep spawn zones lie in an open area on the left, the player base (creep goal, player spawn and respawn, shop
+ *   and healing zone) in an open area on the right.
+ * - In between, numLanes horizontal lanes are separated by solid walls. Inside the lanes, small random obstacles cover
+ *   about obstacleDensity of the area. The center row of each lane is kept free, so every lane connects both sides.
+ * - The flowfield leads all reachable tiles to the creep goal on shortest paths.
+ *
+ * The generated map references the tilesets in Data/map, so it can be loaded with --map or cooked with --cook-map.
+ * The same parameters always yield the same map.
+ */
+class MapGenerator {
+public:
+    /***
+     * Throws std::runtime_error if the parameters are invalid or the map would be too small for the given number of lanes.
+     */
+    MapGenerator(int size, float obstacleDensity, int numLanes, sf::Uint32 seed);
+
+    void save(const std::string &filename) const;
+
+    static constexpr int MIN_SIZE = 32;
+
+private:
+    bool isBlocked(int x, int y) const { return blocked[y * size + x] != 0; }
+
+    void addObstacle(const sf::IntRect &rect);
+
+    void addScatteredObstacles(const sf::IntRect &lane, int freeRow, float obstacleDensity);
+
+    void createFlowfield();
+
+    void createTileLayers();
+
+    // Uniformly distributed number in [0, n). Unlike std::uniform_int_distribution, this is the same with all standard libraries
+    int random(int n) { return static_cast<int>(gen() % static_cast<sf::Uint32>(n)); }
+
+    int size;
+    std::mt19937 gen;
+    std::vector<unsigned char> blocked;
+    std::vector<sf::IntRect> obstacles;
+    // Ordered by their names in the map file (1, 2, 3)
+    std::vector<sf::IntRect> creepSpawnZones;
+    std::vector<sf::Vector2i> playerSpawnPositions;
+    sf::IntRect playerRespawnZone;
+    sf::IntRect creepGoal;
+    sf::IntRect shop;
+    sf::IntRect healingZone;
+    std::vector<ORIENTATIONS> flowfield;
+    // Global tile IDs, as written to the tile layers (0 for empty)
+    std::vector<int> groundTiles;
+    std::vector<int> wallTiles;
+    std::vector<int> decorTiles;
+};
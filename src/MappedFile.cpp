@@ -0,0 +1,74 @@
+#include "MappedFile.h"
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string &filename) : data(nullptr), size(0), fileHandle(nullptr), mappingHandle(nullptr) {
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("Could not open file " + filename);
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        CloseHandle(file);
+        throw std::runtime_error("Could not determine size of file " + filename);
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr) {
+        CloseHandle(file);
+        throw std::runtime_error("Could not map file " + filename);
+    }
+    auto view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view == nullptr) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        throw std::runtime_error("Could not map file " + filename);
+    }
+    fileHandle = file;
+    mappingHandle = mapping;
+    data = static_cast<const char *>(view);
+    size = static_cast<std::size_t>(fileSize.QuadPart);
+}
+
+MappedFile::~MappedFile() {
+    UnmapViewOfFile(data);
+    CloseHandle(static_cast<HANDLE>(mappingHandle));
+    CloseHandle(static_cast<HANDLE>(fileHandle));
+}
+
+#else
+
+MappedFile::MappedFile(const std::string &filename) : data(nullptr), size(0), fileDescriptor(-1) {
+    fileDescriptor = open(filename.c_str(), O_RDONLY);
+    if (fileDescriptor < 0)
+        throw std::runtime_error("Could not open file " + filename);
+    struct stat fileStatus{};
+    if (fstat(fileDescriptor, &fileStatus) != 0 || fileStatus.st_size == 0) {
+        close(fileDescriptor);
+        throw std::runtime_error("Could not determine size of file " + filename);
+    }
+    size = static_cast<std::size_t>(fileStatus.st_size);
+    auto mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+    if (mapping == MAP_FAILED) {
+        close(fileDescriptor);
+        throw std::runtime_error("Could not map file " + filename);
+    }
+    data = static_cast<const char *>(mapping);
+}
+
+MappedFile::~MappedFile() {
+    munmap(const_cast<char *>(data), size);
+    close(fileDescriptor);
+}
+
+#endif
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+/***
+ * Read-only memory mapping of an entire file (mmap on POSIX systems, MapViewOfFile on Windows).
+ * The mapping stays valid for the lifetime of the object. Throws std::runtime_error if the file cannot be mapped.
+ */
+class MappedFile {
+public:
+    explicit MappedFile(const std::string &filename);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const char *getData() const { return data; }
+
+    std::size_t getSize() const { return size; }
+
+private:
+    const char *data;
+    std::size_t size;
+#ifdef _WIN32
+    void *fileHandle;
+    void *mappingHandle;
+#else
+    int fileDescriptor;
+#endif
+};
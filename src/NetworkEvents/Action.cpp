@@ -1,38 +1,53 @@
 #include "Action.h"
+#include "WireFormat.h"
 
 sf::Packet& operator <<(sf::Packet& packet, const Action& a) {
     if (std::holds_alternative<Action::Empty>(a.data))
         throw std::runtime_error("Cannot serialize empty action into packet");
     packet << static_cast<sf::Uint8>(a.data.index());
-    if (const auto* data = std::get_if<Action::MovementKeysChangedAction>(&a.data))
-        packet << data->keyStates[0] << data->keyStates[1] << data->keyStates[2] << data->keyStates[3];
+    if (const auto* data = std::get_if<Action::MovementKeysChangedAction>(&a.data)) {
+        // One bit per key
+        sf::Uint8 keyBits = 0;
+        for (int i = 0; i < 4; i++)
+            if (data->keyStates[i])
+                keyBits |= 1 << i;
+        packet << keyBits;
+    }
     if (const auto* data = std::get_if<Action::AttackCharacterAction>(&a.data))
-        packet << data->targetID;
+        writeVarUint(packet, data->targetID);
     if (const auto* data = std::get_if<Action::BuyItemAction>(&a.data))
         packet << static_cast<sf::Uint8>(data->item);
     if (const auto* data = std::get_if<Action::UsePotionAction>(&a.data))
         packet << static_cast<sf::Uint8>(data->potion);
-    if (const auto* data = std::get_if<Action::UseCharacterTargetSkillAction>(&a.data))
-        packet << data->skillNum << data->targetID;
-    if (const auto* data = std::get_if<Action::UsePositionTargetSkillAction>(&a.data))
-        packet << data->skillNum << static_cast<sf::Int32>(data->targetPosition.x.raw_value()) << static_cast<sf::Int32>(data->targetPosition.y.raw_value());
+    if (const auto* data = std::get_if<Action::UseCharacterTargetSkillAction>(&a.data)) {
+        writeVarUint(packet, data->skillNum);
+        writeVarUint(packet, data->targetID);
+    }
+    if (const auto* data = std::get_if<Action::UsePositionTargetSkillAction>(&a.data)) {
+        writeVarUint(packet, data->skillNum);
+        writeVarInt(packet, data->targetPosition.x.raw_value());
+        writeVarInt(packet, data->targetPosition.y.raw_value());
+    }
     if (const auto* data = std::get_if<Action::UseSelfSkillAction>(&a.data))
-        packet << data->skillNum;
+        writeVarUint(packet, data->skillNum);
     if (const auto* data = std::get_if<Action::UpgradeSkillAction>(&a.data))
-        packet << data->skillNum;
+        writeVarUint(packet, data->skillNum);
     return packet;
 }
 
 sf::Packet& operator >>(sf::Packet& packet, Action& a) {
     sf::Uint8 variantIndex;
-    packet >> variantIndex;
-    if (variantIndex == 0)
-        throw std::runtime_error("Cannot deserialize empty action from packet");
+    if (!(packet >> variantIndex) or variantIndex == 0 or variantIndex >= std::variant_size_v<decltype(a.data)>)
+        throw std::runtime_error("Cannot deserialize empty or unknown action from packet");
     a.data = expand_type(variantIndex, decltype(a.data)());
-    if (auto* data = std::get_if<Action::MovementKeysChangedAction>(&a.data))
-        packet >> data->keyStates[0] >> data->keyStates[1] >> data->keyStates[2] >> data->keyStates[3];
+    if (auto* data = std::get_if<Action::MovementKeysChangedAction>(&a.data)) {
+        sf::Uint8 keyBits;
+        packet >> keyBits;
+        for (int i = 0; i < 4; i++)
+            data->keyStates[i] = (keyBits >> i) & 1;
+    }
     if (auto* data = std::get_if<Action::AttackCharacterAction>(&a.data))
-        packet >> data->targetID;
+        data->targetID = static_cast<sf::Uint32>(readVarUint(packet));
     if (auto* data = std::get_if<Action::BuyItemAction>(&a.data)) {
         sf::Uint8 item;
         packet >> item;
@@ -43,17 +58,47 @@ sf::Packet& operator >>(sf::Packet& packet, Action& a) {
         packet >> potion;
         data->potion = static_cast<POTIONS>(potion);
     }
-    if (auto* data = std::get_if<Action::UseCharacterTargetSkillAction>(&a.data))
-        packet >> data->skillNum >> data->targetID;
+    if (auto* data = std::get_if<Action::UseCharacterTargetSkillAction>(&a.data)) {
+        data->skillNum = static_cast<sf::Uint32>(readVarUint(packet));
+        data->targetID = static_cast<sf::Uint32>(readVarUint(packet));
+    }
     if (auto* data = std::get_if<Action::UsePositionTargetSkillAction>(&a.data)) {
-        sf::Int32 x, y;
-        packet >> data->skillNum >> x >> y;
-        data->targetPosition.x = FPMNum::from_raw_value(x);
-        data->targetPosition.y = FPMNum::from_raw_value(y);
+        data->skillNum = static_cast<sf::Uint32>(readVarUint(packet));
+        data->targetPosition.x = FPMNum::from_raw_value(static_cast<FPMRawValue>(readVarInt(packet)));
+        data->targetPosition.y = FPMNum::from_raw_value(static_cast<FPMRawValue>(readVarInt(packet)));
     }
     if (auto* data = std::get_if<Action::UseSelfSkillAction>(&a.data))
-        packet >> data->skillNum;
+        data->skillNum = static_cast<sf::Uint32>(readVarUint(packet));
     if (auto* data = std::get_if<Action::UpgradeSkillAction>(&a.data))
-        packet >> data->skillNum;
+        data->skillNum = static_cast<sf::Uint32>(readVarUint(packet));
+    if (!packet)
+        throw std::runtime_error("Truncated action in packet");
     return packet;
 }
+
+std::size_t removeSupersededActions(std::queue<std::unique_ptr<Action>>& actions) {
+    std::vector<std::unique_ptr<Action>> remaining;
+    remaining.reserve(actions.size());
+    while (!actions.empty()) {
+        remaining.push_back(std::move(actions.front()));
+        actions.pop();
+    }
+    // Walk backwards, so the first movement or attack action we see is the latest one
+    bool seenMovement = false;
+    bool seenAttack = false;
+    std::size_t numRemoved = 0;
+    for (auto it = remaining.rbegin(); it != remaining.rend(); ++it) {
+        bool& seen = std::holds_alternative<Action::MovementKeysChangedAction>((*it)->data) ? seenMovement : seenAttack;
+        if (std::holds_alternative<Action::MovementKeysChangedAction>((*it)->data) or std::holds_alternative<Action::AttackCharacterAction>((*it)->data)) {
+            if (seen) {
+                it->reset();
+                numRemoved++;
+            }
+            seen = true;
+        }
+    }
+    for (auto& a : remaining)
+        if (a)
+            actions.push(std::move(a));
+    return numRemoved;
+}
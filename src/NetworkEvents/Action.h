@@ -2,6 +2,8 @@
 
 #include <variant>
 #include <array>
+#include <queue>
+#include <memory>
 #include <SFML/Network.hpp>
 #include "../Util.h"
 #include "../GameObjects/Items.h"
@@ -31,7 +33,24 @@ public:
     template <typename T> explicit Action(const T& t) : data(t) { }
 
     std::variant<Empty, MovementKeysChangedAction, AttackCharacterAction, BuyItemAction, UsePotionAction, UseCharacterTargetSkillAction, UsePositionTargetSkillAction, UseSelfSkillAction, UpgradeSkillAction> data;
+
+    // Only for latency tracing (see LatencyTrace.h) and not part of the action's encoding. Locally, takenUS is when the
+    // action was taken. If Game::traceLatency, the host sets the sequence number it was received with, when it was
+    // received and how long it waited for its step (in µs of its clock), and sends these along with the event
+    struct Trace {
+        sf::Uint32 sequence = 0;
+        sf::Int64 takenUS = 0;
+        sf::Int64 hostReceivedUS = 0;
+        sf::Int64 hostWaitUS = 0;
+    };
+    Trace trace;
 };
 
 sf::Packet& operator <<(sf::Packet& packet, const Action& a);
-sf::Packet& operator >>(sf::Packet& packet, Action& a);
\ No newline at end of file
+sf::Packet& operator >>(sf::Packet& packet, Action& a);
+
+// Remove all MovementKeysChangedActions from the queue except for the last one, and the same for AttackCharacterActions.
+// All actions in the queue end up in the same simulation step, where the last movement keys overwrite all earlier ones
+// anyway, and so does the last attack target (Player::startAttacking also stops the movement, just like the earlier
+// ones did). Returns the number of removed actions.
+std::size_t removeSupersededActions(std::queue<std::unique_ptr<Action>>& actions);
\ No newline at end of file
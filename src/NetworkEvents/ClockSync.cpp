@@ -0,0 +1,73 @@
+#include "ClockSync.h"
+#include <algorithm>
+#include <vector>
+#include "../Constants.h"
+#include "../Util.h"
+
+ClockSync::ClockSync() {
+    clear();
+}
+
+void ClockSync::clear() {
+    samples.clear();
+    fitLocalTimeUS = 0;
+    fitOffsetUS = 0;
+    fitDrift = 0;
+}
+
+void ClockSync::addSample(sf::Int64 requestSentUS, sf::Int64 serverReceivedUS, sf::Int64 serverSentUS, sf::Int64 responseReceivedUS) {
+    Sample sample;
+    sample.localTimeUS = requestSentUS + (responseReceivedUS - requestSentUS) / 2;
+    sample.offsetUS = ((serverReceivedUS - requestSentUS) + (serverSentUS - responseReceivedUS)) / 2;
+    sample.delayUS = std::max<sf::Int64>(0, (responseReceivedUS - requestSentUS) - (serverSentUS - serverReceivedUS));
+    samples.push_back(sample);
+    if (samples.size() > CLOCK_SYNC_HISTORY_SAMPLES)
+        samples.pop_front();
+    fit();
+}
+
+void ClockSync::fit() {
+    // Samples that were delayed much more than the fastest one have a large error, so they are left out
+    auto minDelayUS = std::min_element(samples.begin(), samples.end(), [](const auto& a, const auto& b) { return a.delayUS < b.delayUS; })->delayUS;
+    std::vector<const Sample*> used;
+    for (const auto& s : samples) {
+        if (s.delayUS <= minDelayUS + minDelayUS / 2 + CLOCK_SYNC_DELAY_TOLERANCE_MS * 1000)
+            used.push_back(&s);
+    }
+    double meanTimeUS = 0, meanOffsetUS = 0;
+    for (const auto* s : used) {
+        meanTimeUS += static_cast<double>(s->localTimeUS - used.front()->localTimeUS);
+        meanOffsetUS += static_cast<double>(s->offsetUS);
+    }
+    meanTimeUS /= used.size();
+    meanOffsetUS /= used.size();
+    fitLocalTimeUS = used.front()->localTimeUS + static_cast<sf::Int64>(meanTimeUS);
+    fitOffsetUS = meanOffsetUS;
+    fitDrift = 0;
+    // Over a short time span, the noise of the offsets would dominate the slope
+    if (used.size() < 3 or used.back()->localTimeUS - used.front()->localTimeUS < CLOCK_SYNC_MIN_DRIFT_SPAN_MS * 1000)
+        return;
+    double covariance = 0, variance = 0;
+    for (const auto* s : used) {
+        auto dt = static_cast<double>(s->localTimeUS - fitLocalTimeUS);
+        covariance += dt * (static_cast<double>(s->offsetUS) - meanOffsetUS);
+        variance += dt * dt;
+    }
+    if (variance > 0)
+        fitDrift = std::clamp(covariance / variance, -CLOCK_SYNC_MAX_DRIFT_PPM * 1e-6, CLOCK_SYNC_MAX_DRIFT_PPM * 1e-6);
+}
+
+bool ClockSync::isSynchronized() const {
+    return samples.size() >= CLOCK_SYNC_MIN_SAMPLES;
+}
+
+sf::Int64 ClockSync::toServerTimeUS(sf::Int64 localTimeUS) const {
+    return localTimeUS + static_cast<sf::Int64>(fitOffsetUS + fitDrift * static_cast<double>(localTimeUS - fitLocalTimeUS));
+}
+
+std::string ClockSync::toString() const {
+    if (!isSynchronized())
+        return "clock not synchronized";
+    auto minDelayUS = std::min_element(samples.begin(), samples.end(), [](const auto& a, const auto& b) { return a.delayUS < b.delayUS; })->delayUS;
+    return toStr("clock offset ", static_cast<int>(fitOffsetUS / 1000), " ms, drift ", static_cast<int>(fitDrift * 1e6), " ppm, delay ", minDelayUS / 1000, " ms");
+}
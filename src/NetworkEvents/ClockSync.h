@@ -0,0 +1,53 @@
+#pragma once
+
+#include <deque>
+#include <string>
+#include <SFML/System.hpp>
+
+/***
+ * Estimates the server's clock from the client's, like NTP: the client sends its time t0 in a TimeRequest, the server
+ * answers with t0, its receive time t1 and its send time t2, and the client notes the arrival time t3. Then
+ * (t1 - t0 + t2 - t3) / 2 is the offset between the clocks, which is exact if both directions took equally long, and
+ * (t3 - t0) - (t2 - t1) is the round trip delay.
+ *
+ * Queueing (in the network or behind other packets on the same TCP connection) makes the directions asymmetric, and
+ * the error is at most half the delay. So only the samples whose delay is close to the smallest one in the last
+ * CLOCK_SYNC_HISTORY_SAMPLES are used. Through those, a line is fitted (least squares) to also estimate the drift of the
+ * clocks, so the estimate stays accurate between samples instead of jumping whenever a new one arrives.
+ *
+ * All times are in microseconds.
+ */
+class ClockSync {
+public:
+    ClockSync();
+
+    void clear();
+
+    void addSample(sf::Int64 requestSentUS, sf::Int64 serverReceivedUS, sf::Int64 serverSentUS, sf::Int64 responseReceivedUS);
+
+    // True once there are CLOCK_SYNC_MIN_SAMPLES samples
+    bool isSynchronized() const;
+
+    // Estimated time of the server's clock at the given time of the local one
+    sf::Int64 toServerTimeUS(sf::Int64 localTimeUS) const;
+
+    // E.g. "clock offset 12.3 ms, drift 4 ppm, delay 40 ms"
+    std::string toString() const;
+
+private:
+    struct Sample {
+        // Middle of the round trip, where the offset is measured
+        sf::Int64 localTimeUS;
+        sf::Int64 offsetUS;
+        sf::Int64 delayUS;
+    };
+
+    // Fit offsetUS = fitOffsetUS + fitDrift * (localTimeUS - fitLocalTimeUS) through the samples with the smallest delays
+    void fit();
+
+    std::deque<Sample> samples;
+    sf::Int64 fitLocalTimeUS;
+    double fitOffsetUS;
+    // In seconds per second, i.e., 1e-6 is 1 ppm
+    double fitDrift;
+};
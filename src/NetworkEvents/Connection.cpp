@@ -0,0 +1,26 @@
+#include "Connection.h"
+
+TcpConnection::TcpConnection(std::unique_ptr<sf::TcpSocket> socket) : socket(std::move(socket)) {
+    this->socket->setBlocking(false);
+}
+
+sf::Socket::Status TcpConnection::send(sf::Packet& packet) {
+    return socket->send(packet);
+}
+
+sf::Socket::Status TcpConnection::send(const void* data, std::size_t size, std::size_t& sent) {
+    return socket->send(data, size, sent);
+}
+
+sf::Socket::Status TcpConnection::receive(sf::Packet& packet) {
+    return socket->receive(packet);
+}
+
+void TcpConnection::disconnect() {
+    socket->setBlocking(true);
+    socket->disconnect();
+}
+
+sf::IpAddress TcpConnection::getRemoteAddress() const {
+    return socket->getRemoteAddress();
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <memory>
+#include <SFML/Network.hpp>
+
+/***
+ * A reliable, ordered connection carrying sf::Packets, as used by GameServer and GameClient for their game traffic.
+ * All calls are non-blocking and report their result like the corresponding sf::TcpSocket methods.
+ *
+ * TcpConnection sends over a real socket. LoopbackConnection (see LoopbackConnection.h) connects two objects in the
+ * same process and can simulate a bad network, so that a server and several clients can be run together in one
+ * process (see NetworkSoak.h).
+ */
+class Connection {
+public:
+    virtual ~Connection() = default;
+
+    virtual sf::Socket::Status send(sf::Packet& packet) = 0;
+    // Send raw bytes of the stream (e.g. packets that have been encoded beforehand, including the size prefix that
+    // sf::TcpSocket puts in front of each packet). sent is set to the number of bytes accepted
+    virtual sf::Socket::Status send(const void* data, std::size_t size, std::size_t& sent) = 0;
+    virtual sf::Socket::Status receive(sf::Packet& packet) = 0;
+    // Waits until the data sent so far has been handed over, then closes the connection
+    virtual void disconnect() = 0;
+    virtual sf::IpAddress getRemoteAddress() const = 0;
+    // The underlying socket, to wait for it with a SocketPoller. nullptr if there is none, then the connection has to be polled
+    virtual sf::Socket* getSocket() { return nullptr; }
+};
+
+class TcpConnection : public Connection {
+public:
+    // Takes over a connected socket and makes it non-blocking
+    explicit TcpConnection(std::unique_ptr<sf::TcpSocket> socket);
+
+    sf::Socket::Status send(sf::Packet& packet) override;
+    sf::Socket::Status send(const void* data, std::size_t size, std::size_t& sent) override;
+    sf::Socket::Status receive(sf::Packet& packet) override;
+    void disconnect() override;
+    sf::IpAddress getRemoteAddress() const override;
+    sf::Socket* getSocket() override { return socket.get(); }
+
+private:
+    std::unique_ptr<sf::TcpSocket> socket;
+};
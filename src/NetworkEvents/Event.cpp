@@ -1,22 +1,52 @@
 #include "Event.h"
+#include "WireFormat.h"
 
 sf::Packet& operator <<(sf::Packet& packet, const Event& e) {
     if (std::holds_alternative<Event::Empty>(e.data))
         throw std::runtime_error("Cannot serialize empty event into packet");
     packet << static_cast<sf::Uint8>(e.data.index());
-    packet << e.simulationStep;
-    if (const auto* data = std::get_if<Event::PlayerActionEvent>(&e.data))
-        packet << data->characterID << data->action;
+    if (const auto* data = std::get_if<Event::PlayerActionEvent>(&e.data)) {
+        writeVarUint(packet, data->characterID);
+        packet << data->action;
+        // Without latency tracing, this costs a single byte
+        writeVarUint(packet, data->action.trace.sequence);
+        if (data->action.trace.sequence != 0) {
+            writeVarUint(packet, static_cast<sf::Uint64>(data->action.trace.hostReceivedUS / 1000));
+            writeVarUint(packet, static_cast<sf::Uint64>(data->action.trace.hostWaitUS / 1000));
+        }
+    }
+    if (const auto* data = std::get_if<Event::InputDelayChangedEvent>(&e.data))
+        packet << data->steps;
+    if (const auto* data = std::get_if<Event::PlayerJoinedEvent>(&e.data))
+        packet << data->name << static_cast<sf::Uint8>(data->characterType);
     return packet;
 }
 
 sf::Packet& operator >>(sf::Packet& packet, Event& e) {
     sf::Uint8 variantIndex;
-    packet >> variantIndex >> e.simulationStep;
-    if (variantIndex == 0)
-        throw std::runtime_error("Cannot deserialize empty event from packet");
+    if (!(packet >> variantIndex) or variantIndex == 0 or variantIndex >= std::variant_size_v<decltype(e.data)>)
+        throw std::runtime_error("Cannot deserialize empty or unknown event from packet");
     e.data = expand_type(variantIndex, decltype(e.data)());
-    if (auto* data = std::get_if<Event::PlayerActionEvent>(&e.data))
-        packet >> data->characterID >> data->action;
+    if (auto* data = std::get_if<Event::PlayerActionEvent>(&e.data)) {
+        data->characterID = static_cast<sf::Uint32>(readVarUint(packet));
+        packet >> data->action;
+        data->action.trace.sequence = static_cast<sf::Uint32>(readVarUint(packet));
+        if (data->action.trace.sequence != 0) {
+            data->action.trace.hostReceivedUS = static_cast<sf::Int64>(readVarUint(packet)) * 1000;
+            data->action.trace.hostWaitUS = static_cast<sf::Int64>(readVarUint(packet)) * 1000;
+        }
+    }
+    if (auto* data = std::get_if<Event::InputDelayChangedEvent>(&e.data)) {
+        packet >> data->steps;
+        if (data->steps == 0)
+            throw std::runtime_error("Invalid input delay in event");
+    }
+    if (auto* data = std::get_if<Event::PlayerJoinedEvent>(&e.data)) {
+        sf::Uint8 characterType;
+        packet >> data->name >> characterType;
+        if (characterType >= static_cast<sf::Uint8>(CHARACTERS::CHARACTERS_COUNT))
+            throw std::runtime_error("Invalid character type in event");
+        data->characterType = static_cast<CHARACTERS>(characterType);
+    }
     return packet;
 }
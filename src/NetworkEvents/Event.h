@@ -5,14 +5,15 @@
 #include "../Render/AnimatedTileset.h"
 #include "../Util.h"
 #include "../GameObjects/Items.h"
+#include "../GameObjects/Character.h"
 #include "Action.h"
 
 /***
  * Events are all the interactions etc. in the game, which do not result deterministically from the
  * objects' states or random seed. Mostly, these correspond to players' Actions.
- * Each event contains the simulationStep that it occurs in. There is a special NoMoreEvents-Event which is
- * the last one sent for a simulationStep. Once this last event has ben received, the corresponding
- * simulationStep can be executed by the game.
+ * Each event contains the simulationStep that it occurs in. Events are sent to the clients in EventBatches, which
+ * also mark the end of their simulation steps. Once the batch containing a simulationStep has been received,
+ * that step can be executed by the game.
  *
  * When adding new types of events, a corresponding subclass must be created, added to the internal std::variant's
  * list of possible values, and code for (de-)serializing the event from/to packets must be written in the
@@ -22,7 +23,10 @@ class Event {
 public:
     struct Empty { };
     struct PlayerActionEvent { sf::Uint32 characterID; Action action; };
-    struct NoMoreEvents { };
+    // Published by the server whenever it changes how many steps ahead it schedules events (see Game::inputDelaySteps)
+    struct InputDelayChangedEvent { sf::Uint8 steps; };
+    // A player joined the running game and gets the next character ID (i.e., playerCharacters.size())
+    struct PlayerJoinedEvent { std::string name; CHARACTERS characterType; };
 
     Event() : data(Empty()), simulationStep(0) { }
 
@@ -31,8 +35,9 @@ public:
 
     sf::Uint32 simulationStep;
 
-    std::variant<Empty, PlayerActionEvent, NoMoreEvents> data;
+    std::variant<Empty, PlayerActionEvent, InputDelayChangedEvent, PlayerJoinedEvent> data;
 };
 
+// Note: The simulationStep is not (de-)serialized here, since EventBatch encodes it more compactly relative to the previous event
 sf::Packet& operator <<(sf::Packet& packet, const Event& e);
 sf::Packet& operator >>(sf::Packet& packet, Event& e);
\ No newline at end of file
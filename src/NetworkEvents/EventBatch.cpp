@@ -0,0 +1,61 @@
+#include "EventBatch.h"
+#include "WireFormat.h"
+
+void EventBatch::clear() {
+    firstStep = 0;
+    lastStep = 0;
+    events.clear();
+}
+
+void EventBatch::addStep(sf::Uint32 simulationStep, const std::list<std::unique_ptr<Event>>& stepEvents) {
+    addStep(simulationStep, std::vector<Event>());
+    for (const auto& e : stepEvents)
+        events.push_back(*e);
+}
+
+void EventBatch::addStep(sf::Uint32 simulationStep, const std::vector<Event>& stepEvents) {
+    if (isEmpty())
+        firstStep = simulationStep;
+    else if (simulationStep != lastStep + 1)
+        throw std::runtime_error("Simulation steps in an EventBatch must be consecutive");
+    lastStep = simulationStep;
+    events.insert(events.end(), stepEvents.begin(), stepEvents.end());
+}
+
+sf::Packet& operator <<(sf::Packet& packet, const EventBatch& b) {
+    if (b.isEmpty())
+        throw std::runtime_error("Cannot serialize empty event batch into packet");
+    // Steps are sent as deltas: lastStep relative to firstStep, and each event's step relative to the previous event
+    writeVarUint(packet, b.firstStep);
+    writeVarUint(packet, b.lastStep - b.firstStep);
+    writeVarUint(packet, b.events.size());
+    auto previousStep = b.firstStep;
+    for (const auto& e : b.events) {
+        writeVarUint(packet, e.simulationStep - previousStep);
+        packet << e;
+        previousStep = e.simulationStep;
+    }
+    return packet;
+}
+
+sf::Packet& operator >>(sf::Packet& packet, EventBatch& b) {
+    b.firstStep = static_cast<sf::Uint32>(readVarUint(packet));
+    b.lastStep = b.firstStep + static_cast<sf::Uint32>(readVarUint(packet));
+    auto numEvents = readVarUint(packet);
+    if (b.firstStep == 0 or b.lastStep < b.firstStep)
+        throw std::runtime_error("Invalid step range in event batch");
+    if (numEvents > packet.getDataSize())
+        throw std::runtime_error("Invalid number of events in event batch");
+    b.events.resize(numEvents);
+    auto previousStep = b.firstStep;
+    for (auto& e : b.events) {
+        e.simulationStep = previousStep + static_cast<sf::Uint32>(readVarUint(packet));
+        packet >> e;
+        if (e.simulationStep > b.lastStep)
+            throw std::runtime_error("Event outside of the step range of its batch");
+        previousStep = e.simulationStep;
+    }
+    if (!packet)
+        throw std::runtime_error("Truncated event batch");
+    return packet;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <list>
+#include <vector>
+#include <memory>
+#include <SFML/Network.hpp>
+#include "Event.h"
+
+/***
+ * All events of a range of consecutive simulation steps [firstStep, lastStep]. The server sends each client a single
+ * EventBatch packet for all steps that became ready since the last packet to that client.
+ *
+ * Receiving a batch means that all steps up to lastStep are complete and can be simulated. So steps without any
+ * events (which are the majority) take no space apart from the range itself.
+ */
+class EventBatch {
+public:
+    EventBatch() : firstStep(0), lastStep(0) { }
+
+    bool isEmpty() const { return lastStep == 0; }
+
+    void clear();
+
+    // Append the events of the next simulation step (which must directly follow lastStep unless the batch is empty)
+    void addStep(sf::Uint32 simulationStep, const std::list<std::unique_ptr<Event>>& stepEvents);
+    void addStep(sf::Uint32 simulationStep, const std::vector<Event>& stepEvents);
+
+    sf::Uint32 firstStep;
+    sf::Uint32 lastStep;
+    std::vector<Event> events;
+};
+
+sf::Packet& operator <<(sf::Packet& packet, const EventBatch& b);
+sf::Packet& operator >>(sf::Packet& packet, EventBatch& b);
@@ -0,0 +1,43 @@
+#pragma once
+/***
+ * IDs for the different types of messages exchanged between server and clients in the GameServer and GameClient classes.
+ *
+ * Over TCP, the server sends EventBatch and the clients send Actions packets.
+ * If UDP is enabled, the same data is also sent as datagrams, each of which repeats everything the other side has not
+ * acknowledged yet:
+ * EventWindow datagrams contain the events of the last UDP_REDUNDANT_STEPS steps not yet acknowledged by the client,
+ * ActionWindow datagrams contain all actions not yet acknowledged by the server (at most UDP_MAX_UNACKED_ACTIONS).
+ * Since actions are numbered and steps are ordered, whatever arrives first over either transport is used and the rest
+ * is discarded. So a lost datagram is covered by the next one, and TCP guarantees delivery if UDP does not get through.
+ *
+ * The latest complete simulation step in the clients' packets acknowledges the received events. The server also uses it
+ * to measure round trip times for choosing the input delay. Without UDP, clients send an Actions packet without any
+ * actions after completing a step, so that the acknowledgement is not delayed until the next action.
+ *
+ * To pace their simulation by the host's clock, clients regularly send a TimeRequest over TCP, which the server answers
+ * with a TimeResponse (see ClockSync.h). Times are in microseconds of the respective clock.
+ *
+ * At the start of the game, each player sends Ready once it has loaded the game and synchronized its clock. When all
+ * players are ready, the server sends everyone MatchStart with the time on its clock at which step 0 begins, and only
+ * then starts creating steps. Players connecting later get MatchStart before their first events.
+ *
+ * Clients joining a running game first get the host's latest checkpoint (see Game::saveCheckpoint) in Checkpoint
+ * packets, unless there is none yet, and then EventBatches starting with the step after it.
+ */
+
+#include <SFML/Network.hpp>
+
+enum class GameServerToClientPacketTypes : sf::Uint8 {
+    EventBatch,     // EventBatch
+    EventWindow,    // varuint last action sequence number received from this client, EventBatch
+    TimeResponse,   // Int64 client time of the request, Int64 server time of receiving it, Int64 server time of sending the response
+    MatchStart,     // Int64 server time at which step 0 begins
+    Checkpoint      // Uint32 step, Uint32 total size of the checkpoint, Uint32 offset of this chunk, std::string chunk
+};
+
+enum class GameClientToServerPacketTypes : sf::Uint8 {
+    Actions,        // varuint latest complete simulation step, varuint sequence number of the first action, Uint8 number of actions, actions
+    ActionWindow,   // Uint8 character index, then like Actions
+    TimeRequest,    // Int64 client time of sending this request
+    Ready           // no data
+};
@@ -0,0 +1,55 @@
+#include "LatencyTrace.h"
+#include <algorithm>
+#include "../Constants.h"
+
+void LatencyTrace::clear() {
+    sentActions.clear();
+    for (auto& s : samplesMS)
+        s.clear();
+}
+
+void LatencyTrace::actionSent(sf::Uint32 sequence, sf::Int64 takenUS, sf::Int64 sentUS) {
+    sentActions[sequence] = {takenUS, sentUS};
+    // If the host does not trace, no action ever comes back with its sequence number
+    while (sentActions.size() > LATENCY_TRACE_MAX_PENDING_ACTIONS)
+        sentActions.erase(sentActions.begin());
+}
+
+void LatencyTrace::actionExecuted(const Action::Trace& trace, sf::Int64 executedUS, const std::function<std::optional<sf::Int64>(sf::Int64)>& toHostTimeUS) {
+    auto entry = sentActions.find(trace.sequence);
+    if (entry == sentActions.end())
+        return;
+    auto sent = entry->second;
+    sentActions.erase(sentActions.begin(), std::next(entry));
+    auto addSample = [this](STAGES stage, sf::Int64 durationUS) {
+        samplesMS[stage].push_back(static_cast<float>(durationUS) / 1000);
+        if (samplesMS[stage].size() > LATENCY_TRACE_HISTORY_ACTIONS)
+            samplesMS[stage].pop_front();
+    };
+    addSample(TOTAL, executedUS - sent.takenUS);
+    auto sentHostUS = toHostTimeUS(sent.sentUS);
+    auto executedHostUS = toHostTimeUS(executedUS);
+    if (!sentHostUS or !executedHostUS)
+        return;
+    // With an error of the clock estimate, the network and simulation wait may come out slightly negative
+    addSample(QUEUEING, sent.sentUS - sent.takenUS);
+    addSample(NETWORK, trace.hostReceivedUS - *sentHostUS);
+    addSample(SERVER_WAIT, trace.hostWaitUS);
+    addSample(SIMULATION_WAIT, *executedHostUS - (trace.hostReceivedUS + trace.hostWaitUS));
+}
+
+std::string LatencyTrace::describeStage(STAGES stage, const char* name) const {
+    if (samplesMS[stage].empty())
+        return toStr(name, " -");
+    std::vector<float> sorted(samplesMS[stage].begin(), samplesMS[stage].end());
+    std::sort(sorted.begin(), sorted.end());
+    auto percentile = [&sorted](float p) { return static_cast<int>(sorted[std::min<std::size_t>(sorted.size() - 1, static_cast<std::size_t>(p * sorted.size()))]); };
+    return toStr(name, " ", percentile(0.5f), "/", percentile(0.9f), "/", percentile(0.99f), "/", static_cast<int>(sorted.back()), " ms");
+}
+
+std::vector<std::string> LatencyTrace::describe() const {
+    if (samplesMS[TOTAL].empty())
+        return {};
+    return {toStr("Input latency p50/p90/p99/max of ", samplesMS[TOTAL].size(), " actions: ", describeStage(TOTAL, "total"), ", ", describeStage(QUEUEING, "queueing")),
+            toStr("  ", describeStage(NETWORK, "network"), ", ", describeStage(SERVER_WAIT, "server wait"), ", ", describeStage(SIMULATION_WAIT, "simulation wait"))};
+}
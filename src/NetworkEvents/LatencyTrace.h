@@ -0,0 +1,49 @@
+#pragma once
+
+#include <map>
+#include <array>
+#include <deque>
+#include <string>
+#include <vector>
+#include <optional>
+#include <functional>
+#include "Action.h"
+
+/***
+ * Measures how long the local player's actions take from the input to the simulation step in which they are executed
+ * (only if the host sets Game::traceLatency), split into the stages they pass:
+ *  - queueing: from the input until the action is sent (or, on the host, handed to the network thread)
+ *  - network: until the host's network thread has received it
+ *  - server wait: until the host has created the step with the action's event
+ *  - simulation wait: until that step is executed locally (the input delay, and the time for the step to arrive)
+ *
+ * The action's sequence number serves as the trace ID. Actions merged on the way (removeSupersededActions) are never
+ * executed; their pending entries are forgotten once a later action arrives. The stages on both sides of the network
+ * are compared on the host's clock, so they are only measured once that is known (see ClockSync.h); the total does not
+ * need it.
+ */
+class LatencyTrace {
+public:
+    void clear();
+
+    // The action with the given sequence number was taken at takenUS and sent at sentUS (both local times)
+    void actionSent(sf::Uint32 sequence, sf::Int64 takenUS, sf::Int64 sentUS);
+    // An own action was executed at executedUS. toHostTimeUS converts local times to the host's, if known
+    void actionExecuted(const Action::Trace& trace, sf::Int64 executedUS, const std::function<std::optional<sf::Int64>(sf::Int64)>& toHostTimeUS);
+
+    // Percentiles of each stage over the last LATENCY_TRACE_HISTORY_ACTIONS actions, empty if none was traced yet
+    std::vector<std::string> describe() const;
+
+private:
+    struct SentAction {
+        sf::Int64 takenUS;
+        sf::Int64 sentUS;
+    };
+    enum STAGES {TOTAL, QUEUEING, NETWORK, SERVER_WAIT, SIMULATION_WAIT, NUM_STAGES};
+
+    std::string describeStage(STAGES stage, const char* name) const;
+
+    std::map<sf::Uint32, SentAction> sentActions;
+    // In ms, the stages other than TOTAL only for actions executed while the host's clock was known
+    std::array<std::deque<float>, NUM_STAGES> samplesMS;
+};
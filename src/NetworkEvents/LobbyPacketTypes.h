@@ -1,6 +1,17 @@
 #pragma once
 /***
  * IDs for the different types of messages exchanged between server and clients in the Lobby classes.
+ * UpdatePlayerName packets start with NETWORK_PROTOCOL_VERSION and FPM_FRACTION_BITS, so that clients with an
+ * incompatible build are turned away before the game starts. After the name and character type, they contain a Uint8
+ * that is 1 for spectators (who get no character and are not part of the players list), and a Uint64 reconnect token
+ * (0 if the client has none for this host and name).
+ * StartGame packets contain the random seed, the server's UDP port (0 if the server does not use UDP) and a Uint32 step
+ * up to which the client has to catch up. That step is 0, unless the client joins a game that is already running. Then,
+ * the players list sent right before is the one from the game's start, and the server streams its latest checkpoint
+ * and the events since then.
+ * Next is the host's Tilemap::getContentHash. Clients with a different map refuse to start the game.
+ * The last field is the client's reconnect token (0 for spectators). A client that has lost the connection can only
+ * take its character back by joining again with the same name and this token.
  */
 
 #include <SFML/Network.hpp>
@@ -0,0 +1,89 @@
+#include "LoopbackConnection.h"
+#include <algorithm>
+#include "../Constants.h"
+
+std::pair<std::unique_ptr<LoopbackConnection>, std::unique_ptr<LoopbackConnection>> LoopbackConnection::createPair(const NetworkProfile& profile, unsigned int seed) {
+    auto aToB = std::make_shared<Pipe>();
+    auto bToA = std::make_shared<Pipe>();
+    aToB->profile = bToA->profile = profile;
+    aToB->gen.seed(seed);
+    bToA->gen.seed(seed + 1);
+    aToB->linkFreeTime = bToA->linkFreeTime = Clock::now();
+    // The constructor is private, so std::make_unique cannot be used
+    return {std::unique_ptr<LoopbackConnection>(new LoopbackConnection(aToB, bToA)),
+            std::unique_ptr<LoopbackConnection>(new LoopbackConnection(bToA, aToB))};
+}
+
+LoopbackConnection::LoopbackConnection(std::shared_ptr<Pipe> outgoing, std::shared_ptr<Pipe> incoming)
+        : outgoing(std::move(outgoing)), incoming(std::move(incoming)) { }
+
+sf::Socket::Status LoopbackConnection::send(sf::Packet& packet) {
+    // Same framing as sf::TcpSocket: the size as 32 bit integer in network byte order, then the data
+    auto size = static_cast<sf::Uint32>(packet.getDataSize());
+    std::vector<char> frame;
+    frame.reserve(sizeof(size) + size);
+    for (int shift = 24; shift >= 0; shift -= 8)
+        frame.push_back(static_cast<char>((size >> shift) & 0xFF));
+    auto data = static_cast<const char*>(packet.getData());
+    frame.insert(frame.end(), data, data + size);
+    std::size_t sent;
+    return send(frame.data(), frame.size(), sent);
+}
+
+sf::Socket::Status LoopbackConnection::send(const void* data, std::size_t size, std::size_t& sent) {
+    sent = 0;
+    auto& pipe = *outgoing;
+    std::lock_guard<std::mutex> lock(pipe.mutex);
+    if (pipe.isClosed)
+        return sf::Socket::Disconnected;
+    auto now = Clock::now();
+    // The segment occupies the link for its transmission time, then travels for the latency plus jitter
+    auto transmissionStart = std::max(now, pipe.linkFreeTime);
+    pipe.linkFreeTime = transmissionStart;
+    if (pipe.profile.bytesPerSecond != 0)
+        pipe.linkFreeTime += std::chrono::microseconds(static_cast<sf::Int64>(size) * 1000000 / pipe.profile.bytesPerSecond);
+    auto delayMS = pipe.profile.latencyMS + std::uniform_int_distribution<unsigned int>(0, pipe.profile.jitterMS)(pipe.gen);
+    std::uniform_real_distribution<float> lossDistribution(0.f, 1.f);
+    while (pipe.profile.lossRate > 0 and lossDistribution(pipe.gen) < pipe.profile.lossRate)
+        delayMS += LOOPBACK_RETRANSMISSION_MS;
+    auto deliveryTime = pipe.linkFreeTime + std::chrono::milliseconds(delayMS);
+    // Delivery is in order, so a delayed segment holds up the following ones
+    if (!pipe.inFlight.empty())
+        deliveryTime = std::max(deliveryTime, pipe.inFlight.back().deliveryTime);
+    auto bytes = static_cast<const char*>(data);
+    pipe.inFlight.push_back({deliveryTime, std::vector<char>(bytes, bytes + size)});
+    sent = size;
+    return sf::Socket::Done;
+}
+
+sf::Socket::Status LoopbackConnection::receive(sf::Packet& packet) {
+    auto& pipe = *incoming;
+    std::lock_guard<std::mutex> lock(pipe.mutex);
+    auto now = Clock::now();
+    while (!pipe.inFlight.empty() and pipe.inFlight.front().deliveryTime <= now) {
+        pipe.delivered.insert(pipe.delivered.end(), pipe.inFlight.front().data.begin(), pipe.inFlight.front().data.end());
+        pipe.inFlight.pop_front();
+    }
+    sf::Uint32 size = 0;
+    if (pipe.delivered.size() >= sizeof(size)) {
+        for (std::size_t i = 0; i < sizeof(size); i++)
+            size = (size << 8) | static_cast<unsigned char>(pipe.delivered[i]);
+        if (pipe.delivered.size() >= sizeof(size) + size) {
+            packet.clear();
+            packet.append(pipe.delivered.data() + sizeof(size), size);
+            pipe.delivered.erase(pipe.delivered.begin(), pipe.delivered.begin() + sizeof(size) + size);
+            return sf::Socket::Done;
+        }
+    }
+    if (pipe.isClosed and pipe.inFlight.empty())
+        return sf::Socket::Disconnected;
+    return sf::Socket::NotReady;
+}
+
+void LoopbackConnection::disconnect() {
+    // Data already in flight is still delivered
+    for (auto* pipe : {outgoing.get(), incoming.get()}) {
+        std::lock_guard<std::mutex> lock(pipe->mutex);
+        pipe->isClosed = true;
+    }
+}
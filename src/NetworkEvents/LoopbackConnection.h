@@ -0,0 +1,68 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <string>
+#include <mutex>
+#include "Connection.h"
+
+/***
+ * Conditions of a simulated network link (in each direction).
+ * Since the connection is reliable like TCP, a lost segment is not dropped but delivered after LOOPBACK_RETRANSMISSION_MS
+ * (once for each time it is lost), and everything sent after it waits for it.
+ */
+struct NetworkProfile {
+    std::string name;
+    unsigned int latencyMS;
+    // Every segment is delayed by up to this many ms more, uniformly distributed
+    unsigned int jitterMS;
+    float lossRate;
+    // 0 for unlimited
+    unsigned int bytesPerSecond;
+};
+
+/***
+ * One end of an in-process connection, see Connection. Each send call is one segment, which arrives at the other end
+ * once its simulated transmission and delivery time has passed. The other end reassembles packets from the delivered
+ * bytes just like sf::TcpSocket, so raw sends of encoded packets work the same as over TCP.
+ * The two ends may be used from different threads (e.g., GameServer's network thread and a client's game loop).
+ */
+class LoopbackConnection : public Connection {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Creates the two ends of a connection with the given conditions
+    static std::pair<std::unique_ptr<LoopbackConnection>, std::unique_ptr<LoopbackConnection>> createPair(const NetworkProfile& profile, unsigned int seed);
+
+    sf::Socket::Status send(sf::Packet& packet) override;
+    sf::Socket::Status send(const void* data, std::size_t size, std::size_t& sent) override;
+    sf::Socket::Status receive(sf::Packet& packet) override;
+    void disconnect() override;
+    sf::IpAddress getRemoteAddress() const override { return sf::IpAddress::LocalHost; }
+
+private:
+    // The data sent in one direction
+    struct Pipe {
+        struct Segment {
+            Clock::time_point deliveryTime;
+            std::vector<char> data;
+        };
+        NetworkProfile profile;
+        std::mt19937 gen;
+        std::deque<Segment> inFlight;
+        // Delivered bytes not yet taken by receive
+        std::vector<char> delivered;
+        // When the link has finished transmitting the previous segment (for the bandwidth limit)
+        Clock::time_point linkFreeTime;
+        bool isClosed = false;
+        // Guards everything above, since the sender and the receiver may be on different threads
+        std::mutex mutex;
+    };
+
+    LoopbackConnection(std::shared_ptr<Pipe> outgoing, std::shared_ptr<Pipe> incoming);
+
+    std::shared_ptr<Pipe> outgoing;
+    std::shared_ptr<Pipe> incoming;
+};
@@ -0,0 +1,166 @@
+#include "SocketPoller.h"
+#include <stdexcept>
+#include <algorithm>
+#include "../Constants.h"
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    // sf::Socket::getHandle is protected. A pointer to it can be formed in a derived class and applied to any socket
+    struct HandleAccess : sf::Socket {
+        static sf::SocketHandle get(const sf::Socket& socket) {
+            return (socket.*(&HandleAccess::getHandle))();
+        }
+    };
+}
+
+sf::SocketHandle SocketPoller::getHandle(const sf::Socket& socket) {
+    return HandleAccess::get(socket);
+}
+
+bool SocketPoller::isReadable(sf::Socket* socket) const {
+    return !socket or registered.count(getHandle(*socket)) == 0 or readable.count(getHandle(*socket)) != 0;
+}
+
+bool SocketPoller::isWritable(sf::Socket* socket) const {
+    return !socket or registered.count(getHandle(*socket)) == 0 or writable.count(getHandle(*socket)) != 0;
+}
+
+#ifdef __linux__
+
+SocketPoller::SocketPoller() : epollFD(epoll_create1(EPOLL_CLOEXEC)), wakeFD(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+    if (epollFD < 0 or wakeFD < 0)
+        throw std::runtime_error("Could not create epoll instance");
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = wakeFD;
+    if (epoll_ctl(epollFD, EPOLL_CTL_ADD, wakeFD, &event) != 0)
+        throw std::runtime_error("Could not watch eventfd");
+}
+
+SocketPoller::~SocketPoller() {
+    close(wakeFD);
+    close(epollFD);
+}
+
+void SocketPoller::add(sf::Socket* socket) {
+    if (!socket or registered.count(getHandle(*socket)) != 0)
+        return;
+    auto handle = getHandle(*socket);
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = handle;
+    if (epoll_ctl(epollFD, EPOLL_CTL_ADD, handle, &event) != 0)
+        throw std::runtime_error("Could not watch socket");
+    registered[handle] = false;
+}
+
+void SocketPoller::remove(sf::Socket* socket) {
+    if (!socket)
+        return;
+    auto handle = getHandle(*socket);
+    if (registered.erase(handle) == 0)
+        return;
+    epoll_ctl(epollFD, EPOLL_CTL_DEL, handle, nullptr);
+    readable.erase(handle);
+    writable.erase(handle);
+}
+
+void SocketPoller::setWantWrite(sf::Socket* socket, bool wantWrite) {
+    if (!socket)
+        return;
+    auto entry = registered.find(getHandle(*socket));
+    if (entry == registered.end() or entry->second == wantWrite)
+        return;
+    epoll_event event{};
+    event.events = wantWrite ? EPOLLIN | EPOLLOUT : EPOLLIN;
+    event.data.fd = entry->first;
+    if (epoll_ctl(epollFD, EPOLL_CTL_MOD, entry->first, &event) != 0)
+        throw std::runtime_error("Could not change watched events of socket");
+    entry->second = wantWrite;
+}
+
+void SocketPoller::wait(sf::Time timeout) {
+    readable.clear();
+    writable.clear();
+    std::vector<epoll_event> events(std::max<std::size_t>(registered.size() + 1, 1));
+    auto numEvents = epoll_wait(epollFD, events.data(), static_cast<int>(events.size()), std::max(0, timeout.asMilliseconds()));
+    for (int i = 0; i < numEvents; i++) {
+        auto fd = events[i].data.fd;
+        if (fd == wakeFD) {
+            eventfd_t value;
+            eventfd_read(wakeFD, &value);
+            continue;
+        }
+        // Errors and hangups show up as readable, so that the next receive reports them
+        if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+            readable.insert(fd);
+        if (events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+            writable.insert(fd);
+    }
+}
+
+void SocketPoller::wake() {
+    eventfd_write(wakeFD, 1);
+}
+
+#else
+
+SocketPoller::SocketPoller() = default;
+
+SocketPoller::~SocketPoller() = default;
+
+void SocketPoller::add(sf::Socket* socket) {
+    if (!socket or registered.count(getHandle(*socket)) != 0)
+        return;
+    selector.add(*socket);
+    registered[getHandle(*socket)] = false;
+    sockets[getHandle(*socket)] = socket;
+}
+
+void SocketPoller::remove(sf::Socket* socket) {
+    if (!socket)
+        return;
+    auto handle = getHandle(*socket);
+    if (registered.erase(handle) == 0)
+        return;
+    selector.remove(*socket);
+    sockets.erase(handle);
+    readable.erase(handle);
+    writable.erase(handle);
+}
+
+void SocketPoller::setWantWrite(sf::Socket* socket, bool wantWrite) {
+    if (socket and registered.count(getHandle(*socket)) != 0)
+        registered[getHandle(*socket)] = wantWrite;
+}
+
+void SocketPoller::wait(sf::Time timeout) {
+    readable.clear();
+    writable.clear();
+    // sf::SocketSelector cannot wait for writability, so sockets that want to write are retried every tick
+    if (std::any_of(registered.begin(), registered.end(), [](const auto& r) { return r.second; }))
+        timeout = std::min(timeout, sf::milliseconds(NETWORK_THREAD_TICK_MS));
+    // For sf::SocketSelector, a timeout of zero means waiting forever
+    timeout = std::max(timeout, sf::microseconds(1));
+    if (registered.empty())
+        sf::sleep(timeout);
+    else if (selector.wait(timeout)) {
+        for (const auto& s : sockets) {
+            if (selector.isReady(*s.second))
+                readable.insert(s.first);
+        }
+    }
+    for (const auto& r : registered)
+        writable.insert(r.first);
+}
+
+void SocketPoller::wake() {
+    // Not supported by sf::SocketSelector, so the caller has to keep its timeouts short
+}
+
+#endif
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <SFML/Network.hpp>
+
+/***
+ * Waits until one of a set of sockets is ready, so that a network loop can sleep instead of polling all its sockets
+ * with non-blocking calls. On Linux, this is an epoll instance (level-triggered) plus an eventfd for wake(), so the
+ * cost of a wait does not depend on the number of idle sockets. Elsewhere, it falls back to sf::SocketSelector, which
+ * cannot wait for writability or be woken up; there, sockets count as always writable, and wait returns after at
+ * most NETWORK_THREAD_TICK_MS while any socket wants to write.
+ *
+ * A registered socket stays registered when its owner changes (e.g. when the std::unique_ptr<sf::TcpSocket> of a
+ * joining client is handed to a TcpConnection). It must be removed before it is closed or destroyed, though.
+ */
+class SocketPoller {
+public:
+    SocketPoller();
+    ~SocketPoller();
+
+    SocketPoller(const SocketPoller&) = delete;
+    SocketPoller& operator=(const SocketPoller&) = delete;
+
+    // Watch the socket for incoming data (or connections, for a listener). Does nothing for nullptr or if already added
+    void add(sf::Socket* socket);
+    void remove(sf::Socket* socket);
+    // Also watch the socket for space in its send buffer, e.g. while a packet has only been sent partially
+    void setWantWrite(sf::Socket* socket, bool wantWrite);
+
+    // Block until a socket is ready, wake() is called, or the timeout has passed
+    void wait(sf::Time timeout);
+    // Results of the last wait. Sockets that are not registered are always ready
+    bool isReadable(sf::Socket* socket) const;
+    bool isWritable(sf::Socket* socket) const;
+
+    // May be called from any thread, to make a current or the next wait return immediately
+    void wake();
+
+    // The OS handle of any SFML socket (sf::Socket::getHandle is protected)
+    static sf::SocketHandle getHandle(const sf::Socket& socket);
+
+private:
+
+    // Registered sockets and whether they want to write
+    std::unordered_map<sf::SocketHandle, bool> registered;
+    std::unordered_set<sf::SocketHandle> readable;
+    std::unordered_set<sf::SocketHandle> writable;
+#ifdef __linux__
+    int epollFD;
+    int wakeFD;
+#else
+    sf::SocketSelector selector;
+    std::unordered_map<sf::SocketHandle, sf::Socket*> sockets;
+#endif
+};
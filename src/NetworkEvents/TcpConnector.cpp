@@ -0,0 +1,196 @@
+#include "TcpConnector.h"
+#include <cmath>
+#include <thread>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+#include "SocketPoller.h"
+#include "../Constants.h"
+#include "../Util.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#endif
+
+namespace {
+    // All IPv4 addresses of the host (sf::IpAddress only returns the first one), in the order of the resolver
+    std::vector<sf::IpAddress> resolve(const std::string& host, std::string& error) {
+        addrinfo hints{};
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* result = nullptr;
+        auto code = getaddrinfo(host.c_str(), nullptr, &hints, &result);
+        if (code != 0) {
+            error = gai_strerror(code);
+            return {};
+        }
+        std::vector<sf::IpAddress> addresses;
+        for (auto info = result; info; info = info->ai_next) {
+            sf::IpAddress address(ntohl(reinterpret_cast<sockaddr_in*>(info->ai_addr)->sin_addr.s_addr));
+            if (std::find(addresses.begin(), addresses.end(), address) == addresses.end())
+                addresses.push_back(address);
+        }
+        freeaddrinfo(result);
+        if (addresses.empty())
+            error = "no IPv4 address";
+        return addresses;
+    }
+
+    // The error of a failed non-blocking connect, empty while it is pending or once it succeeded
+    std::string getConnectError(const sf::TcpSocket& socket) {
+        int error = 0;
+#ifdef _WIN32
+        int length = sizeof(error);
+        getsockopt(SocketPoller::getHandle(socket), SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&error), &length);
+        return error == 0 ? "" : toStr("error ", error);
+#else
+        socklen_t length = sizeof(error);
+        getsockopt(SocketPoller::getHandle(socket), SOL_SOCKET, SO_ERROR, &error, &length);
+        return error == 0 ? "" : std::strerror(error);
+#endif
+    }
+}
+
+TcpConnector::TcpConnector(const std::string& host, unsigned short port) : host(host), port(port), status(STATUS::CONNECTING),
+        round(0), backoff(sf::milliseconds(CONNECT_RETRY_BACKOFF_MS)), waitingForBackoff(false), resolving(false), nextAddress(0) {
+    startRound();
+}
+
+void TcpConnector::startRound() {
+    round++;
+    roundClock.restart();
+    attempts.clear();
+    addresses.clear();
+    nextAddress = 0;
+    resolving = true;
+    resolution = std::make_shared<Resolution>();
+    std::thread([resolution = resolution, host = host]() {
+        std::string error;
+        auto addresses = resolve(host, error);
+        std::lock_guard<std::mutex> lock(resolution->mutex);
+        resolution->addresses = std::move(addresses);
+        resolution->error = std::move(error);
+        resolution->done = true;
+    }).detach();
+}
+
+void TcpConnector::startAttempt() {
+    Attempt attempt;
+    attempt.socket = std::make_unique<sf::TcpSocket>();
+    attempt.socket->setBlocking(false);
+    attempt.address = addresses[nextAddress++];
+    staggerClock.restart();
+    // Non-blocking, connect returns NotReady while the connection is being established
+    switch (attempt.socket->connect(attempt.address, port)) {
+        case sf::Socket::Done:
+        case sf::Socket::NotReady:
+            std::cout << "Connecting to " << attempt.address.toString() << " on port " << port << std::endl;
+            attempts.push_back(std::move(attempt));
+            break;
+        default:
+            lastError = toStr(attempt.address.toString(), ": could not start connecting");
+            std::cout << "Could not connect to " << lastError << std::endl;
+            break;
+    }
+}
+
+TcpConnector::STATUS TcpConnector::update() {
+    if (status != STATUS::CONNECTING)
+        return status;
+    if (waitingForBackoff) {
+        if (roundClock.getElapsedTime() < backoff)
+            return status;
+        waitingForBackoff = false;
+        backoff = sf::milliseconds(backoff.asMilliseconds() * 2);
+        startRound();
+    }
+
+    if (resolving) {
+        std::lock_guard<std::mutex> lock(resolution->mutex);
+        if (!resolution->done) {
+            if (roundClock.getElapsedTime() < sf::milliseconds(CONNECT_ATTEMPT_TIMEOUT_MS))
+                return status;
+            // The resolver thread finishes in the background and is ignored
+            lastError = toStr(host, ": resolving timed out");
+            resolving = false;
+            return finishRoundIfFailed();
+        }
+        resolving = false;
+        addresses = resolution->addresses;
+        if (addresses.empty()) {
+            lastError = toStr(host, ": ", resolution->error);
+            return finishRoundIfFailed();
+        }
+    }
+
+    bool attemptFailed = false;
+    for (auto attempt = attempts.begin(); attempt != attempts.end();) {
+        if (attempt->socket->getRemoteAddress() != sf::IpAddress::None) {
+            connected = std::move(attempt->socket);
+            connectedAddress = attempt->address;
+            attempts.clear();
+            status = STATUS::CONNECTED;
+            std::cout << "Client connected to host at " << connectedAddress.toString() << " on port " << port << std::endl;
+            return status;
+        }
+        auto error = getConnectError(*attempt->socket);
+        if (error.empty() and attempt->clock.getElapsedTime() >= sf::milliseconds(CONNECT_ATTEMPT_TIMEOUT_MS))
+            error = "timed out";
+        if (!error.empty()) {
+            lastError = toStr(attempt->address.toString(), ": ", error);
+            std::cout << "Could not connect to " << lastError << std::endl;
+            attempt = attempts.erase(attempt);
+            attemptFailed = true;
+        } else
+            ++attempt;
+    }
+    if (nextAddress < addresses.size() and (attemptFailed or attempts.empty() or staggerClock.getElapsedTime() >= sf::milliseconds(CONNECT_ATTEMPT_STAGGER_MS)))
+        startAttempt();
+    return finishRoundIfFailed();
+}
+
+TcpConnector::STATUS TcpConnector::finishRoundIfFailed() {
+    if (resolving or !attempts.empty() or nextAddress < addresses.size())
+        return status;
+    if (round >= CONNECT_MAX_ROUNDS) {
+        std::cout << "Giving up connecting to " << host << " after " << round << " rounds" << std::endl;
+        status = STATUS::FAILED;
+        return status;
+    }
+    std::cout << "Retrying to connect to " << host << " in " << backoff.asMilliseconds() << " ms" << std::endl;
+    waitingForBackoff = true;
+    roundClock.restart();
+    return status;
+}
+
+std::unique_ptr<sf::TcpSocket> TcpConnector::takeSocket() {
+    return std::move(connected);
+}
+
+std::string TcpConnector::describe() const {
+    switch (status) {
+        case STATUS::CONNECTED:
+            return toStr("Connected to ", connectedAddress.toString());
+        case STATUS::FAILED:
+            return toStr("Could not connect (", lastError, ")");
+        default:
+            break;
+    }
+    if (waitingForBackoff) {
+        auto remainingSec = static_cast<int>(std::ceil((backoff - roundClock.getElapsedTime()).asSeconds()));
+        return toStr("Could not connect (", lastError, "), retrying in ", std::max(remainingSec, 1), " s...");
+    }
+    auto roundText = round > 1 ? toStr(" (round ", round, " of ", CONNECT_MAX_ROUNDS, ")") : "";
+    if (resolving)
+        return toStr("Resolving ", host, roundText, "...");
+    if (addresses.size() > 1)
+        return toStr("Connecting to ", host, " (trying ", attempts.size(), " of ", addresses.size(), " addresses)", roundText, "...");
+    return toStr("Connecting to ", host, roundText, "...");
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <SFML/Network.hpp>
+
+/***
+ * Connects a TCP socket to a host without ever blocking the caller, so the main menu keeps running at full frame rate
+ * while joining. Call update() every frame until it returns CONNECTED or FAILED.
+ *
+ * The host name is resolved on a background thread (getaddrinfo cannot be interrupted, so the thread is left behind if
+ * it takes longer than CONNECT_ATTEMPT_TIMEOUT_MS or the connector is destroyed). If it resolves to several addresses,
+ * they are tried in parallel, Happy Eyeballs style: the next attempt starts CONNECT_ATTEMPT_STAGGER_MS after the
+ * previous one, or right away once that failed. The first socket to connect wins and the other attempts are dropped.
+ * Attempts fail when the OS reports an error (e.g. connection refused) or after CONNECT_ATTEMPT_TIMEOUT_MS.
+ *
+ * If all addresses failed, the connector resolves the name again and starts another round after a backoff of
+ * CONNECT_RETRY_BACKOFF_MS, doubled each round, and gives up after CONNECT_MAX_ROUNDS rounds.
+ */
+class TcpConnector {
+public:
+    enum class STATUS {
+        CONNECTING, CONNECTED, FAILED
+    };
+
+    TcpConnector(const std::string& host, unsigned short port);
+
+    TcpConnector(const TcpConnector&) = delete;
+    TcpConnector& operator=(const TcpConnector&) = delete;
+
+    // Polls the pending attempts. Never blocks
+    STATUS update();
+    // Once update returned CONNECTED: the connected socket, in non-blocking mode
+    std::unique_ptr<sf::TcpSocket> takeSocket();
+    // For the main menu, e.g. "Connecting to 192.168.0.2 (round 2 of 3)..." or why connecting failed
+    std::string describe() const;
+
+private:
+    // Filled by the resolver thread, which may outlive the connector
+    struct Resolution {
+        std::mutex mutex;
+        bool done = false;
+        std::vector<sf::IpAddress> addresses;
+        std::string error;
+    };
+
+    struct Attempt {
+        std::unique_ptr<sf::TcpSocket> socket;
+        sf::IpAddress address;
+        sf::Clock clock;
+    };
+
+    void startRound();
+    void startAttempt();
+    // Ends the round if no attempt is left. Returns the new status
+    STATUS finishRoundIfFailed();
+
+    std::string host;
+    unsigned short port;
+    STATUS status;
+    unsigned int round;
+    // Since the current round (or its backoff) started
+    sf::Clock roundClock;
+    sf::Time backoff;
+    bool waitingForBackoff;
+
+    std::shared_ptr<Resolution> resolution;
+    bool resolving;
+    std::vector<sf::IpAddress> addresses;
+    // Index of the next address to try in this round
+    std::size_t nextAddress;
+    // Since the last attempt started
+    sf::Clock staggerClock;
+    std::vector<Attempt> attempts;
+    std::unique_ptr<sf::TcpSocket> connected;
+    sf::IpAddress connectedAddress;
+    // Why the last attempt failed
+    std::string lastError;
+};
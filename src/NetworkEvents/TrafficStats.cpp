@@ -0,0 +1,38 @@
+#include "TrafficStats.h"
+#include "../Constants.h"
+#include "../Util.h"
+
+TrafficStats::TrafficStats() : bytesSentPerSec(0), bytesReceivedPerSec(0), packetsSentPerSec(0), packetsReceivedPerSec(0),
+                               bytesSent(0), bytesReceived(0), packetsSent(0), packetsReceived(0) { }
+
+void TrafficStats::countSent(const sf::Packet& packet) {
+    countSent(packet.getDataSize());
+}
+
+void TrafficStats::countSent(std::size_t numBytes) {
+    bytesSent += numBytes;
+    packetsSent++;
+}
+
+void TrafficStats::countReceived(const sf::Packet& packet) {
+    bytesReceived += packet.getDataSize();
+    packetsReceived++;
+}
+
+void TrafficStats::update() {
+    auto seconds = intervalClock.getElapsedTime().asSeconds();
+    if (seconds * 1000 < NETWORK_STATS_INTERVAL_MS)
+        return;
+    bytesSentPerSec = bytesSent / seconds;
+    bytesReceivedPerSec = bytesReceived / seconds;
+    packetsSentPerSec = packetsSent / seconds;
+    packetsReceivedPerSec = packetsReceived / seconds;
+    bytesSent = bytesReceived = 0;
+    packetsSent = packetsReceived = 0;
+    intervalClock.restart();
+}
+
+std::string TrafficStats::toString() const {
+    return toStr("in ", static_cast<int>(bytesReceivedPerSec), " B/s (", static_cast<int>(packetsReceivedPerSec), " pkt/s), out ",
+                 static_cast<int>(bytesSentPerSec), " B/s (", static_cast<int>(packetsSentPerSec), " pkt/s)");
+}
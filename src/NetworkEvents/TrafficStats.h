@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+#include <SFML/Network.hpp>
+
+/***
+ * Counts the packets and payload bytes (without TCP/UDP headers) sent and received over one connection, for the
+ * network statistics in the F overlay and the --net-stats log.
+ *
+ * update() should be called once per frame. Every NETWORK_STATS_INTERVAL_MS, it turns the counts of the past interval
+ * into rates per second.
+ */
+class TrafficStats {
+public:
+    TrafficStats();
+
+    void countSent(const sf::Packet& packet);
+    // For data sent without an sf::Packet (e.g. the shared buffers of GameServer's spectators)
+    void countSent(std::size_t numBytes);
+    void countReceived(const sf::Packet& packet);
+
+    void update();
+
+    // E.g. "in 1.2 kB/s (10 pkt/s), out 0.3 kB/s (10 pkt/s)"
+    std::string toString() const;
+
+    float bytesSentPerSec;
+    float bytesReceivedPerSec;
+    float packetsSentPerSec;
+    float packetsReceivedPerSec;
+
+private:
+    sf::Clock intervalClock;
+    sf::Uint64 bytesSent;
+    sf::Uint64 bytesReceived;
+    unsigned int packetsSent;
+    unsigned int packetsReceived;
+};
@@ -0,0 +1,48 @@
+#include "WireFormat.h"
+#include <stdexcept>
+#include <cstring>
+
+void writeVarUint(sf::Packet& packet, sf::Uint64 value) {
+    while (value >= 0x80) {
+        packet << static_cast<sf::Uint8>((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    packet << static_cast<sf::Uint8>(value);
+}
+
+sf::Uint64 readVarUint(sf::Packet& packet) {
+    sf::Uint64 value = 0;
+    for (unsigned int shift = 0; shift < 64; shift += 7) {
+        sf::Uint8 byte;
+        if (!(packet >> byte))
+            throw std::runtime_error("Truncated varint in packet");
+        value |= static_cast<sf::Uint64>(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return value;
+    }
+    throw std::runtime_error("Malformed varint in packet");
+}
+
+void writeVarInt(sf::Packet& packet, sf::Int64 value) {
+    writeVarUint(packet, (static_cast<sf::Uint64>(value) << 1) ^ static_cast<sf::Uint64>(value >> 63));
+}
+
+sf::Int64 readVarInt(sf::Packet& packet) {
+    auto zigzag = readVarUint(packet);
+    return static_cast<sf::Int64>(zigzag >> 1) ^ -static_cast<sf::Int64>(zigzag & 1);
+}
+
+void writeFloat(sf::Packet& packet, float value) {
+    sf::Uint32 bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    packet << bits;
+}
+
+float readFloat(sf::Packet& packet) {
+    sf::Uint32 bits;
+    if (!(packet >> bits))
+        throw std::runtime_error("Truncated float in packet");
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
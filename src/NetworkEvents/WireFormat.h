@@ -0,0 +1,31 @@
+#pragma once
+/***
+ * Helpers for the compact binary encoding of Actions and Events.
+ *
+ * Integers are written as varints: 7 bits per byte, least significant group first, with the high bit of each byte set
+ * if more bytes follow. So values below 128 (most IDs, skill numbers and step deltas) take a single byte.
+ * Signed integers are zigzag-encoded first (0, -1, 1, -2, ... become 0, 1, 2, 3, ...), so small negative values are short, too.
+ *
+ * The read functions throw std::runtime_error on truncated or malformed data.
+ */
+
+#include <SFML/Network.hpp>
+
+void writeVarUint(sf::Packet& packet, sf::Uint64 value);
+sf::Uint64 readVarUint(sf::Packet& packet);
+
+void writeVarInt(sf::Packet& packet, sf::Int64 value);
+sf::Int64 readVarInt(sf::Packet& packet);
+
+// Fixed point numbers (FPMNum, FPMNum24) are written as varints of their raw values
+template <typename T> void writeFixed(sf::Packet& packet, T value) {
+    writeVarInt(packet, value.raw_value());
+}
+
+template <typename T> T readFixed(sf::Packet& packet) {
+    return T::from_raw_value(static_cast<decltype(T().raw_value())>(readVarInt(packet)));
+}
+
+// Floats are written bit for bit, in network byte order
+void writeFloat(sf::Packet& packet, float value);
+float readFloat(sf::Packet& packet);
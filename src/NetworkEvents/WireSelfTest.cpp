@@ -0,0 +1,315 @@
+#include "WireSelfTest.h"
+#include <limits>
+#include <iostream>
+#include "WireFormat.h"
+#include "EventBatch.h"
+#include "../Constants.h"
+
+namespace {
+    const std::vector<sf::Uint32> idBoundaries = {0, 1, 127, 128, 16383, 16384, std::numeric_limits<sf::Uint32>::max()};
+
+    std::vector<char> getBytes(const sf::Packet& packet) {
+        auto data = static_cast<const char*>(packet.getData());
+        return std::vector<char>(data, data + packet.getDataSize());
+    }
+
+    template <typename T> std::vector<char> encode(const T& t) {
+        sf::Packet packet;
+        packet << t;
+        return getBytes(packet);
+    }
+
+    sf::Packet toPacket(const std::vector<char>& bytes, std::size_t length) {
+        sf::Packet packet;
+        if (length > 0)
+            packet.append(bytes.data(), length);
+        return packet;
+    }
+
+    template <typename T> bool isRejected(const std::vector<char>& bytes, std::size_t length) {
+        auto packet = toPacket(bytes, length);
+        try {
+            T t;
+            packet >> t;
+            return !packet;
+        } catch (const std::runtime_error&) {
+            return true;
+        }
+    }
+
+    std::vector<Action> getTestActions() {
+        std::vector<Action> actions;
+        for (int keys = 0; keys < 16; keys++)
+            actions.emplace_back(Action::MovementKeysChangedAction{{(keys & 1) != 0, (keys & 2) != 0, (keys & 4) != 0, (keys & 8) != 0}});
+        for (int item = 0; item < static_cast<int>(ITEMS::NUM_ITEMS); item++)
+            actions.emplace_back(Action::BuyItemAction{static_cast<ITEMS>(item)});
+        actions.emplace_back(Action::UsePotionAction{POTIONS::HP});
+        actions.emplace_back(Action::UsePotionAction{POTIONS::MP});
+        for (auto id : idBoundaries) {
+            actions.emplace_back(Action::AttackCharacterAction{id});
+            actions.emplace_back(Action::UseCharacterTargetSkillAction{{id}, id});
+            actions.emplace_back(Action::UseSelfSkillAction{{id}});
+            actions.emplace_back(Action::UpgradeSkillAction{id});
+        }
+        std::vector<FPMRawValue> rawValues = {std::numeric_limits<FPMRawValue>::min(), -1, 0, 1, FPMNum(20.5).raw_value(),
+                                              std::numeric_limits<FPMRawValue>::max()};
+        for (std::size_t i = 0; i < rawValues.size(); i++) {
+            FPMVector2 position(FPMNum::from_raw_value(rawValues[i]), FPMNum::from_raw_value(rawValues[rawValues.size() - 1 - i]));
+            actions.emplace_back(Action::UsePositionTargetSkillAction{{static_cast<sf::Uint32>(i)}, position});
+        }
+        return actions;
+    }
+
+    // In the fixed-width format, actions had their variant index and all fields at full width (bools as one byte each)
+    std::size_t getFixedWidthSize(const Action& a) {
+        std::size_t size = 1;
+        if (std::holds_alternative<Action::MovementKeysChangedAction>(a.data))
+            size += 4;
+        if (std::holds_alternative<Action::AttackCharacterAction>(a.data))
+            size += 4;
+        if (std::holds_alternative<Action::BuyItemAction>(a.data) or std::holds_alternative<Action::UsePotionAction>(a.data))
+            size += 1;
+        if (std::holds_alternative<Action::UseCharacterTargetSkillAction>(a.data))
+            size += 8;
+        if (std::holds_alternative<Action::UsePositionTargetSkillAction>(a.data))
+            size += 4 + 2 * sizeof(FPMRawValue);
+        if (std::holds_alternative<Action::UseSelfSkillAction>(a.data) or std::holds_alternative<Action::UpgradeSkillAction>(a.data))
+            size += 4;
+        return size;
+    }
+
+    // Each event was a packet of its own: the 4 byte size prefix of sf::TcpSocket, the variant index, the 32 bit step,
+    // and for actions the character ID. A NoMoreEvents packet (without character ID) ended each step
+    const std::size_t fixedWidthStepEndSize = 4 + 1 + 4;
+
+    std::size_t getFixedWidthSize(const Event& e) {
+        std::size_t size = 4 + 1 + 4;
+        if (const auto* data = std::get_if<Event::PlayerActionEvent>(&e.data))
+            size += 4 + getFixedWidthSize(data->action);
+        return size;
+    }
+}
+
+bool WireSelfTest::run() {
+    testVarints();
+    testActions();
+    testEvents();
+    testEventBatches();
+    std::cout << "Wire format self test: " << numChecks << " checks, " << numFailures << " failed" << std::endl;
+    printSizes();
+    return numFailures == 0;
+}
+
+void WireSelfTest::check(bool condition, const std::string& description) {
+    numChecks++;
+    if (!condition) {
+        numFailures++;
+        std::cout << "FAILED: " << description << std::endl;
+    }
+}
+
+template <typename T> void WireSelfTest::checkRoundTrip(const T& original, const std::string& description) {
+    auto bytes = encode(original);
+    auto packet = toPacket(bytes, bytes.size());
+    bool passed = false;
+    try {
+        T decoded;
+        packet >> decoded;
+        passed = packet and packet.endOfPacket() and encode(decoded) == bytes;
+    } catch (const std::runtime_error& e) {
+        std::cout << description << ": " << e.what() << std::endl;
+    }
+    check(passed, description + " round trip");
+    bool allRejected = true;
+    for (std::size_t length = 0; length < bytes.size(); length++)
+        allRejected = isRejected<T>(bytes, length) and allRejected;
+    check(allRejected, description + " truncated");
+}
+
+template <typename T> void WireSelfTest::checkRejected(const std::vector<char>& bytes, const std::string& description) {
+    check(isRejected<T>(bytes, bytes.size()), description + " rejected");
+}
+
+void WireSelfTest::testVarints() {
+    std::vector<std::pair<sf::Uint64, std::size_t>> unsignedValues = {
+            {0, 1}, {1, 1}, {127, 1}, {128, 2}, {16383, 2}, {16384, 3}, {std::numeric_limits<sf::Uint32>::max(), 5},
+            {sf::Uint64(1) << 63, 10}, {std::numeric_limits<sf::Uint64>::max(), 10}};
+    for (const auto& v : unsignedValues) {
+        sf::Packet packet;
+        writeVarUint(packet, v.first);
+        check(packet.getDataSize() == v.second, toStr("varuint ", v.first, " takes ", v.second, " bytes"));
+        bool passed = false;
+        try {
+            passed = readVarUint(packet) == v.first and packet.endOfPacket();
+        } catch (const std::runtime_error&) { }
+        check(passed, toStr("varuint ", v.first, " round trip"));
+    }
+    // Zigzag: small magnitudes of either sign take one byte
+    std::vector<std::pair<sf::Int64, std::size_t>> signedValues = {
+            {0, 1}, {-1, 1}, {1, 1}, {-64, 1}, {63, 1}, {-65, 2}, {64, 2},
+            {std::numeric_limits<sf::Int32>::min(), 5}, {std::numeric_limits<sf::Int32>::max(), 5},
+            {std::numeric_limits<sf::Int64>::min(), 10}, {std::numeric_limits<sf::Int64>::max(), 10}};
+    for (const auto& v : signedValues) {
+        sf::Packet packet;
+        writeVarInt(packet, v.first);
+        check(packet.getDataSize() == v.second, toStr("varint ", v.first, " takes ", v.second, " bytes"));
+        bool passed = false;
+        try {
+            passed = readVarInt(packet) == v.first and packet.endOfPacket();
+        } catch (const std::runtime_error&) { }
+        check(passed, toStr("varint ", v.first, " round trip"));
+    }
+    auto rejectsVarint = [](const std::vector<char>& bytes) {
+        auto packet = toPacket(bytes, bytes.size());
+        try {
+            readVarUint(packet);
+            return false;
+        } catch (const std::runtime_error&) {
+            return true;
+        }
+    };
+    check(rejectsVarint({}), "empty varint rejected");
+    check(rejectsVarint({static_cast<char>(0x80)}), "truncated varint rejected");
+    check(rejectsVarint(std::vector<char>(11, static_cast<char>(0xFF))), "overlong varint rejected");
+}
+
+void WireSelfTest::testActions() {
+    auto actions = getTestActions();
+    for (std::size_t i = 0; i < actions.size(); i++)
+        checkRoundTrip(actions[i], toStr("action ", i, " (variant ", actions[i].data.index(), ")"));
+    sf::Packet packet;
+    packet << static_cast<sf::Uint8>(0);
+    checkRejected<Action>(getBytes(packet), "empty action");
+    packet.clear();
+    packet << static_cast<sf::Uint8>(std::variant_size_v<decltype(Action::data)>);
+    checkRejected<Action>(getBytes(packet), "unknown action");
+}
+
+void WireSelfTest::testEvents() {
+    auto actions = getTestActions();
+    for (std::size_t i = 0; i < actions.size(); i++) {
+        auto characterID = idBoundaries[i % idBoundaries.size()];
+        checkRoundTrip(Event(Event::PlayerActionEvent{characterID, actions[i]}, 1), toStr("action event ", i));
+    }
+    // Traced actions carry the host's times in ms
+    for (auto sequence : idBoundaries) {
+        Action traced(Action::MovementKeysChangedAction{{true, false, false, true}});
+        traced.trace.sequence = sequence;
+        traced.trace.hostReceivedUS = sf::Int64(86400) * 1000 * 1000;
+        traced.trace.hostWaitUS = 42000;
+        checkRoundTrip(Event(Event::PlayerActionEvent{5, traced}, 1), toStr("traced action event ", sequence));
+    }
+    for (int steps : {1, INPUT_DELAY_MAX_STEPS, 255})
+        checkRoundTrip(Event(Event::InputDelayChangedEvent{static_cast<sf::Uint8>(steps)}, 1), toStr("input delay event ", steps));
+    checkRoundTrip(Event(Event::PlayerJoinedEvent{"", CHARACTERS::KNIGHT}, 1), "player joined event without name");
+    for (int type = 0; type < static_cast<int>(CHARACTERS::CHARACTERS_COUNT); type++)
+        checkRoundTrip(Event(Event::PlayerJoinedEvent{"Chantal", static_cast<CHARACTERS>(type)}, 1), toStr("player joined event ", type));
+    checkRoundTrip(Event(Event::PlayerJoinedEvent{"Elfriede123", CHARACTERS::MONK}, 1), "player joined event with long name");
+
+    sf::Packet packet;
+    packet << static_cast<sf::Uint8>(0);
+    checkRejected<Event>(getBytes(packet), "empty event");
+    packet.clear();
+    packet << static_cast<sf::Uint8>(std::variant_size_v<decltype(Event::data)>);
+    checkRejected<Event>(getBytes(packet), "unknown event");
+    packet.clear();
+    packet << static_cast<sf::Uint8>(Event(Event::InputDelayChangedEvent{1}, 1).data.index()) << static_cast<sf::Uint8>(0);
+    checkRejected<Event>(getBytes(packet), "input delay of 0");
+    packet.clear();
+    packet << static_cast<sf::Uint8>(Event(Event::PlayerJoinedEvent{}, 1).data.index()) << std::string("Gudrun")
+           << static_cast<sf::Uint8>(CHARACTERS::CHARACTERS_COUNT);
+    checkRejected<Event>(getBytes(packet), "unknown character type");
+}
+
+void WireSelfTest::testEventBatches() {
+    Event move(Event::PlayerActionEvent{3, Action(Action::MovementKeysChangedAction{{false, true, true, false}})}, 0);
+    Event join(Event::PlayerJoinedEvent{"Helga", CHARACTERS::ARCHER}, 0);
+
+    EventBatch batch;
+    batch.addStep(1, std::vector<Event>());
+    checkRoundTrip(batch, "batch of one empty step");
+
+    // Several events in one step (step delta 0), empty steps and large deltas
+    batch.clear();
+    for (sf::Uint32 step = 1; step <= 1000; step++) {
+        std::vector<Event> stepEvents;
+        if (step == 1 or step == 500 or step == 1000) {
+            move.simulationStep = join.simulationStep = step;
+            stepEvents = {move, join};
+        }
+        batch.addStep(step, stepEvents);
+    }
+    checkRoundTrip(batch, "batch of 1000 steps");
+
+    batch.clear();
+    auto lastStep = std::numeric_limits<sf::Uint32>::max();
+    for (auto step = lastStep - 100; step != 0 and step <= lastStep; step++) {
+        move.simulationStep = step;
+        batch.addStep(step, step == lastStep ? std::vector<Event>{move} : std::vector<Event>());
+    }
+    checkRoundTrip(batch, "batch at the end of the step range");
+
+    auto encodeBatch = [](sf::Uint64 firstStep, sf::Uint64 stepDelta, sf::Uint64 numEvents, const std::vector<std::pair<sf::Uint64, Event>>& events) {
+        sf::Packet packet;
+        writeVarUint(packet, firstStep);
+        writeVarUint(packet, stepDelta);
+        writeVarUint(packet, numEvents);
+        for (const auto& e : events) {
+            writeVarUint(packet, e.first);
+            packet << e.second;
+        }
+        return getBytes(packet);
+    };
+    checkRejected<EventBatch>(encodeBatch(0, 0, 0, {}), "batch starting at step 0");
+    checkRejected<EventBatch>(encodeBatch(std::numeric_limits<sf::Uint32>::max(), 1, 0, {}), "batch with wrapping step range");
+    checkRejected<EventBatch>(encodeBatch(1, 0, 1, {{1, move}}), "batch with event after its last step");
+    checkRejected<EventBatch>(encodeBatch(1, 0, 1000000, {{0, move}}), "batch with too many events");
+}
+
+void WireSelfTest::printSizes() {
+    std::cout << "Encoded sizes (fixed-width format before the compact encoding in brackets):" << std::endl;
+    struct NamedAction {
+        const char* name;
+        Action action;
+    };
+    std::vector<NamedAction> namedActions = {
+            {"MovementKeysChanged", Action(Action::MovementKeysChangedAction{{true, false, false, false}})},
+            {"AttackCharacter", Action(Action::AttackCharacterAction{300})},
+            {"BuyItem", Action(Action::BuyItemAction{ITEMS::HP_POTION})},
+            {"UseCharacterTargetSkill", Action(Action::UseCharacterTargetSkillAction{{1}, 300})},
+            {"UsePositionTargetSkill", Action(Action::UsePositionTargetSkillAction{{2}, FPMVector2(FPMNum(40.25), FPMNum(12.5))})},
+            {"UseSelfSkill", Action(Action::UseSelfSkillAction{{0}})}};
+    for (const auto& a : namedActions)
+        std::cout << "  " << a.name << " action: " << encode(a.action).size() << " bytes (" << getFixedWidthSize(a.action) << ")" << std::endl;
+
+    // Over TCP, a batch is one packet: sf::TcpSocket's 4 byte size prefix, the packet type and the batch
+    auto printStep = [](const std::string& name, unsigned int numSteps, const std::vector<Action>& actions) {
+        EventBatch batch;
+        std::size_t fixedWidthBytes = 0;
+        for (unsigned int step = 1; step <= numSteps; step++) {
+            std::vector<Event> stepEvents;
+            for (std::size_t i = 0; i < actions.size(); i++)
+                stepEvents.emplace_back(Event::PlayerActionEvent{static_cast<sf::Uint32>(i % MAX_NUM_PLAYERS), actions[i]}, step);
+            for (const auto& e : stepEvents)
+                fixedWidthBytes += getFixedWidthSize(e);
+            fixedWidthBytes += fixedWidthStepEndSize;
+            batch.addStep(step, stepEvents);
+        }
+        auto bytes = 4 + 1 + encode(batch).size();
+        std::cout << "  " << name << ": " << static_cast<float>(bytes) / numSteps << " bytes per step ("
+                  << static_cast<float>(fixedWidthBytes) / numSteps << ")" << std::endl;
+    };
+    Action move(Action::MovementKeysChangedAction{{true, false, false, false}});
+    std::vector<Action> busyActions;
+    for (int i = 0; i < MAX_NUM_PLAYERS; i++)
+        busyActions.push_back(move);
+    auto movingActions = busyActions;
+    for (const auto& a : namedActions)
+        if (!std::holds_alternative<Action::MovementKeysChangedAction>(a.action.data))
+            busyActions.push_back(a.action);
+    printStep("Idle step", 1, {});
+    printStep("3 idle steps in one batch", 3, {});
+    printStep("1 player changing movement", 1, {move});
+    printStep(toStr(MAX_NUM_PLAYERS, " players changing movement"), 1, movingActions);
+    printStep(toStr(MAX_NUM_PLAYERS, " players changing movement, plus one of each other action"), 1, busyActions);
+}
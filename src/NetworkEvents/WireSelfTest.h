@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <SFML/Network.hpp>
+
+/***
+ * Self test of the wire format (see WireFormat.h), run with ./Arena --wire-selftest. It needs no window, map or network.
+ *
+ * Every Action and Event variant, varints and EventBatches are encoded and decoded again, with boundary values (e.g.
+ * the largest IDs, the extreme raw fixed point values, step ranges near the end of the Uint32 range). A round trip passes
+ * if the whole input was read and encoding the result gives the same bytes. Every truncated prefix of each encoding, and
+ * some malformed input (overlong varints, unknown variants, invalid step ranges), must be rejected with an exception.
+ *
+ * Afterwards, the bytes per step of typical steps are printed next to the fixed-width format used before the compact
+ * encoding, where each event was a packet of its own with a 32 bit step, and each step ended with a NoMoreEvents packet.
+ */
+class WireSelfTest {
+public:
+    // Returns false if any check failed
+    bool run();
+
+private:
+    void testVarints();
+    void testActions();
+    void testEvents();
+    void testEventBatches();
+    void printSizes();
+
+    void check(bool condition, const std::string& description);
+    // Decode bytes as T, encode the result again and compare. Also checks that all truncated prefixes are rejected
+    template <typename T> void checkRoundTrip(const T& original, const std::string& description);
+    // The bytes must not decode as T
+    template <typename T> void checkRejected(const std::vector<char>& bytes, const std::string& description);
+
+    unsigned int numChecks = 0;
+    unsigned int numFailures = 0;
+};
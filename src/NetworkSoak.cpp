@@ -0,0 +1,95 @@
+#include "NetworkSoak.h"
+#include <iostream>
+#include <algorithm>
+#include "GameStates/GameServer.h"
+#include "GameStates/GameClient.h"
+
+NetworkSoak::NetworkSoak(unsigned int numClients, unsigned int durationSec) : numClients(numClients), durationSec(durationSec) { }
+
+std::vector<NetworkProfile> NetworkSoak::getDefaultProfiles() {
+    return {{"lan", 1, 0, 0.f, 0},
+            {"dsl", 20, 5, 0.005f, 125000},
+            {"wifi", 40, 30, 0.01f, 500000},
+            {"mobile", 80, 60, 0.03f, 32000}};
+}
+
+bool NetworkSoak::run(const NetworkProfile& profile) {
+    std::mt19937 gen(1234);
+    auto randomSeed = static_cast<sf::Uint32>(gen());
+    const std::array<CHARACTERS, 4> characterTypes = {CHARACTERS::KNIGHT, CHARACTERS::MAGE, CHARACTERS::ARCHER, CHARACTERS::MONK};
+
+    // The same start data as the lobbies would pass on, but with loopback connections instead of sockets
+    auto serverStartData = std::make_shared<GameServerStartData>();
+    serverStartData->randomSeed = randomSeed;
+    std::vector<std::pair<std::string, CHARACTERS>> playersList;
+    for (unsigned int i = 0; i < numClients; i++)
+        playersList.emplace_back(toStr("Bot ", i + 1), characterTypes[i % characterTypes.size()]);
+    std::vector<std::unique_ptr<GameClient>> clients;
+    std::vector<std::shared_ptr<GameClientStartData>> clientStartData;
+    for (unsigned int i = 0; i < numClients; i++) {
+        auto connections = LoopbackConnection::createPair(profile, gen());
+        serverStartData->clients.emplace_back(std::move(connections.first), playersList[i]);
+        auto startData = std::make_shared<GameClientStartData>();
+        startData->playersList = playersList;
+        startData->playerName = playersList[i].first;
+        startData->hostIP = "loopback";
+        startData->connection = std::move(connections.second);
+        startData->randomSeed = randomSeed;
+        startData->serverUdpPort = 0;
+        startData->spectate = false;
+        startData->catchUpStep = 0;
+        clientStartData.push_back(startData);
+        clients.push_back(std::make_unique<GameClient>());
+    }
+
+    GameServer server;
+    server.start(serverStartData);
+    for (unsigned int i = 0; i < numClients; i++)
+        clients[i]->start(clientStartData[i]);
+
+    bool completed = true;
+    sf::Clock soakClock;
+    sf::Clock botClock;
+    std::bernoulli_distribution keyDistribution(0.3);
+    while (completed and soakClock.getElapsedTime() < sf::seconds(durationSec)) {
+        completed = server.run() == GameState::GameServer;
+        for (auto& c : clients)
+            completed = completed and c->run() == GameState::GameClient;
+        if (botClock.getElapsedTime() >= sf::milliseconds(SOAK_BOT_ACTION_INTERVAL_MS)) {
+            botClock.restart();
+            for (auto& c : clients) {
+                Action::MovementKeysChangedAction keys{{keyDistribution(gen), keyDistribution(gen), keyDistribution(gen), keyDistribution(gen)}};
+                c->addLocalAction(std::make_unique<Action>(keys));
+            }
+        }
+    }
+
+    // Percentiles over all steps of all clients
+    std::vector<unsigned int> stallsMS;
+    for (const auto& c : clients)
+        stallsMS.insert(stallsMS.end(), c->getStepStallsMS().begin(), c->getStepStallsMS().end());
+    std::vector<std::vector<std::string>> latencyLines;
+    for (const auto& c : clients)
+        latencyLines.push_back(c->describeInputLatency());
+    for (auto& c : clients)
+        c->end();
+    server.end();
+    if (!completed)
+        std::cout << "Profile " << profile.name << ": the game ended before the soak test was over" << std::endl;
+    if (stallsMS.empty()) {
+        std::cout << "Profile " << profile.name << ": no simulation steps executed" << std::endl;
+        return false;
+    }
+    std::sort(stallsMS.begin(), stallsMS.end());
+    auto percentile = [&stallsMS](float p) { return stallsMS[std::min<std::size_t>(stallsMS.size() - 1, static_cast<std::size_t>(p * stallsMS.size()))]; };
+    auto numStalled = std::count_if(stallsMS.begin(), stallsMS.end(), [](unsigned int s) { return s > 0; });
+    std::cout << "Profile " << profile.name << " (" << profile.latencyMS << " ms + up to " << profile.jitterMS << " ms jitter, "
+              << profile.lossRate * 100 << "% loss, " << (profile.bytesPerSecond == 0 ? std::string("unlimited") : toStr(profile.bytesPerSecond / 1000, " kB/s")) << "): "
+              << numClients << " clients, " << stallsMS.size() << " steps, " << 100.f * numStalled / stallsMS.size() << "% stalled, stall p50 "
+              << percentile(0.5f) << " ms, p90 " << percentile(0.9f) << " ms, p99 " << percentile(0.99f) << " ms, max " << stallsMS.back() << " ms" << std::endl;
+    for (unsigned int i = 0; i < numClients; i++) {
+        for (const auto& line : latencyLines[i])
+            std::cout << "  " << playersList[i].first << ": " << line << std::endl;
+    }
+    return completed;
+}
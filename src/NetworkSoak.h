@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include "NetworkEvents/LoopbackConnection.h"
+
+/***
+ * Soak test for the network code: runs a GameServer and numClients GameClients in one process, connected by
+ * LoopbackConnections that simulate the given network conditions. The clients are bots that change their movement keys
+ * every SOAK_BOT_ACTION_INTERVAL_MS. After durationSec seconds (in real time, since the game is paced by the clock),
+ * the percentiles of how long the clients' simulation steps were overdue are printed, and with Game::traceLatency also
+ * each bot's input latency (see LatencyTrace.h).
+ *
+ * Everything runs headless, so GameState::headless must be set and the static resources loaded accordingly.
+ */
+class NetworkSoak {
+public:
+    NetworkSoak(unsigned int numClients, unsigned int durationSec);
+
+    // Returns false if the server or a client left the game before the end
+    bool run(const NetworkProfile& profile);
+
+    // From a local network to a congested mobile connection
+    static std::vector<NetworkProfile> getDefaultProfiles();
+
+private:
+    unsigned int numClients;
+    unsigned int durationSec;
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <random>
+#include <SFML/System.hpp>
+
+/***
+ * A std::mt19937 that remembers its seed and how many numbers it has produced. The full state of the engine takes
+ * 2.5 KB, so checkpoints (see Game::saveCheckpoint) store these two values instead and restore the state by seeding
+ * the engine again and skipping the numbers that were already produced.
+ */
+class RandomGenerator {
+public:
+    typedef std::mt19937::result_type result_type;
+
+    explicit RandomGenerator(result_type seed = std::mt19937::default_seed) { this->seed(seed); }
+
+    void seed(result_type seed) { restore(seed, 0); }
+
+    void restore(result_type seed, sf::Uint64 numDrawn) {
+        engine.seed(seed);
+        engine.discard(numDrawn);
+        initialSeed = seed;
+        this->numDrawn = numDrawn;
+    }
+
+    result_type operator()() {
+        numDrawn++;
+        return engine();
+    }
+
+    static constexpr result_type min() { return std::mt19937::min(); }
+
+    static constexpr result_type max() { return std::mt19937::max(); }
+
+    result_type getSeed() const { return initialSeed; }
+
+    sf::Uint64 getNumDrawn() const { return numDrawn; }
+
+private:
+    std::mt19937 engine;
+    result_type initialSeed;
+    sf::Uint64 numDrawn;
+};
@@ -1,11 +1,28 @@
 #include "AnimatedTileset.h"
 
 AnimatedTileset::AnimatedTileset(const std::string &path, int numTilesAnimation, int originX, int originY,
-                                 int tilesetTileWidth, int tilesetTileHeight, float defaultAnimationStepsPerSecond) {
-    if (!this->texture.loadFromFile(path))
+                                 int tilesetTileWidth, int tilesetTileHeight, float defaultAnimationStepsPerSecond,
+                                 bool loadTexture) {
+    if (loadTexture and !this->texture.loadFromFile(path))
         throw std::runtime_error(toStr("Could not load tileset ", path));
-    assert(texture.getSize().x % tilesetTileWidth == 0 && texture.getSize().y % tilesetTileHeight == 0);
-    this->tilesetTilesPerColumn = texture.getSize().x / tilesetTileWidth;
+    init(loadTexture, numTilesAnimation, originX, originY, tilesetTileWidth, tilesetTileHeight, defaultAnimationStepsPerSecond);
+}
+
+AnimatedTileset::AnimatedTileset(const sf::Image &image, int numTilesAnimation, int originX, int originY,
+                                 int tilesetTileWidth, int tilesetTileHeight, float defaultAnimationStepsPerSecond) {
+    // Uploading the texture needs the OpenGL context, so it happens here on the calling thread
+    if (!this->texture.loadFromImage(image))
+        throw std::runtime_error("Could not create tileset texture");
+    init(true, numTilesAnimation, originX, originY, tilesetTileWidth, tilesetTileHeight, defaultAnimationStepsPerSecond);
+}
+
+void AnimatedTileset::init(bool textureLoaded, int numTilesAnimation, int originX, int originY,
+                           int tilesetTileWidth, int tilesetTileHeight, float defaultAnimationStepsPerSecond) {
+    if (textureLoaded) {
+        assert(texture.getSize().x % tilesetTileWidth == 0 && texture.getSize().y % tilesetTileHeight == 0);
+        this->tilesetTilesPerColumn = texture.getSize().x / tilesetTileWidth;
+    } else
+        this->tilesetTilesPerColumn = 1;
     // unsigned int numRows = texture.getSize().y / tilesetTileHeight;
     // assert(numRows * tilesetTilesPerColumn >= numTilesAnimation * static_cast<unsigned int>(ORIENTATIONS::NUM_ORIENTATIONS));
     this->numTilesAnimation = numTilesAnimation;
@@ -12,10 +12,16 @@
  * the number of animation steps per animation (assumed to be the same for all animations).
  * Usually, the tile sheets contain characters and the different animations correspond to the character's
  * orientation (i.e. facing east, west, north etc.).
+ * Without the texture (loadTexture = false, e.g. on the dedicated server), only the animation information is available.
  */
 class AnimatedTileset {
 public:
     AnimatedTileset(const std::string &path, int numTilesAnimation, int originX,
+                    int originY, int tilesetTileWidth, int tilesetTileHeight, float defaultAnimationStepsPerSecond,
+                    bool loadTexture = true);
+
+    // Same, but with the tile sheet already decoded (e.g., by a job, see Character::loadStaticResources)
+    AnimatedTileset(const sf::Image &image, int numTilesAnimation, int originX,
                     int originY, int tilesetTileWidth, int tilesetTileHeight, float defaultAnimationStepsPerSecond);
 
     sf::Vector2f getOrigin() const { return {static_cast<float>(originX), static_cast<float>(originY)}; }
@@ -31,6 +37,8 @@ public:
     sf::IntRect getTileCoordinates(unsigned int animationIndex, unsigned int animationStep) const;
 
 private:
+    void init(bool textureLoaded, int numTilesAnimation, int originX, int originY, int tilesetTileWidth, int tilesetTileHeight, float defaultAnimationStepsPerSecond);
+
     unsigned int tilesetTilesPerColumn;
     unsigned int numTilesAnimation;
     unsigned int tilesetTileWidth;
@@ -47,7 +47,7 @@ bool Arrow::update(const sf::FloatRect &frustum, float elapsedSeconds, unsigned
     if (visible) {
         sprite.setPosition(worldPositionToRender);
         auto mapPositionToRender = tilemap->worldToMap(worldPositionToRender);
-        sprite.setDepth(1.f - ((((unsigned int) mapPositionToRender.y) * tilemap->getWidth() + (float) mapPositionToRender.x) / (tilemap->getHeight() * tilemap->getWidth())));
+        sprite.setDepth(tilemap->getDepth(mapPositionToRender));
     }
     return visible;
 }
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <chrono>
+#include <unordered_map>
+#include "../GameObjects/Character.h"
+
+/***
+ * The state of all living characters after a simulation step, as far as the rendering needs it. The simulation thread
+ * publishes a new snapshot after each step it executes (see Game::publishRenderSnapshot), and the render thread
+ * interpolates from it without locking the world. A snapshot is never changed once published.
+ *
+ * The characters are referenced so that the rendering can update and draw their sprites, which only it touches. The
+ * references also keep characters alive that the simulation has removed in the meantime.
+ */
+struct RenderSnapshot {
+    // The step after which the snapshot was taken
+    unsigned int simulationStep = 0;
+    // Time since that step was due (see Game::simulationTimerMS) when the snapshot was published at publishedAt
+    unsigned int timerMS = 0;
+    std::chrono::steady_clock::time_point publishedAt;
+    // Players first, in the order of their IDs
+    std::vector<std::pair<std::shared_ptr<Character>, CharacterRenderState>> characters;
+    unsigned int numPlayers = 0;
+    // From the character ID to its index in characters
+    std::unordered_map<sf::Uint32, std::size_t> indexByID;
+
+    const CharacterRenderState* find(sf::Uint32 ID) const {
+        auto index = indexByID.find(ID);
+        return index == indexByID.end() ? nullptr : &characters[index->second].second;
+    }
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+/***
+ * Bounded lock-free queue for exactly one producer thread and one consumer thread.
+ *
+ * The producer only writes the tail index and the consumer only writes the head index, each published with release
+ * semantics after the slot has been written or emptied. Neither side ever waits: tryPush fails if the queue is full
+ * (leaving the value untouched) and tryPop fails if it is empty. One slot is kept free to tell a full queue from an empty one.
+ */
+template <typename T>
+class SpscQueue {
+public:
+    explicit SpscQueue(std::size_t capacity) : slots(capacity + 1), head(0), tail(0) { }
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // Only called by the producer. The value is moved into the queue on success
+    bool tryPush(T& value) {
+        auto curTail = tail.load(std::memory_order_relaxed);
+        auto nextTail = (curTail + 1) % slots.size();
+        if (nextTail == head.load(std::memory_order_acquire))
+            return false;
+        slots[curTail] = std::move(value);
+        tail.store(nextTail, std::memory_order_release);
+        return true;
+    }
+
+    // Only called by the consumer
+    bool tryPop(T& value) {
+        auto curHead = head.load(std::memory_order_relaxed);
+        if (curHead == tail.load(std::memory_order_acquire))
+            return false;
+        value = std::move(slots[curHead]);
+        head.store((curHead + 1) % slots.size(), std::memory_order_release);
+        return true;
+    }
+
+    // Only exact if neither side is active at the same time, e.g. for statistics
+    std::size_t sizeApprox() const {
+        auto curHead = head.load(std::memory_order_acquire);
+        auto curTail = tail.load(std::memory_order_acquire);
+        return (curTail + slots.size() - curHead) % slots.size();
+    }
+
+private:
+    std::vector<T> slots;
+    // Next slot to pop (written by the consumer) and next slot to push (written by the producer), on separate cache lines
+    alignas(64) std::atomic<std::size_t> head;
+    alignas(64) std::atomic<std::size_t> tail;
+};
@@ -1,18 +1,193 @@
+#include <iostream>
+#include <cstdlib>
 #include "GameStates/GameState.h"
 #include "GameStates/MainMenu.h"
 #include "GameStates/GameServer.h"
 #include "GameStates/GameClient.h"
 #include "GameStates/LobbyServer.h"
 #include "GameStates/LobbyClient.h"
+#include "GameObjects/Tilemap.h"
+#include "MapGenerator.h"
+#include "NetworkSoak.h"
+#include "NetworkEvents/WireSelfTest.h"
+#include "JobSystem.h"
+
+// Handles the --generate-map command line option (see below)
+int generateMap(int argc, char **argv) {
+    if (argc < 3 || argc % 2 != 1) {
+        std::cout << "Usage: " << argv[0] << " --generate-map <out.tmx> [--size N] [--obstacle-density D] [--lanes L] [--seed S]" << std::endl;
+        return 1;
+    }
+    int size = 71;
+    float obstacleDensity = 0.1f;
+    int numLanes = 3;
+    sf::Uint32 seed = 0;
+    try {
+        for (int i = 3; i < argc; i += 2) {
+            std::string option = argv[i];
+            if (option == "--size")
+                size = std::stoi(argv[i + 1]);
+            else if (option == "--obstacle-density")
+                obstacleDensity = std::stof(argv[i + 1]);
+            else if (option == "--lanes")
+                numLanes = std::stoi(argv[i + 1]);
+            else if (option == "--seed")
+                seed = static_cast<sf::Uint32>(std::stoul(argv[i + 1]));
+            else
+                throw std::runtime_error("Unknown option " + option);
+        }
+        MapGenerator(size, obstacleDensity, numLanes, seed).save(argv[2]);
+    } catch (const std::exception &e) {
+        std::cout << "Generating map failed: " << e.what() << std::endl;
+        return 1;
+    }
+#ifndef ARENA_WIDE_FIXED_POINT
+    if (size > 180)
+        std::cout << "Warning: Maps larger than about 180 tiles need a build with ARENA_WIDE_FIXED_POINT enabled" << std::endl;
+#endif
+    std::cout << "Generated " << size << "x" << size << " map " << argv[2] << std::endl;
+    return 0;
+}
+
+// Handles the --soak command line option (see below)
+int runSoak(int argc, char **argv) {
+    unsigned int numClients = 3, durationSec = 60;
+    std::string profileName;
+    try {
+        for (int i = 2; i < argc; i += 2) {
+            std::string option = argv[i];
+            if (i + 1 >= argc)
+                throw std::runtime_error("Missing value for " + option);
+            if (option == "--players")
+                numClients = static_cast<unsigned int>(std::stoul(argv[i + 1]));
+            else if (option == "--seconds")
+                durationSec = static_cast<unsigned int>(std::stoul(argv[i + 1]));
+            else if (option == "--profile")
+                profileName = argv[i + 1];
+            else
+                throw std::runtime_error("Unknown option " + option);
+        }
+        if (numClients < 1 or numClients > MAX_NUM_PLAYERS)
+            throw std::runtime_error(toStr("The number of players must be between 1 and ", MAX_NUM_PLAYERS));
+    } catch (const std::exception &e) {
+        std::cout << e.what() << std::endl;
+        std::cout << "Usage: " << argv[0] << " --soak [--players N] [--seconds S] [--profile lan|dsl|wifi|mobile]" << std::endl;
+        return 1;
+    }
+    auto profiles = NetworkSoak::getDefaultProfiles();
+    if (!profileName.empty()) {
+        profiles.erase(std::remove_if(profiles.begin(), profiles.end(), [&profileName](const auto& p) { return p.name != profileName; }), profiles.end());
+        if (profiles.empty()) {
+            std::cout << "Unknown network profile " << profileName << std::endl;
+            return 1;
+        }
+    }
+    JobSystem::start(JobSystem::getDefaultNumWorkers());
+    GameState::loadStaticResources(true);
+    Game::recordStepStalls = true;
+    Game::traceLatency = true;
+    bool completed = true;
+    for (const auto& profile : profiles)
+        completed = NetworkSoak(numClients, durationSec).run(profile) and completed;
+    GameState::unloadStaticResources();
+    JobSystem::stop();
+    return completed ? 0 : 1;
+}
 
 /***
  * Entry point to the program.
  * Here, we have a state machine running the current GameState until GameState::end is returned.
  *
  * See GameStates/Game.h for the class handling most of the game logic. Also check out README.md.
+ *
+ * Command line options:
+ *   --cook-map <in.tmx> <out.arenamap>   Convert a Tiled map into the binary format loaded by Tilemap and exit
+ *   --generate-map <out.tmx> [--size N] [--obstacle-density D] [--lanes L] [--seed S]
+ *                                        Write a procedurally generated map (see MapGenerator) and exit
+ *   --map <file>                         Play on the given .tmx or .arenamap file instead of the default map
+ *   --udp                                Additionally send game traffic over UDP (if the other side enables it, too)
+ *   --input-delay N                      When hosting, always schedule events N simulation steps ahead instead of
+ *                                        adapting the delay to the network conditions
+ *   --net-stats                          Print network and timing statistics (as in the F overlay) every second
+ *   --trace-latency                      When hosting, tell the players when their actions arrived, so they can trace
+ *                                        their input latency (see LatencyTrace)
+ *   --workers N                          Run jobs on N worker threads (see JobSystem) instead of one less than the
+ *                                        number of cores. 0 runs everything on the threads that wait for the jobs
+ *   --dedicated [--players N]            Run a dedicated server without window or local player. Games start once N
+ *                                        (default 1) players have joined; afterwards, the server returns to the lobby.
+ *                                        Implies --net-stats
+ *   --soak [--players N] [--seconds S] [--profile P]
+ *                                        Run a server and N bot clients (default 3) in this process over simulated
+ *                                        network connections for S seconds (default 60) per network profile, print
+ *                                        percentiles of the simulation stalls and the bots' input latency and exit
+ *                                        (see NetworkSoak)
+ *   --wire-selftest                      Round-trip all actions and events through the network encoding, check that
+ *                                        malformed input is rejected, print the bytes per step and exit (see WireSelfTest)
  */
-int main() {
-    GameState::loadStaticResources();
+int main(int argc, char **argv) {
+    if (argc > 1 && std::string(argv[1]) == "--cook-map") {
+        if (argc != 4) {
+            std::cout << "Usage: " << argv[0] << " --cook-map <in.tmx> <out.arenamap>" << std::endl;
+            return 1;
+        }
+        try {
+            Tilemap(argv[2], false).saveCooked(argv[3]);
+        } catch (const std::exception &e) {
+            std::cout << "Cooking map failed: " << e.what() << std::endl;
+            return 1;
+        }
+        std::cout << "Cooked " << argv[2] << " into " << argv[3] << std::endl;
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--generate-map")
+        return generateMap(argc, argv);
+    if (argc > 1 && std::string(argv[1]) == "--soak")
+        return runSoak(argc, argv);
+    if (argc > 1 && std::string(argv[1]) == "--wire-selftest")
+        return WireSelfTest().run() ? 0 : 1;
+    bool dedicated = false;
+    auto numWorkers = JobSystem::getDefaultNumWorkers();
+    for (int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+        if (option == "--map" && i + 1 < argc)
+            Game::mapFilenameOverride = argv[++i];
+        else if (option == "--udp")
+            Game::udpEnabled = true;
+        else if (option == "--net-stats")
+            Game::logNetworkStats = true;
+        else if (option == "--trace-latency")
+            Game::traceLatency = true;
+        else if (option == "--dedicated")
+            dedicated = true;
+        else if (option == "--workers" && i + 1 < argc && std::atoi(argv[i + 1]) >= 0 && std::atoi(argv[i + 1]) <= JOB_SYSTEM_MAX_WORKERS)
+            numWorkers = std::atoi(argv[++i]);
+        else if (option == "--players" && i + 1 < argc && std::atoi(argv[i + 1]) >= 1 && std::atoi(argv[i + 1]) <= MAX_NUM_PLAYERS)
+            LobbyServer::dedicatedMinPlayers = std::atoi(argv[++i]);
+        else if (option == "--input-delay" && i + 1 < argc && std::atoi(argv[i + 1]) >= 1 && std::atoi(argv[i + 1]) <= INPUT_DELAY_MAX_STEPS)
+            Game::inputDelayOverride = std::atoi(argv[++i]);
+        else {
+            std::cout << "Usage: " << argv[0] << " [--map <file>] [--udp] [--input-delay 1-" << INPUT_DELAY_MAX_STEPS << "] [--net-stats] [--trace-latency] [--workers 0-" << JOB_SYSTEM_MAX_WORKERS << "]"
+                      << " [--dedicated [--players 1-" << MAX_NUM_PLAYERS << "]]" << std::endl;
+            return 1;
+        }
+    }
+
+    if (dedicated)
+        Game::logNetworkStats = true;
+    JobSystem::start(numWorkers);
+    GameState::loadStaticResources(dedicated);
+
+    auto currentState = GameState::MainMenu;
+    std::shared_ptr<void> startData;
+    // The dedicated server skips the main menu and goes straight to hosting a lobby
+    if (dedicated) {
+        startData = LobbyServer::createDedicatedStartData();
+        if (!startData) {
+            JobSystem::stop();
+            return 1;
+        }
+        currentState = GameState::LobbyServer;
+    }
 
     // TODO Better to use RAII idiom and create objects on demand, put code from start-methods into constructor
     auto **gameStates = new GameState *[GameState::End];
@@ -22,8 +197,7 @@ int main() {
     gameStates[GameState::GameServer] = new GameServer();
     gameStates[GameState::GameClient] = new GameClient();
 
-    auto currentState = GameState::MainMenu;
-    gameStates[currentState]->start(nullptr);
+    gameStates[currentState]->start(startData);
     while (true) {
         auto newState = gameStates[currentState]->run();
         if (currentState != newState) {
@@ -39,6 +213,7 @@ int main() {
         delete gameStates[i];
     delete[] gameStates;
     GameState::unloadStaticResources();
+    JobSystem::stop();
 
     return 0;
 }
\ No newline at end of file